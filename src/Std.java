@@ -1,22 +1,95 @@
+import java.io.FileDescriptor;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+
+// Library functions of Tiger. Input and output have buffers of their own, and
+// output is written only by flush, exit and at the end of the program.
 public class Std {
-  public static void print(String s) { System.out.print(s); }
-  public static void printi(int i) { System.out.print(Integer.toString(i)); }
-  public static void flush() { System.out.flush(); }
-  public static String getChar() {
+  private static final FileInputStream in = new FileInputStream(FileDescriptor.in);
+  private static final FileOutputStream out = new FileOutputStream(FileDescriptor.out);
+  private static final byte[] inBuffer = new byte[1 << 16];
+  private static int inStart = 0;
+  private static int inEnd = 0;
+  private static final byte[] outBuffer = new byte[1 << 16];
+  private static int outEnd = 0;
+  // Strings of the characters 0 to 255, which chr and getChar return.
+  private static final String[] chars = new String[256];
+
+  static {
+    for (int i = 0; i < chars.length; i++) chars[i] = String.valueOf((char)i);
+    Runtime.getRuntime().addShutdownHook(new Thread(Std::flush));
+  }
+
+  // Writes characters below 256 as single bytes, as getChar reads them, so that
+  // input is written back as it was. Others, which only chr makes, are written
+  // in UTF-8.
+  public static void print(String s) {
+    for (int i = 0, n = s.length(); i < n; i++) {
+      char c = s.charAt(i);
+      if (c < 0x100) {
+        if (outEnd == outBuffer.length) flush();
+        outBuffer[outEnd++] = (byte)c;
+      } else {
+        int end = Character.isHighSurrogate(c) && i + 1 < n ? i + 2 : i + 1;
+        for (byte b : s.substring(i, end).getBytes(StandardCharsets.UTF_8)) {
+          if (outEnd == outBuffer.length) flush();
+          outBuffer[outEnd++] = b;
+        }
+        i = end - 1;
+      }
+    }
+  }
+  public static void printi(int i) {
+    // Room for the sign and 10 digits.
+    if (outBuffer.length - outEnd < 11) flush();
+    // Digits come from the negated value, as -Integer.MIN_VALUE is no int.
+    if (i < 0) {
+      outBuffer[outEnd++] = '-';
+    } else {
+      i = -i;
+    }
+    int start = outEnd;
+    do {
+      outBuffer[outEnd++] = (byte)('0' - i % 10);
+      i /= 10;
+    } while (i != 0);
+    for (int l = start, r = outEnd - 1; l < r; l++, r--) {
+      byte digit = outBuffer[l];
+      outBuffer[l] = outBuffer[r];
+      outBuffer[r] = digit;
+    }
+  }
+  public static void flush() {
     try {
-      int c = System.in.read();
-      if (c >= 0) return chr(c);
-    } catch (Exception ignored) {
+      out.write(outBuffer, 0, outEnd);
+    } catch (IOException ignored) {
     }
-    return "";
+    outEnd = 0;
+  }
+  public static String getChar() {
+    if (inStart == inEnd) {
+      inStart = 0;
+      try {
+        inEnd = Math.max(in.read(inBuffer), 0);
+      } catch (IOException e) {
+        inEnd = 0;
+      }
+      if (inEnd == 0) return "";
+    }
+    return chars[inBuffer[inStart++] & 255];
   }
   public static int ord(String s) { return s.length() > 0 ? s.charAt(0) : -1; }
-  public static String chr(int i) { return new String(new char[] {(char)i}); }
+  public static String chr(int i) { return i >= 0 && i < chars.length ? chars[i] : String.valueOf((char)i); }
   public static int size(String s) { return s.length(); }
   public static String substring(String s, int f, int n) {
     return s.substring(f, f + n);
   }
   public static String concat(String s, String t) { return s + t; }
   public static int not(int i) { return i == 0 ? 1 : 0; }
-  public static void exit(int i) { System.exit(i); }
+  public static void exit(int i) {
+    flush();
+    System.exit(i);
+  }
 }
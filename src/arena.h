@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace syntax {
+
+// Pointer to a node allocated in an Arena. The arena owns the node, so the
+// pointer is freely copyable and never frees what it points to.
+template <class T>
+class ArenaPtr {
+ public:
+  ArenaPtr() = default;
+  ArenaPtr(std::nullptr_t) {}
+  explicit ArenaPtr(T* p) : p_(p) {}
+
+  T* get() const { return p_; }
+  T& operator*() const { return *p_; }
+  T* operator->() const { return p_; }
+  explicit operator bool() const { return p_ != nullptr; }
+  friend bool operator==(ArenaPtr a, ArenaPtr b) { return a.p_ == b.p_; }
+
+ private:
+  T* p_ = nullptr;
+};
+
+// Sequence of nodes or node pointers allocated in an Arena.
+template <class T>
+using ArenaSpan = std::span<const T>;
+
+// Bump allocator for syntax trees. Hands out memory from a few large blocks
+// and releases them all at once on destruction, without running destructors
+// of the objects allocated in it. Hence it only accepts trivially
+// destructible types, which own no memory outside of the arena.
+class Arena {
+ public:
+  explicit Arena(size_t initial_block_size = 1 << 16) : resource_(initial_block_size) {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // Returns a new T aggregate-initialized from the given arguments.
+  template <class T, class... Args>
+  ArenaPtr<T> New(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena never runs destructors");
+    ++allocations_;
+    return ArenaPtr<T>(new (resource_.allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...});
+  }
+
+  // Returns a copy of the given elements.
+  template <class T>
+  ArenaSpan<T> NewArray(const std::vector<T>& v) {
+    static_assert(std::is_trivially_destructible_v<T>, "Arena never runs destructors");
+    if (v.empty()) return {};
+    ++allocations_;
+    T* data = static_cast<T*>(resource_.allocate(sizeof(T) * v.size(), alignof(T)));
+    std::uninitialized_copy(v.begin(), v.end(), data);
+    return {data, v.size()};
+  }
+
+  // Returns the number of calls to New and NewArray.
+  size_t allocations() const { return allocations_; }
+
+ private:
+  std::pmr::monotonic_buffer_resource resource_;
+  size_t allocations_ = 0;
+};
+
+}  // namespace syntax
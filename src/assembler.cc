@@ -0,0 +1,225 @@
+#include "assembler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "instruction.h"
+
+namespace assembler {
+namespace {
+
+bool IsJump(uint8_t op) { return (op >= _ifeq && op <= _goto) || op == _ifnull || op == _ifnonnull || op == _goto_w; }
+bool IsLoad(uint8_t op) { return op >= _iload && op <= _aload; }
+bool IsStore(uint8_t op) { return op >= _istore && op <= _astore; }
+
+// Returns the length of the instruction at the given offset, or 0 if it is
+// not known.
+size_t Length(std::string_view code, size_t offset) {
+  uint8_t op = code[offset];
+  if (op == _wide) return offset + 1 < code.size() && static_cast<uint8_t>(code[offset + 1]) == _iinc ? 6 : 4;
+  if (op == _bipush || op == _ldc || IsLoad(op) || IsStore(op) || op == _newarray) return 2;
+  if (op == _sipush || op == _ldc_w || op == _ldc2_w || op == _iinc || (IsJump(op) && op != _goto_w) ||
+      (op >= _getstatic && op <= _invokestatic) || op == _new || op == _anewarray || op == _checkcast ||
+      op == _instanceof) {
+    return 3;
+  }
+  if (op == _multianewarray) return 4;
+  if (op == _invokeinterface || op == _invokedynamic || op == _goto_w) return 5;
+  if (op == _jsr || op == _ret || op == _tableswitch || op == _lookupswitch || op > _jsr_w) return 0;
+  return 1;
+}
+
+// Returns the length of the given instruction in its shortest form, or for
+// jumps in their long one if asked.
+size_t EncodedLength(const Op& op, bool long_jump) {
+  if (op.target >= 0) return !long_jump ? 3 : op.opcode == _goto ? 5 : 8;
+  if (op.opcode == _iinc) return op.local <= 255 && op.increment >= INT8_MIN && op.increment <= INT8_MAX ? 3 : 6;
+  if (op.local >= 0) return op.local <= 3 ? 1 : op.local <= 255 ? 2 : 4;
+  return 1 + op.operands.size();
+}
+
+}  // namespace
+
+uint8_t Inverted(uint8_t op) {
+  if (op == _ifnull) return _ifnonnull;
+  if (op == _ifnonnull) return _ifnull;
+  return (op - _ifeq) % 2 == 0 ? op + 1 : op - 1;
+}
+
+std::optional<std::vector<Op>> Decode(std::string_view code) {
+  std::vector<Op> ops;
+  std::vector<int> index_at(code.size(), -1);
+  std::vector<int64_t> jump_offsets;
+  for (size_t offset = 0; offset < code.size();) {
+    size_t length = Length(code, offset);
+    if (length == 0 || offset + length > code.size()) return {};
+    auto u1 = [&](size_t i) { return static_cast<uint8_t>(code[offset + i]); };
+    auto u2 = [&](size_t i) { return static_cast<uint16_t>(u1(i) << 8 | u1(i + 1)); };
+    index_at[offset] = static_cast<int>(ops.size());
+    uint8_t op = u1(0);
+    Op& decoded = ops.emplace_back(op);
+    if (op == _wide) {
+      decoded.opcode = u1(1);
+      decoded.local = u2(2);
+      if (decoded.opcode == _iinc) decoded.increment = static_cast<int16_t>(u2(4));
+    } else if (IsLoad(op) || IsStore(op)) {
+      decoded.local = u1(1);
+    } else if (op == _iinc) {
+      decoded.local = u1(1);
+      decoded.increment = static_cast<int8_t>(u1(2));
+    } else if (op >= _iload_0 && op <= _aload_3) {
+      decoded.opcode = _iload + (op - _iload_0) / 4;
+      decoded.local = (op - _iload_0) % 4;
+    } else if (op >= _istore_0 && op <= _astore_3) {
+      decoded.opcode = _istore + (op - _istore_0) / 4;
+      decoded.local = (op - _istore_0) % 4;
+    } else if (IsJump(op)) {
+      int32_t jump = op == _goto_w ? static_cast<int32_t>(uint32_t{u2(1)} << 16 | u2(3)) : static_cast<int16_t>(u2(1));
+      if (op == _goto_w) decoded.opcode = _goto;
+      jump_offsets.resize(ops.size(), -1);
+      jump_offsets.back() = static_cast<int64_t>(offset) + jump;
+    } else {
+      decoded.operands = code.substr(offset + 1, length - 1);
+    }
+    offset += length;
+  }
+  for (size_t i = 0; i < jump_offsets.size(); ++i) {
+    if (jump_offsets[i] < 0) continue;
+    if (jump_offsets[i] >= static_cast<int64_t>(code.size()) || index_at[jump_offsets[i]] < 0) return {};
+    ops[i].target = index_at[jump_offsets[i]];
+  }
+  return ops;
+}
+
+std::string Encode(const std::vector<Op>& ops) {
+  // Jumps start short and are made long while their offsets do not fit. Code
+  // only grows, so this ends.
+  std::vector<bool> long_jumps(ops.size());
+  std::vector<int64_t> offsets(ops.size() + 1);
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 0; i < ops.size(); ++i) offsets[i + 1] = offsets[i] + EncodedLength(ops[i], long_jumps[i]);
+    for (size_t i = 0; i < ops.size(); ++i) {
+      if (ops[i].target < 0 || long_jumps[i]) continue;
+      int64_t jump = offsets[ops[i].target] - offsets[i];
+      if (jump < INT16_MIN || jump > INT16_MAX) {
+        long_jumps[i] = true;
+        changed = true;
+      }
+    }
+  }
+
+  std::string code;
+  code.reserve(offsets.back());
+  auto put = [&](int64_t byte) { code.push_back(static_cast<char>(byte & 255)); };
+  for (size_t i = 0; i < ops.size(); ++i) {
+    const Op& op = ops[i];
+    size_t length = EncodedLength(op, long_jumps[i]);
+    if (op.target >= 0) {
+      int64_t jump = offsets[op.target] - offsets[i];
+      if (long_jumps[i]) {
+        if (op.opcode != _goto) {
+          // Over the goto_w that follows.
+          put(Inverted(op.opcode));
+          put(0);
+          put(8);
+          jump -= 3;
+        }
+        put(_goto_w);
+        put(jump >> 24);
+        put(jump >> 16);
+      } else {
+        put(op.opcode);
+      }
+      put(jump >> 8);
+      put(jump);
+    } else if (op.local >= 0) {
+      if (length == 1) {
+        put((IsLoad(op.opcode) ? _iload_0 + (op.opcode - _iload) * 4 : _istore_0 + (op.opcode - _istore) * 4) +
+            op.local);
+        continue;
+      }
+      if (length >= 4) put(_wide);
+      put(op.opcode);
+      if (length >= 4) put(op.local >> 8);
+      put(op.local);
+      if (op.opcode == _iinc && length == 6) put(op.increment >> 8);
+      if (op.opcode == _iinc) put(op.increment);
+    } else {
+      put(op.opcode);
+      code += op.operands;
+    }
+  }
+  return code;
+}
+
+void Assembler::Local(uint8_t op, uint16_t local) {
+  Op added(op);
+  added.local = local;
+  Add(std::move(added));
+}
+
+void Assembler::Increment(uint16_t local, int16_t increment) {
+  Op added(_iinc);
+  added.local = local;
+  added.increment = increment;
+  Add(std::move(added));
+}
+
+Assembler::Label Assembler::NewLabel() {
+  label_indexes_.push_back(-1);
+  label_jumped_.push_back(false);
+  return static_cast<Label>(label_indexes_.size() - 1);
+}
+
+void Assembler::Jump(uint8_t op, Label label) {
+  if (!reachable_) return;
+  Op jump(op == _goto_w ? uint8_t{_goto} : op);
+  // Jumps have their label as target until Finish.
+  jump.target = label;
+  Add(std::move(jump));
+  label_jumped_[label] = true;
+  if (op == _goto || op == _goto_w) reachable_ = false;
+}
+
+void Assembler::Place(Label label) {
+  Flush();
+  label_indexes_[label] = static_cast<int>(ops_.size());
+  if (!reachable_ && label_jumped_[label]) {
+    reachable_ = true;
+    unreachable_code_.str("");
+  }
+}
+
+std::vector<Op> Assembler::Finish() {
+  Flush();
+  for (Op& op : ops_) {
+    if (op.target < 0) continue;
+    int index = label_indexes_[op.target];
+    if (index < 0 || index >= static_cast<int>(ops_.size())) {
+      throw std::invalid_argument("jump to label " + std::to_string(op.target) + " before no instruction");
+    }
+    op.target = index;
+  }
+  return std::move(ops_);
+}
+
+void Assembler::Flush() {
+  if (!reachable_) return;
+  std::string bytes = code_.str();
+  if (bytes.empty()) return;
+  code_.str("");
+  std::optional<std::vector<Op>> ops = Decode(bytes);
+  if (!ops || std::any_of(ops->begin(), ops->end(), [](const Op& op) { return op.target >= 0; })) {
+    throw std::invalid_argument("code written to the stream has jumps or unknown instructions");
+  }
+  for (Op& op : *ops) ops_.push_back(std::move(op));
+}
+
+void Assembler::Add(Op op) {
+  if (!reachable_) return;
+  Flush();
+  ops_.push_back(std::move(op));
+}
+
+}  // namespace assembler
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Assembly of the code of JVM methods from instructions and jumps to labels.
+namespace assembler {
+
+// Instruction of a method. Loads, stores and iinc have their local apart, and
+// jumps the index of the instruction they go to instead of an offset, so that
+// they get their shortest encoding once all instructions are known.
+struct Op {
+  explicit Op(uint8_t opcode) : opcode(opcode) {}
+
+  // Opcode, which for loads and stores is the one taking the local as operand,
+  // like iload for iload_1, and for gotos goto.
+  uint8_t opcode;
+  // Operands of other instructions.
+  std::string operands;
+  int local = -1;
+  int increment = 0;
+  int target = -1;
+};
+
+// Returns the opcode of the conditional jump taken exactly when the given one
+// is not.
+uint8_t Inverted(uint8_t op);
+
+// Returns the instructions of the given code, or nothing if it has
+// instructions it does not know, like tableswitch, or jumps into instructions.
+std::optional<std::vector<Op>> Decode(std::string_view code);
+
+// Returns the code of the given instructions. Locals and jumps take their
+// shortest form: loads and stores like iload_1 where there is one, and wide
+// ones for locals above 255. Gotos whose offset does not fit 16 bits become
+// goto_w, and conditional jumps then jump over a goto_w by the inverted
+// condition.
+std::string Encode(const std::vector<Op>& ops);
+
+// Assembles the code of a method. Instructions other than jumps and locals
+// are written to a stream, like those of emit::Pushable. Code after an
+// unconditional jump that no jump goes to is never run, and is written to a
+// stream that is discarded, as the JVM does not verify unreachable code.
+class Assembler {
+ public:
+  using Label = int;
+
+  // Returns the stream taking instructions other than jumps.
+  std::ostream& out() { return reachable_ ? code_ : unreachable_code_; }
+
+  // Adds the load or store of the given kind, like iload, of the given local.
+  void Local(uint8_t op, uint16_t local);
+  // Adds an iinc of the given local by the given increment.
+  void Increment(uint16_t local, int16_t increment);
+
+  Label NewLabel();
+  // Adds the given jump instruction to the given label.
+  void Jump(uint8_t op, Label label);
+  // Places the given label before the next instruction.
+  void Place(Label label);
+
+  // Returns the instructions with jumps going to the instructions of their
+  // labels. Throws std::invalid_argument if the stream got jumps or
+  // instructions that Decode does not know, or a jump goes to a label that is
+  // not placed before an instruction.
+  std::vector<Op> Finish();
+
+ private:
+  // Adds the instructions written to the stream.
+  void Flush();
+  void Add(Op op);
+
+  std::ostringstream code_;
+  std::ostringstream unreachable_code_;
+  bool reachable_ = true;
+  std::vector<Op> ops_;
+  // Index of the instruction each label is placed before, or -1, and whether
+  // jumps go to it.
+  std::vector<int> label_indexes_;
+  std::vector<bool> label_jumped_;
+};
+
+}  // namespace assembler
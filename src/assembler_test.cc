@@ -0,0 +1,87 @@
+#include "assembler.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "catch2/catch_test_macros.hpp"
+#include "instruction.h"
+#include "testing/testing.h"
+
+namespace {
+
+using assembler::Assembler;
+
+using testing::Code;
+
+SCENARIO("Assembling method code", "[assembler]") {
+  Assembler a;
+  GIVEN("A loop with jumps forward and back") {
+    Assembler::Label loop = a.NewLabel();
+    Assembler::Label end = a.NewLabel();
+    a.Place(loop);
+    a.Local(_iload, 0);
+    a.Jump(_ifeq, end);
+    a.Increment(0, -1);
+    a.Jump(_goto, loop);
+    a.Place(end);
+    a.out() << Code({_return});
+    THEN("the jumps have the offsets of their labels in short form") {
+      REQUIRE(assembler::Encode(a.Finish()) ==
+              Code({_iload_0, _ifeq, 0, 9, _iinc, 0, 0xff, _goto, 0xff, 0xf9, _return}));
+    }
+  }
+  GIVEN("Locals of all sizes") {
+    a.Local(_iload, 3);
+    a.Local(_astore, 200);
+    a.Local(_iload, 300);
+    a.Increment(300, 1);
+    a.Increment(5, 1000);
+    a.out() << Code({_return});
+    THEN("each has its shortest form, and those above 255 are wide") {
+      REQUIRE(assembler::Encode(a.Finish()) == Code({_iload_3, _astore, 200, _wide, _iload, 1, 44, _wide, _iinc, 1, 44,
+                                                     0, 1, _wide, _iinc, 0, 5, 3, 0xe8, _return}));
+    }
+  }
+  GIVEN("Code after a goto that no jump goes to") {
+    Assembler::Label end = a.NewLabel();
+    a.Jump(_goto, end);
+    a.out() << Code({_iconst_0});
+    a.Local(_istore, 1);
+    a.Place(end);
+    a.out() << Code({_return});
+    THEN("it is dropped") { REQUIRE(assembler::Encode(a.Finish()) == Code({_goto, 0, 3, _return})); }
+  }
+  GIVEN("Jumps longer than 16 bit offsets hold") {
+    Assembler::Label loop = a.NewLabel();
+    Assembler::Label end = a.NewLabel();
+    a.Place(loop);
+    a.Local(_iload, 0);
+    a.Jump(_ifeq, end);
+    for (int i = 0; i < 40000; ++i) a.out().put(_nop);
+    a.Jump(_goto, loop);
+    a.Place(end);
+    a.out() << Code({_return});
+    std::string code = assembler::Encode(a.Finish());
+    THEN("gotos are goto_w") {
+      REQUIRE(code.size() == 40015);
+      REQUIRE(code.substr(40009) == Code({_goto_w, 0xff, 0xff, 0x63, 0xb7, _return}));
+    }
+    THEN("conditional jumps jump over a goto_w by the inverted condition") {
+      REQUIRE(code.substr(0, 9) == Code({_iload_0, _ifne, 0, 8, _goto_w, 0, 0, 0x9c, 0x4a}));
+    }
+    THEN("decoding and encoding the code again keeps it") {
+      REQUIRE(assembler::Encode(*assembler::Decode(code)) == code);
+    }
+  }
+  GIVEN("A jump to a label that is never placed") {
+    a.Jump(_goto, a.NewLabel());
+    THEN("it is an error") { REQUIRE_THROWS_AS(a.Finish(), std::invalid_argument); }
+  }
+  GIVEN("A jump written to the stream") {
+    a.out() << Code({_goto, 0, 3, _return});
+    THEN("it is an error") { REQUIRE_THROWS_AS(a.Finish(), std::invalid_argument); }
+  }
+}
+
+}  // namespace
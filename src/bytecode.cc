@@ -0,0 +1,946 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "assembler.h"
+#include "closures.h"
+#include "emit.h"
+#include "instruction.h"
+#include "peephole.h"
+#include "types.h"
+
+namespace bytecode {
+namespace {
+
+using java::Closures;
+using java::FreeVariable;
+using java::Global;
+using java::Nesting;
+using syntax::Overloaded;
+
+// Jump instructions taken when ints compare in the given way.
+constexpr std::pair<BinaryOp, uint8_t> kJumps[] = {
+    {kEqual, _if_icmpeq},       {kUnequal, _if_icmpne},        {kLessThan, _if_icmplt},
+    {kGreaterThan, _if_icmpgt}, {kNotGreaterThan, _if_icmple}, {kNotLessThan, _if_icmpge}};
+
+// Returns the element type of the given array type.
+const types::Type* ElementType(const types::Type* array) {
+  if (!array->canonical->element) {
+    throw std::invalid_argument("type " + std::string(array->name.str()) + " is not an array");
+  }
+  return array->canonical->element;
+}
+
+// Returns the class name of values with the given reference descriptor, like
+// "java/lang/String" for "Ljava/lang/String;".
+std::string ClassName(std::string_view descriptor) {
+  if (descriptor[0] == 'L') return std::string(descriptor.substr(1, descriptor.size() - 2));
+  return std::string(descriptor);
+}
+
+// Returns the text of the given Tiger string literal in the modified UTF-8 of
+// class files. Characters from escape sequences are Unicode code points below
+// 256, like those of Std.chr. Other bytes of the source are copied.
+std::string Unescape(std::string_view literal) {
+  std::string text;
+  auto put_char = [&](unsigned c) {
+    if (c > 0 && c < 0x80) {
+      text.push_back(static_cast<char>(c));
+    } else {
+      text.push_back(static_cast<char>(0xc0 | c >> 6));
+      text.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+  };
+  for (size_t i = 0; i < literal.size(); ++i) {
+    if (literal[i] != '\\' || i + 1 == literal.size()) {
+      text.push_back(literal[i]);
+      continue;
+    }
+    char c = literal[++i];
+    if (c == 'n') {
+      put_char('\n');
+    } else if (c == 't') {
+      put_char('\t');
+    } else if (c == '^' && i + 1 < literal.size()) {
+      put_char(literal[++i] & 0x1f);
+    } else if (c >= '0' && c <= '9' && i + 2 < literal.size()) {
+      put_char(((c - '0') * 100 + (literal[i + 1] - '0') * 10 + (literal[i + 2] - '0')) & 0xff);
+      i += 2;
+    } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      // A sequence of white space between backslashes is ignored.
+      while (i < literal.size() && literal[i] != '\\') ++i;
+    } else {
+      put_char(static_cast<unsigned char>(c));
+    }
+  }
+  return text;
+}
+
+// Returns the slot of the given name in the given scope.
+int SlotOf(const Scope* scope, syntax::Symbol name) {
+  return static_cast<int>(std::find(scope->slots.begin(), scope->slots.end(), name) - scope->slots.begin());
+}
+
+// State shared by the generators of all methods of the program. Records are
+// objects of a class named like their type, and names of a scope that live in
+// an object are fields of class Scope<id>, like in the Java source.
+struct Context {
+  const SymbolTable& symbols;
+  TypeFinder& types;
+  const Closures& closures;
+  emit::Program& program;
+  std::string class_name;
+  // Names and descriptors of the methods of functions.
+  std::unordered_map<const syntax::FunctionDeclaration*, std::string> method_names;
+  std::unordered_map<const syntax::FunctionDeclaration*, std::string> method_descriptors;
+  // Static fields of the names of the main program used by functions.
+  std::map<std::pair<const Scope*, int>, const emit::Field*> fields;
+  // Types of values of expressions by NodeId, found by ValueType.
+  std::vector<const types::Type*> value_types;
+  // Types of the parameters of all functions.
+  std::unordered_map<const syntax::TypeField*, const types::Type*> parameter_types;
+  // Classes of records by their canonical type, and of objects of scopes.
+  std::unordered_map<const types::Type*, emit::Program*> record_classes;
+  std::unordered_map<const Scope*, emit::Program*> scope_classes;
+  // Nesting depth of the expressions being compiled or typed, counted by
+  // Nesting.
+  int depth;
+
+  // Returns the type of the value of the given expression, or the unit type if
+  // it has none.
+  const types::Type* ValueType(const syntax::Expr& e) {
+    const types::Type*& cached = value_types[e.node_id];
+    if (cached) return cached;
+    Nesting nesting(depth);
+    const types::Type* type = std::visit(
+        Overloaded{
+            [](const syntax::StringConstant&) { return types::String(); },
+            [](const syntax::IntegerConstant&) { return types::Int(); },
+            [](const syntax::Nil&) { return types::Nil(); },
+            [&](const syntax::ArenaPtr<syntax::LValue>& l) { return LValueType(symbols.getBinding(e), *l); },
+            [](const syntax::Negated&) { return types::Int(); },
+            [](const syntax::Binary&) { return types::Int(); },
+            [&](const syntax::RecordLiteral&) { return types(e); },
+            [&](const syntax::ArrayLiteral&) { return types(e); },
+            [&](const syntax::FunctionCall& call) {
+              if (const syntax::FunctionDeclaration* fd = symbols.getBinding(e).function()) {
+                const types::Type* result = symbols.getSignature(*fd).result;
+                return result ? result : types::Unit();
+              }
+              const types::Signature* library = types::LibrarySignature(call.id.str());
+              return library ? library->result : types::Unit();
+            },
+            [&](const syntax::IfThenElse& ite) {
+              const types::Type* then_type = ValueType(*ite.then_expr);
+              return then_type->kind == types::Type::kNil ? ValueType(*ite.else_expr) : then_type;
+            },
+            [&](const syntax::Let& let) { return let.body.empty() ? types::Unit() : ValueType(*let.body.back()); },
+            [&](const syntax::Parenthesized& p) {
+              return p.exprs.empty() ? types::Unit() : ValueType(*p.exprs.back());
+            },
+            [](const auto&) { return types::Unit(); }},
+        e);
+    return cached = type;
+  }
+
+  bool HasValue(const syntax::Expr& e) { return ValueType(e)->kind != types::Type::kUnit; }
+
+  // Returns the type of the given variable.
+  const types::Type* VariableType(const syntax::VariableDeclaration& var) {
+    const types::Type* declared = symbols.getType(var);
+    return declared ? declared : ValueType(*var.value);
+  }
+
+  // Returns the type of the name with the given binding.
+  const types::Type* BindingType(const Binding& b) {
+    return std::visit(Overloaded{[&](const syntax::VariableDeclaration* var) { return VariableType(*var); },
+                                 [&](const syntax::TypeField*) { return b.value_type; },
+                                 [](const syntax::For*) { return types::Int(); },
+                                 [](std::nullptr_t) { return types::Unit(); }},
+                      b.storage());
+  }
+
+  // Returns the type of the name in the given slot of the given scope.
+  const types::Type* StorageType(const Scope* scope, int slot) {
+    return std::visit(Overloaded{[&](const syntax::VariableDeclaration* var) { return VariableType(*var); },
+                                 [&](const syntax::TypeField* parameter) { return parameter_types.at(parameter); },
+                                 [](const syntax::For*) { return types::Int(); },
+                                 [](std::nullptr_t) { return types::Unit(); }},
+                      scope->storage.at(scope->slots[slot]));
+  }
+
+  // Returns the JVM descriptor of values of the given type.
+  std::string Descriptor(const types::Type* type) {
+    switch (type->kind) {
+      case types::Type::kInt:
+        return "I";
+      case types::Type::kString:
+        return "Ljava/lang/String;";
+      case types::Type::kArray:
+        return "[" + Descriptor(ElementType(type));
+      case types::Type::kRecord:
+        return "L" + std::string(RecordClass(type).Name()) + ";";
+      default:
+        throw std::invalid_argument("no JVM type for type " + std::string(type->name.str()));
+    }
+  }
+
+  // Returns the class of the given record type, defining it on first use.
+  // Types of the same name in different scopes get the id of their
+  // declaration appended.
+  emit::Program& RecordClass(const types::Type* type) {
+    type = type->canonical;
+    emit::Program*& record_class = record_classes[type];
+    if (record_class) return *record_class;
+    std::string name = java::Sanitize(type->name);
+    auto named = [&](const emit::Program* c) { return c->Name() == name; };
+    std::vector<emit::Program*> classes = program.Classes();
+    if (name == class_name || std::any_of(classes.begin(), classes.end(), named)) {
+      name += "_" + std::to_string(type->declaration->node_id);
+    }
+    record_class = &program.DefineClass(name);
+    // Fields may have the type of the record itself, which now has its class.
+    for (const types::Type::Field& field : type->fields) {
+      record_class->DefineField(java::Sanitize(field.id), Descriptor(field.type));
+    }
+    return *record_class;
+  }
+
+  // Returns the field of the given record type with the given name.
+  const emit::Field& RecordField(const types::Type* record, syntax::Identifier id) {
+    const types::Type* type = FieldType(record, id);
+    return program.LookupField(RecordClass(record).Name(), java::Sanitize(id), Descriptor(type),
+                               emit::Dispatch::kVirtual);
+  }
+
+  const types::Type* FieldType(const types::Type* record, syntax::Identifier id) {
+    if (const types::Type* type = record->canonical->field(id)) return type;
+    throw std::invalid_argument("no field " + std::string(id.str()) + " in type " + std::string(record->name.str()));
+  }
+
+  // Returns the class of objects of the given scope, defining it on first use.
+  emit::Program& ScopeClass(const Scope* scope) {
+    emit::Program*& scope_class = scope_classes[scope];
+    if (scope_class) return *scope_class;
+    scope_class = &program.DefineClass("Scope" + std::to_string(scope->id));
+    for (int slot = 0; slot < static_cast<int>(scope->slots.size()); ++slot) {
+      if (closures.InObject(scope, slot)) {
+        scope_class->DefineField(FieldName(scope, slot), Descriptor(StorageType(scope, slot)));
+      }
+    }
+    return *scope_class;
+  }
+
+  // Returns the name of the field for the given slot of the given scope, which
+  // is that of the slot, with the slot appended if the scope has several.
+  static std::string FieldName(const Scope* scope, int slot) {
+    syntax::Symbol name = scope->slots[slot];
+    std::string field_name = java::Sanitize(name);
+    if (std::count(scope->slots.begin(), scope->slots.end(), name) > 1) field_name += "_" + std::to_string(slot);
+    return field_name;
+  }
+
+  // Returns the field for the name in the given slot of the given scope, which
+  // lives in the object of the scope.
+  const emit::Field& ScopeField(const Scope* scope, int slot) {
+    return program.LookupField(ScopeClass(scope).Name(), FieldName(scope, slot),
+                               Descriptor(StorageType(scope, slot)), emit::Dispatch::kVirtual);
+  }
+
+  const types::Type* LValueType(const Binding& b, const syntax::LValue& l) {
+    return std::visit(Overloaded{[&](const syntax::Identifier&) { return BindingType(b); },
+                                 [&](const syntax::RecordField& rf) { return FieldType(LValueType(b, *rf.l_value), rf.id); },
+                                 [&](const syntax::ArrayElement& ae) {
+                                   return ElementType(LValueType(b, *ae.l_value));
+                                 }},
+                      l);
+  }
+
+  // Returns the descriptor of the method of the given function, which takes its
+  // free variables before its parameters.
+  const std::string& MethodDescriptor(const syntax::FunctionDeclaration& fd) {
+    std::string& descriptor = method_descriptors[&fd];
+    if (!descriptor.empty()) return descriptor;
+    descriptor = "(";
+    for (const FreeVariable& v : closures.Free(symbols.getScope(fd))) {
+      descriptor += v.slot < 0 ? "L" + std::string(ScopeClass(v.scope).Name()) + ";"
+                               : Descriptor(StorageType(v.scope, v.slot));
+    }
+    const types::Signature& signature = symbols.getSignature(fd);
+    for (const types::Type* parameter : signature.parameters) descriptor += Descriptor(parameter);
+    descriptor += ")" + (signature.result ? Descriptor(signature.result) : "V");
+    return descriptor;
+  }
+};
+
+// Local variable of a method.
+struct Local {
+  uint16_t index;
+  bool is_int;
+};
+
+// Generates the code of one method. Values of expressions are left on the
+// operand stack, and expressions without a value leave it as it was.
+struct Compiler {
+  explicit Compiler(Context& c) : c(c) {}
+
+  Context& c;
+  // Next local variable index not taken.
+  uint16_t next_local = 0;
+  // Locals holding names and objects of scopes, and free variables.
+  std::map<std::pair<const Scope*, int>, Local> locals;
+  const syntax::Expr* current_expr = nullptr;
+
+  // Labels after the loops around the code, innermost last.
+  std::vector<int> loop_exits;
+
+  assembler::Assembler assembler;
+
+  std::ostream& out() { return assembler.out(); }
+
+  void Op(uint8_t op) { out().put(static_cast<char>(op)); }
+  void Op(uint8_t op, uint8_t operand) {
+    Op(op);
+    out().put(static_cast<char>(operand));
+  }
+  void Op2(uint8_t op, uint16_t operand) {
+    Op(op);
+    out().put(static_cast<char>(operand >> 8));
+    out().put(static_cast<char>(operand & 255));
+  }
+
+  void PushInt(int i) { c.program.DefineIntegerConstant(i).Push(out()); }
+
+  void Load(Local local) { assembler.Local(local.is_int ? _iload : _aload, local.index); }
+  void Store(Local local) { assembler.Local(local.is_int ? _istore : _astore, local.index); }
+  Local NewLocal(bool is_int) { return {next_local++, is_int}; }
+
+  int NewLabel() { return assembler.NewLabel(); }
+  void Jump(uint8_t op, int label) { assembler.Jump(op, label); }
+  void Place(int label) { assembler.Place(label); }
+
+  // Returns the code, optimized.
+  std::string Finish() {
+    std::vector<assembler::Op> ops = assembler.Finish();
+    peephole::Optimize(ops);
+    return assembler::Encode(ops);
+  }
+
+  // Returns the local of the given slot of the given scope, or of its object if
+  // the slot is -1.
+  Local Reference(const Scope* scope, int slot) const {
+    auto it = locals.find({scope, slot});
+    if (it == locals.end()) {
+      throw std::invalid_argument("no storage for slot " + std::to_string(slot) + " of scope " +
+                                  std::to_string(scope->id));
+    }
+    return it->second;
+  }
+
+  // Makes the name in the given slot of the given scope a new local, unless it
+  // lives in a static field or an object.
+  void Declare(const Scope* scope, int slot, const types::Type* type) {
+    if (c.fields.count({scope, slot}) || c.closures.InObject(scope, slot)) return;
+    locals[{scope, slot}] = NewLocal(type->kind == types::Type::kInt);
+  }
+
+  // Pushes the value of the name in the given slot of the given scope.
+  void LoadName(const Scope* scope, int slot) {
+    if (auto field = c.fields.find({scope, slot}); field != c.fields.end()) {
+      field->second->Load(out());
+    } else if (c.closures.InObject(scope, slot)) {
+      Load(Reference(scope, -1));
+      c.ScopeField(scope, slot).Load(out());
+    } else {
+      Load(Reference(scope, slot));
+    }
+  }
+
+  // Stores the value of the given expression in the given slot of the given
+  // scope.
+  void StoreName(const Scope* scope, int slot, const syntax::Expr& value) {
+    if (auto field = c.fields.find({scope, slot}); field != c.fields.end()) {
+      CompileValue(value);
+      field->second->Store(out());
+    } else if (c.closures.InObject(scope, slot)) {
+      Load(Reference(scope, -1));
+      CompileValue(value);
+      c.ScopeField(scope, slot).Store(out());
+    } else {
+      CompileValue(value);
+      Store(Reference(scope, slot));
+    }
+  }
+
+  // Creates the object of the given scope in a new local.
+  void NewObject(const Scope* scope) {
+    c.program.LookupConstructor(c.ScopeClass(scope).Name()).Push(out());
+    Local object = NewLocal(false);
+    Store(object);
+    locals[{scope, -1}] = object;
+  }
+
+  void Compile(const syntax::Expr& expr) {
+    const syntax::Expr* old_expr = current_expr;
+    current_expr = &expr;
+    Nesting nesting(c.depth);
+    std::visit(*this, static_cast<const syntax::ExprVariant&>(expr));
+    current_expr = old_expr;
+  }
+  // Compiles the given expression, which must have a value.
+  void CompileValue(const syntax::Expr& expr) {
+    if (!c.HasValue(expr)) throw std::invalid_argument("expression without value used as value");
+    Compile(expr);
+  }
+  // Compiles the given expression, dropping its value if it has one.
+  void CompileStatement(const syntax::Expr& expr) {
+    Compile(expr);
+    if (c.HasValue(expr)) Op(_pop);
+  }
+
+  void operator()(const syntax::StringConstant& expr) {
+    c.program.DefineStringConstant(Unescape(expr.value)).Push(out());
+  }
+  void operator()(const syntax::IntegerConstant& expr) { PushInt(expr); }
+  void operator()(const syntax::Nil&) { Op(_aconst_null); }
+  void operator()(const syntax::ArenaPtr<syntax::LValue>& expr) {
+    LoadLValue(c.symbols.getBinding(*current_expr), *expr);
+  }
+
+  // Pushes the value of the given l-value of a name with the given binding.
+  // Returns its type.
+  const types::Type* LoadLValue(const Binding& b, const syntax::LValue& l) {
+    return std::visit(Overloaded{[&](const syntax::Identifier&) {
+                                   LoadName(b.scope, b.slot);
+                                   return c.BindingType(b);
+                                 },
+                                 [&](const syntax::RecordField& rf) {
+                                   const types::Type* record = LoadLValue(b, *rf.l_value);
+                                   c.RecordField(record, rf.id).Load(out());
+                                   return c.FieldType(record, rf.id);
+                                 },
+                                 [&](const syntax::ArrayElement& ae) {
+                                   const types::Type* element = ElementType(LoadLValue(b, *ae.l_value));
+                                   CompileValue(*ae.expr);
+                                   Op(element->kind == types::Type::kInt ? _iaload : _aaload);
+                                   return element;
+                                 }},
+                      l);
+  }
+
+  void operator()(const syntax::Negated& expr) {
+    CompileValue(*expr.expr);
+    Op(_ineg);
+  }
+
+  // Replaces the values on the stack that the given jump instruction tests by 1
+  // if it jumps for them, or by 0 otherwise.
+  void Compare(uint8_t jump) {
+    int is_true = NewLabel();
+    int end = NewLabel();
+    Jump(jump, is_true);
+    PushInt(0);
+    Jump(_goto, end);
+    Place(is_true);
+    PushInt(1);
+    Place(end);
+  }
+
+  // Compiles the right operand of the given comparison of values of the given
+  // type, whose left operand is on the stack, and returns the jump instruction
+  // taken when the comparison holds. Comparisons of strings compare their
+  // characters, and others compare ints or references. Zero and nil are not
+  // pushed but tested for by the jump.
+  uint8_t CompareWith(BinaryOp op, const types::Type* type, const syntax::Expr& right) {
+    uint8_t jump = std::find_if(std::begin(kJumps), std::end(kJumps), [&](auto j) { return j.first == op; })->second;
+    if (type->kind == types::Type::kInt) {
+      const auto* constant = std::get_if<syntax::IntegerConstant>(&right);
+      if (constant && *constant == 0) return jump - (_if_icmpeq - _ifeq);
+      CompileValue(right);
+      return jump;
+    }
+    if (type->kind != types::Type::kString) {
+      if (std::holds_alternative<syntax::Nil>(right)) return op == kEqual ? _ifnull : _ifnonnull;
+      CompileValue(right);
+      return op == kEqual ? _if_acmpeq : _if_acmpne;
+    }
+    CompileValue(right);
+    if (op == kEqual || op == kUnequal) {
+      InvokeString("equals", "(Ljava/lang/Object;)Z");
+      return op == kEqual ? _ifne : _ifeq;
+    }
+    InvokeString("compareTo", "(Ljava/lang/String;)I");
+    return jump - (_if_icmpeq - _ifeq);
+  }
+
+  // Compiles the given condition as a jump to the given label taken if it is
+  // true, or if it is false when the given when is false, and falling through
+  // otherwise. Comparisons, &, | and not jump on their operands, and only other
+  // expressions push a value to test.
+  void CompileCondition(const syntax::Expr& expr, bool when, int label) {
+    Nesting nesting(c.depth);
+    if (const auto* binary = std::get_if<syntax::Binary>(&expr)) {
+      BinaryOp op = binary->op;
+      if (op == kAnd || op == kOr) {
+        // Chains like a&b&...&c are followed in a loop. Operands that decide
+        // the chain the way it is asked for jump to the label, and those that
+        // decide it the other way skip the rest.
+        std::vector<const syntax::Binary*> chain = {binary};
+        while (const auto* left = std::get_if<syntax::Binary>(chain.back()->left.get())) {
+          if (left->op != op) break;
+          chain.push_back(left);
+        }
+        bool decides = op == kOr;
+        int skip = NewLabel();
+        auto operand = [&](const syntax::Expr& e, bool last) {
+          if (when == decides || last) {
+            CompileCondition(e, when, label);
+          } else {
+            CompileCondition(e, decides, skip);
+          }
+        };
+        operand(*chain.back()->left, false);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) operand(*(*it)->right, it + 1 == chain.rend());
+        Place(skip);
+        return;
+      }
+      if (op != kPlus && op != kMinus && op != kTimes && op != kDivide) {
+        const types::Type* type = c.ValueType(*binary->left);
+        if (type->kind == types::Type::kNil) type = c.ValueType(*binary->right);
+        CompileValue(*binary->left);
+        uint8_t jump = CompareWith(op, type, *binary->right);
+        Jump(when ? jump : assembler::Inverted(jump), label);
+        return;
+      }
+    } else if (const auto* call = std::get_if<syntax::FunctionCall>(&expr)) {
+      if (call->id.str() == "not" && call->arguments.size() == 1 && !c.symbols.getBinding(expr).function()) {
+        CompileCondition(*call->arguments[0], !when, label);
+        return;
+      }
+    } else if (const auto* constant = std::get_if<syntax::IntegerConstant>(&expr)) {
+      if ((*constant != 0) == when) Jump(_goto, label);
+      return;
+    } else if (const auto* parenthesized = std::get_if<syntax::Parenthesized>(&expr)) {
+      if (!parenthesized->exprs.empty()) {
+        for (size_t i = 0; i + 1 < parenthesized->exprs.size(); ++i) CompileStatement(*parenthesized->exprs[i]);
+        CompileCondition(*parenthesized->exprs.back(), when, label);
+        return;
+      }
+    }
+    CompileValue(expr);
+    Jump(when ? _ifne : _ifeq, label);
+  }
+
+  void operator()(const syntax::Binary& expr) {
+    if (expr.op == kAnd || expr.op == kOr) {
+      // The right operand is evaluated only if the left one does not decide,
+      // and is then the value.
+      int decided = NewLabel();
+      int end = NewLabel();
+      CompileCondition(*expr.left, expr.op == kOr, decided);
+      CompileValue(*expr.right);
+      Jump(_goto, end);
+      Place(decided);
+      PushInt(expr.op == kOr ? 1 : 0);
+      Place(end);
+      return;
+    }
+    // Left operands of chains like 1+1+...+1 are followed in a loop, so that
+    // the length of the chain does not matter.
+    std::vector<const syntax::Binary*> chain = {&expr};
+    while (const auto* left = std::get_if<syntax::Binary>(chain.back()->left.get())) chain.push_back(left);
+    CompileValue(*chain.back()->left);
+    const types::Type* left_type = c.ValueType(*chain.back()->left);
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      BinaryOp op = (*it)->op;
+      const syntax::Expr& right = *(*it)->right;
+      const types::Type* type = left_type->kind == types::Type::kNil ? c.ValueType(right) : left_type;
+      left_type = types::Int();
+      if (op == kAnd || op == kOr) {
+        // Only where the parser would have put parentheses around it.
+        int decided = NewLabel();
+        int end = NewLabel();
+        Jump(op == kOr ? _ifne : _ifeq, decided);
+        CompileValue(right);
+        Jump(_goto, end);
+        Place(decided);
+        PushInt(op == kOr ? 1 : 0);
+        Place(end);
+        continue;
+      }
+      static constexpr std::pair<BinaryOp, uint8_t> kArithmetic[] = {
+          {kPlus, _iadd}, {kMinus, _isub}, {kTimes, _imul}, {kDivide, _idiv}};
+      if (auto a = std::find_if(std::begin(kArithmetic), std::end(kArithmetic), [&](auto a) { return a.first == op; });
+          a != std::end(kArithmetic)) {
+        CompileValue(right);
+        Op(a->second);
+        continue;
+      }
+      if (type->kind == types::Type::kString && (op == kEqual || op == kUnequal)) {
+        // Already 1 or 0.
+        CompileValue(right);
+        InvokeString("equals", "(Ljava/lang/Object;)Z");
+        if (op == kUnequal) {
+          PushInt(1);
+          Op(_ixor);
+        }
+        continue;
+      }
+      Compare(CompareWith(op, type, right));
+    }
+  }
+
+  void operator()(const syntax::Assignment& expr) {
+    const Binding& b = c.symbols.getBinding(*current_expr);
+    std::visit(Overloaded{[&](const syntax::Identifier&) { StoreName(b.scope, b.slot, *expr.expr); },
+                          [&](const syntax::RecordField& rf) {
+                            const types::Type* record = LoadLValue(b, *rf.l_value);
+                            CompileValue(*expr.expr);
+                            c.RecordField(record, rf.id).Store(out());
+                          },
+                          [&](const syntax::ArrayElement& ae) {
+                            const types::Type* element = ElementType(LoadLValue(b, *ae.l_value));
+                            CompileValue(*ae.expr);
+                            CompileValue(*expr.expr);
+                            Op(element->kind == types::Type::kInt ? _iastore : _aastore);
+                          }},
+               *expr.l_value);
+  }
+
+  void operator()(const syntax::FunctionCall& expr) {
+    if (const syntax::FunctionDeclaration* fd = c.symbols.getBinding(*current_expr).function()) {
+      for (const FreeVariable& v : c.closures.Free(c.symbols.getScope(*fd))) Load(Reference(v.scope, v.slot));
+      for (const auto& arg : expr.arguments) CompileValue(*arg);
+      c.program.LookupMethod(c.class_name, c.method_names.at(fd), c.MethodDescriptor(*fd), emit::Dispatch::kStatic)
+          .Invoke(out());
+      return;
+    }
+    if (CompileIntrinsic(expr)) return;
+    const emit::Invocable* library_function = c.program.LookupLibraryFunction(expr.id.str());
+    if (!library_function) throw std::invalid_argument("Function not found: " + std::string(expr.id.str()));
+    for (const auto& arg : expr.arguments) CompileValue(*arg);
+    library_function->Invoke(out());
+  }
+
+  void InvokeString(std::string_view name, std::string_view descriptor) {
+    c.program.LookupMethod("java/lang/String", name, descriptor, emit::Dispatch::kVirtual).Invoke(out());
+  }
+
+  // Compiles the given call of a library function that takes a few
+  // instructions, like size(s), to those instructions instead of a call of a
+  // method of class Std. Returns whether it is one of those.
+  bool CompileIntrinsic(const syntax::FunctionCall& call) {
+    struct Intrinsic {
+      size_t arity;
+      void (*compile)(Compiler&, const syntax::FunctionCall&);
+    };
+    static const std::unordered_map<std::string_view, Intrinsic> kIntrinsics = {
+        {"size",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.CompileValue(*call.arguments[0]);
+            m.InvokeString("length", "()I");
+          }}},
+        {"ord",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            // The first character of literals is known, and those of other
+            // strings are -1 if there is none.
+            if (const auto* literal = std::get_if<syntax::StringConstant>(call.arguments[0].get())) {
+              std::string text = Unescape(literal->value);
+              if (text.empty() || static_cast<uint8_t>(text[0]) < 0x80) {
+                m.PushInt(text.empty() ? -1 : text[0]);
+                return;
+              }
+            }
+            int empty = m.NewLabel();
+            int end = m.NewLabel();
+            m.CompileValue(*call.arguments[0]);
+            m.Op(_dup);
+            m.InvokeString("length", "()I");
+            m.Jump(_ifeq, empty);
+            m.PushInt(0);
+            m.InvokeString("charAt", "(I)C");
+            m.Jump(_goto, end);
+            m.Place(empty);
+            m.Op(_pop);
+            m.PushInt(-1);
+            m.Place(end);
+          }}},
+        {"substring",
+         {3,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.CompileValue(*call.arguments[0]);
+            m.CompileValue(*call.arguments[1]);
+            m.Op(_dup);
+            m.CompileValue(*call.arguments[2]);
+            m.Op(_iadd);
+            m.InvokeString("substring", "(II)Ljava/lang/String;");
+          }}},
+        {"concat",
+         {2,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.CompileValue(*call.arguments[0]);
+            m.CompileValue(*call.arguments[1]);
+            m.InvokeString("concat", "(Ljava/lang/String;)Ljava/lang/String;");
+          }}},
+        {"not",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            int is_true = m.NewLabel();
+            int end = m.NewLabel();
+            m.CompileCondition(*call.arguments[0], true, is_true);
+            m.PushInt(1);
+            m.Jump(_goto, end);
+            m.Place(is_true);
+            m.PushInt(0);
+            m.Place(end);
+          }}}};
+    auto intrinsic = kIntrinsics.find(call.id.str());
+    if (intrinsic == kIntrinsics.end() || call.arguments.size() != intrinsic->second.arity) return false;
+    intrinsic->second.compile(*this, call);
+    return true;
+  }
+
+  void operator()(const syntax::RecordLiteral& expr) {
+    const types::Type* record = c.types(*current_expr);
+    c.program.LookupConstructor(c.RecordClass(record).Name()).Push(out());
+    for (const syntax::FieldAssignment& field : expr.fields) {
+      Op(_dup);
+      CompileValue(*field.expr);
+      c.RecordField(record, field.id).Store(out());
+    }
+  }
+
+  void operator()(const syntax::ArrayLiteral& expr) {
+    const types::Type* element = ElementType(c.types(*current_expr));
+    CompileValue(*expr.size);
+    if (element->kind == types::Type::kInt) {
+      Op(_newarray, 10);  // T_INT
+    } else {
+      Op2(_anewarray, c.program.DefineClassConstant(ClassName(c.Descriptor(element))));
+    }
+    Op(_dup);
+    CompileValue(*expr.value);
+    c.program
+        .LookupMethod("java/util/Arrays", "fill",
+                      element->kind == types::Type::kInt ? "([II)V" : "([Ljava/lang/Object;Ljava/lang/Object;)V",
+                      emit::Dispatch::kStatic)
+        .Invoke(out());
+  }
+
+  void operator()(const syntax::IfThen& expr) {
+    int end = NewLabel();
+    CompileCondition(*expr.condition, false, end);
+    CompileStatement(*expr.then_expr);
+    Place(end);
+  }
+
+  void operator()(const syntax::IfThenElse& expr) {
+    // Else branches that are if-then-else expressions of the same kind are
+    // followed in a loop, so that the length of else-if chains does not matter.
+    bool has_value = c.HasValue(*current_expr);
+    auto branch = [&](const syntax::Expr& e) { has_value ? CompileValue(e) : CompileStatement(e); };
+    int end = NewLabel();
+    const syntax::IfThenElse* link = &expr;
+    for (;;) {
+      int next = NewLabel();
+      CompileCondition(*link->condition, false, next);
+      branch(*link->then_expr);
+      Jump(_goto, end);
+      Place(next);
+      const auto* else_link = std::get_if<syntax::IfThenElse>(link->else_expr.get());
+      if (!else_link || c.HasValue(*link->else_expr) != has_value) break;
+      link = else_link;
+    }
+    branch(*link->else_expr);
+    Place(end);
+  }
+
+  void operator()(const syntax::While& expr) {
+    int test = NewLabel();
+    int exit = NewLabel();
+    Place(test);
+    CompileCondition(*expr.condition, false, exit);
+    loop_exits.push_back(exit);
+    CompileStatement(*expr.body);
+    loop_exits.pop_back();
+    Jump(_goto, test);
+    Place(exit);
+  }
+
+  void operator()(const syntax::For& expr) {
+    // The root has no scope of its own, and its loop declares its variable in
+    // the outermost scope.
+    const Scope* scope = c.symbols.getScope(*current_expr);
+    if (!scope) scope = c.symbols.scopes()[0].get();
+    std::pair<const Scope*, int> key = {scope, SlotOf(scope, expr.id)};
+    // Loops of the same name in a scope share its slot, so each has a local of
+    // its own only while it runs.
+    auto old = locals.find(key);
+    std::optional<Local> shadowed = old == locals.end() ? std::nullopt : std::optional(old->second);
+    Local variable = NewLocal(true);
+    Local limit = NewLocal(true);
+    CompileValue(*expr.start);
+    Store(variable);
+    CompileValue(*expr.end);
+    Store(limit);
+    locals[key] = variable;
+    int test = NewLabel();
+    int exit = NewLabel();
+    Place(test);
+    Load(variable);
+    Load(limit);
+    Jump(_if_icmpgt, exit);
+    loop_exits.push_back(exit);
+    CompileStatement(*expr.body);
+    loop_exits.pop_back();
+    assembler.Increment(variable.index, 1);
+    Jump(_goto, test);
+    Place(exit);
+    if (shadowed) {
+      locals[key] = *shadowed;
+    } else {
+      locals.erase(key);
+    }
+  }
+
+  void operator()(const syntax::Break&) {
+    if (loop_exits.empty()) throw std::invalid_argument("break outside of a loop");
+    Jump(_goto, loop_exits.back());
+  }
+
+  void operator()(const syntax::Let& expr) {
+    const Scope* scope = c.symbols.getScope(expr);
+    uint16_t first_local = next_local;
+    if (c.closures.HasObject(scope)) NewObject(scope);
+    for (const auto& decl : expr.declaration) {
+      std::visit(Overloaded{[&](const syntax::FunctionDeclaration& fd) { DefineFunction(fd); },
+                            [](const syntax::TypeDeclaration&) {},
+                            [&](const syntax::VariableDeclaration& var) {
+                              int slot = SlotOf(scope, var.id);
+                              Declare(scope, slot, c.VariableType(var));
+                              StoreName(scope, slot, *var.value);
+                            }},
+                 *decl);
+    }
+    for (size_t i = 0; i < expr.body.size(); ++i) {
+      if (i + 1 < expr.body.size()) {
+        CompileStatement(*expr.body[i]);
+      } else {
+        Compile(*expr.body[i]);
+      }
+    }
+    // Later code reuses the locals of the let.
+    next_local = first_local;
+  }
+
+  void operator()(const syntax::Parenthesized& expr) {
+    for (size_t i = 0; i < expr.exprs.size(); ++i) {
+      if (i + 1 < expr.exprs.size()) {
+        CompileStatement(*expr.exprs[i]);
+      } else {
+        Compile(*expr.exprs[i]);
+      }
+    }
+  }
+
+  // Defines the method of the given function. Its free variables and
+  // parameters are its first locals, and parameters that nested functions
+  // assign move to the object of its scope.
+  void DefineFunction(const syntax::FunctionDeclaration& fd) {
+    const Scope* scope = c.symbols.getScope(fd);
+    const types::Signature& signature = c.symbols.getSignature(fd);
+    Compiler method{c};
+    for (const FreeVariable& v : c.closures.Free(scope)) {
+      method.locals[{v.scope, v.slot}] =
+          method.NewLocal(v.slot >= 0 && c.StorageType(v.scope, v.slot)->kind == types::Type::kInt);
+    }
+    for (size_t i = 0; i < signature.parameters.size(); ++i) {
+      method.locals[{scope, SlotOf(scope, fd.parameter[i].id)}] =
+          method.NewLocal(signature.parameters[i]->kind == types::Type::kInt);
+    }
+    if (c.closures.HasObject(scope)) {
+      method.NewObject(scope);
+      for (size_t i = 0; i < signature.parameters.size(); ++i) {
+        int slot = SlotOf(scope, fd.parameter[i].id);
+        if (!c.closures.InObject(scope, slot)) continue;
+        method.Load(method.Reference(scope, -1));
+        method.Load(method.Reference(scope, slot));
+        c.ScopeField(scope, slot).Store(method.out());
+        method.locals.erase({scope, slot});
+      }
+    }
+    if (signature.result) {
+      method.CompileValue(*fd.body);
+      method.Op(signature.result->kind == types::Type::kInt ? _ireturn : _areturn);
+    } else {
+      method.CompileStatement(*fd.body);
+      method.Op(_return);
+    }
+    c.program.DefineFunction(emit::ACC_STATIC, c.method_names.at(&fd), c.MethodDescriptor(fd), method.Finish());
+  }
+};
+
+}  // namespace
+
+std::vector<ClassFile> Compile(const syntax::Expr& expr, const SymbolTable& t, TypeFinder& tf,
+                               std::string_view class_name) {
+  std::unique_ptr<emit::Program> program = emit::Program::JavaProgram(class_name);
+  Closures closures = java::FindClosures(expr, t, tf);
+  Context context{t, tf, closures, *program, std::string(class_name), {}, {}, {}, {}, {}, {}, {}, 0};
+  context.value_types.resize(t.exprCount());
+
+  // Methods have the names of their functions, unless functions of different
+  // scopes share them, which then get the id of their scope appended.
+  std::unordered_map<syntax::Symbol, int> name_counts = {{syntax::Symbol("main"), 1}};
+  std::vector<const syntax::FunctionDeclaration*> functions;
+  syntax::Walk(expr, Overloaded{[&](const syntax::Declaration& d) {
+                                  if (const auto* fd = std::get_if<syntax::FunctionDeclaration>(&d)) {
+                                    functions.push_back(fd);
+                                    name_counts[fd->id]++;
+                                    const types::Signature& signature = t.getSignature(*fd);
+                                    for (size_t i = 0; i < signature.parameters.size(); ++i) {
+                                      context.parameter_types[&fd->parameter[i]] = signature.parameters[i];
+                                    }
+                                  }
+                                },
+                                [](const auto&) {}});
+  for (const syntax::FunctionDeclaration* fd : functions) {
+    std::string name(fd->id.str());
+    if (name_counts[fd->id] > 1) name += "_" + std::to_string(t.getScope(*fd)->id);
+    context.method_names[fd] = name;
+  }
+  for (const Global& global : closures.globals) {
+    std::string descriptor = context.Descriptor(context.StorageType(global.scope, global.slot));
+    context.fields[{global.scope, global.slot}] = &program->DefineStaticField(global.name, descriptor);
+  }
+
+  Compiler main{context};
+  main.next_local = 1;  // args
+  main.CompileStatement(expr);
+  main.Op(_return);
+  program->DefineFunction(emit::ACC_PUBLIC | emit::ACC_STATIC, "main", "([Ljava/lang/String;)V", main.Finish());
+
+  std::vector<ClassFile> class_files;
+  std::vector<emit::Program*> classes = program->Classes();
+  classes.insert(classes.begin(), program.get());
+  for (emit::Program* c : classes) {
+    std::ostringstream os;
+    c->Emit(os);
+    class_files.push_back({std::string(c->Name()), os.str()});
+  }
+  return class_files;
+}
+
+}  // namespace bytecode
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "symbol_table.h"
+#include "syntax.h"
+#include "type_finder.h"
+
+namespace bytecode {
+
+struct ClassFile {
+  std::string class_name;
+  std::string bytes;
+};
+
+// Returns the class files of the given program, which must pass the checker.
+// The first is the class of the given name, whose main method runs the program,
+// calling library functions as methods of class Std. The others are the
+// classes of records and of the objects of scopes. Throws
+// std::invalid_argument if the program calls functions that are neither
+// declared nor in the library, and std::length_error if a method exceeds the
+// limits of a class file or if expressions are nested more than
+// java::kMaxNesting levels deep. Chains of binary operators and of else-ifs
+// may be longer, but lets, sequences, calls and loops count a level each, and
+// a sequence as the body of a loop another.
+//
+// This backend is experimental. Its classes have not yet been run against
+// those of the Java source backend on a JVM: the test doing so, in
+// bytecode_test, is skipped where java and javac are not installed. Until it
+// has passed, stack map frames, modified UTF-8 strings and the classes of
+// scopes are only checked by the tests of their bytes.
+std::vector<ClassFile> Compile(const syntax::Expr& expr, const SymbolTable& t, TypeFinder& tf,
+                               std::string_view class_name = "Main");
+
+}  // namespace bytecode
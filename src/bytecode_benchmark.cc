@@ -0,0 +1,106 @@
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "bytecode.h"
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "checker.h"
+#include "java_source.h"
+#include "symbol_table.h"
+#include "testing/testing.h"
+#include "type_finder.h"
+
+namespace {
+
+// Tiger filters reading their input a character at a time with getchar.
+constexpr std::string_view kCat = R"(
+let var c := getchar()
+in while c <> "" do (print(c); c := getchar())
+end)";
+constexpr std::string_view kWc = R"(
+let var c := getchar() var lines := 0 var words := 0 var chars := 0 var in_word := 0
+in while c <> "" do (
+     chars := chars + 1;
+     if ord(c) = 10 then lines := lines + 1;
+     if ord(c) = 32 | ord(c) = 10 | ord(c) = 9 then in_word := 0
+     else if not(in_word) then (words := words + 1; in_word := 1);
+     c := getchar());
+   printi(lines); print(" "); printi(words); print(" "); printi(chars); print("\n")
+end)";
+
+// Writes the class files of the given program to the given directory, and, if
+// java_dir is not empty, its Java source compiled by javac to that directory.
+void WriteClasses(std::string_view text, const std::string& class_name, const std::filesystem::path& dir,
+                  const std::filesystem::path& java_dir = {}, const std::string& std_dir = {}) {
+  std::shared_ptr<syntax::Expr> expr = testing::Parse(text);
+  REQUIRE(expr != nullptr);
+  std::unique_ptr<SymbolTable> symbols = SymbolTable::Build(*expr);
+  std::vector<std::string> errors;
+  TypeFinder types(*symbols, errors);
+  std::vector<std::string> checker_errors = ListErrors(*expr, *symbols, types);
+  errors.insert(errors.end(), checker_errors.begin(), checker_errors.end());
+  REQUIRE(errors.empty());
+  for (const bytecode::ClassFile& class_file : bytecode::Compile(*expr, *symbols, types, class_name)) {
+    std::ofstream((dir / (class_file.class_name + ".class")).string(), std::ios::binary) << class_file.bytes;
+  }
+  if (java_dir.empty()) return;
+  std::string source = (java_dir / (class_name + ".java")).string();
+  std::ofstream(source) << java::Compile(*expr, *symbols, types, class_name);
+  std::string javac_output =
+      testing::Run("javac -cp " + std_dir + " -d " + java_dir.string() + " " + source + " 2>&1 && echo ok");
+  INFO(javac_output);
+  REQUIRE(javac_output.ends_with("ok\n"));
+}
+
+// Each run takes seconds, so run with a few samples, like
+// ./benchmarks "[bytecode]" --benchmark-samples 5
+TEST_CASE("Run filters on 100 MB of text", "[bytecode]") {
+  if (testing::Run("command -v java && command -v javac").empty()) SKIP("java and javac are not installed");
+  std::string std_dir = testing::CompileStd();
+  REQUIRE(!std_dir.empty());
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_benchmark";
+  std::filesystem::create_directories(dir);
+  WriteClasses(kCat, "Cat", dir);
+  WriteClasses(kWc, "Wc", dir);
+  std::string input = (dir / "input.txt").string();
+  // Bytes above 127, here of UTF-8, must be written back as they were read.
+  testing::Run("yes 'The quick brown fox jumps over the lazy dog. Größe, naïve café.' | head -c 100000000 > " +
+               input);
+  auto java = [&](std::string_view class_name) {
+    return "java -cp " + dir.string() + ":" + std_dir + " " + std::string(class_name) + " < " + input;
+  };
+
+  REQUIRE(testing::Run(java("Cat") + " | cmp - " + input + " && echo same") == "same\n");
+  REQUIRE(testing::Run(java("Wc")) == testing::Run("wc -l -w -c < " + input + " | awk '{print $1, $2, $3}'"));
+
+  BENCHMARK("cat 100 MB") { return testing::Run(java("Cat") + " > /dev/null"); };
+  BENCHMARK("wc 100 MB") { return testing::Run(java("Wc")); };
+}
+
+// Nested functions reaching storage of the functions around them, whose cost
+// depends on how closures are converted. Both backends convert them alike:
+//   ./benchmarks "[closures]" --benchmark-samples 5
+TEST_CASE("Run deeply nested functions", "[bytecode][closures]") {
+  if (testing::Run("command -v java && command -v javac").empty()) SKIP("java and javac are not installed");
+  std::string std_dir = testing::CompileStd();
+  REQUIRE(!std_dir.empty());
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_benchmark" / "tnest";
+  std::filesystem::create_directories(dir / "class");
+  std::filesystem::create_directories(dir / "java");
+  std::ifstream file(TESTDATA_DIR "/tnest.tig");
+  std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  WriteClasses(text, "Tnest", dir / "class", dir / "java", std_dir);
+  auto java = [&](std::string_view backend) {
+    return "java -cp " + (dir / backend).string() + ":" + std_dir + " Tnest";
+  };
+
+  REQUIRE(testing::Run(java("class")) == testing::Run(java("java")));
+
+  BENCHMARK("tnest from class files") { return testing::Run(java("class")); };
+  BENCHMARK("tnest from Java source") { return testing::Run(java("java")); };
+}
+
+}  // namespace
@@ -0,0 +1,330 @@
+#include "bytecode.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+#include "checker.h"
+#include "closures.h"
+#include "instruction.h"
+#include "java_source.h"
+#include "testing/testing.h"
+
+namespace {
+
+using testing::Code;
+
+// Parsed and checked program.
+struct Checked {
+  std::shared_ptr<syntax::Expr> expr;
+  std::unique_ptr<SymbolTable> symbols;
+  std::vector<std::string> errors;
+  std::unique_ptr<TypeFinder> types;
+};
+
+std::unique_ptr<Checked> Check(std::shared_ptr<syntax::Expr> expr) {
+  auto checked = std::make_unique<Checked>();
+  checked->expr = std::move(expr);
+  checked->symbols = SymbolTable::Build(*checked->expr);
+  checked->types = std::make_unique<TypeFinder>(*checked->symbols, checked->errors);
+  std::vector<std::string> checker_errors = ListErrors(*checked->expr, *checked->symbols, *checked->types);
+  checked->errors.insert(checked->errors.end(), checker_errors.begin(), checker_errors.end());
+  return checked;
+}
+
+std::vector<bytecode::ClassFile> CompileClasses(std::string_view text) {
+  std::shared_ptr<syntax::Expr> expr = testing::Parse(text);
+  REQUIRE(expr != nullptr);
+  std::unique_ptr<Checked> checked = Check(expr);
+  REQUIRE(checked->errors.empty());
+  return bytecode::Compile(*checked->expr, *checked->symbols, *checked->types);
+}
+
+// Returns the main class file of the given program.
+std::string Compile(std::string_view text) { return CompileClasses(text)[0].bytes; }
+
+bool Contains(const std::string& class_file, std::string_view text) {
+  return class_file.find(text) != std::string::npos;
+}
+
+// Returns the names of the given classes.
+std::vector<std::string> Names(const std::vector<bytecode::ClassFile>& class_files) {
+  std::vector<std::string> names;
+  for (const bytecode::ClassFile& class_file : class_files) names.push_back(class_file.class_name);
+  return names;
+}
+
+// Program of the test data.
+struct TestProgram {
+  std::string name;
+  // Whether the program has errors, which comments at the top of the file
+  // point out, or like test_extern calls a function that is neither declared
+  // nor in the library. test52 counts too, as the scanner takes no \" in
+  // strings.
+  bool has_errors;
+  // Null if the program does not parse.
+  std::unique_ptr<Checked> checked;
+};
+
+std::vector<TestProgram> Programs() {
+  std::vector<TestProgram> programs;
+  for (const auto& entry : std::filesystem::directory_iterator(TESTDATA_DIR)) {
+    if (entry.path().extension() != ".tig") continue;
+    std::string head(200, '\0');
+    std::ifstream(entry.path()).read(head.data(), head.size());
+    std::string name = entry.path().stem().string();
+    bool has_errors = name == "test_extern" || name == "test52";
+    for (std::string_view word : {"error", "illegal", "mismatch"}) {
+      has_errors = has_errors || head.find(word) != std::string::npos;
+    }
+    std::shared_ptr<syntax::Expr> expr = testing::ParseFile(entry.path().string());
+    programs.push_back({name, has_errors, expr ? Check(expr) : nullptr});
+  }
+  return programs;
+}
+
+SCENARIO("Class files", "[bytecode]") {
+  GIVEN("A program") {
+    std::string class_file = Compile(R"(let var s := "a\tb\065" in print(s) end)");
+    THEN("it is a class file") { REQUIRE(class_file.substr(0, 4) == "\xca\xfe\xba\xbe"); }
+    THEN("its strings have their escapes decoded") { REQUIRE(Contains(class_file, "a\tbA")); }
+    THEN("it calls library functions in class Std") {
+      REQUIRE(Contains(class_file, "Std"));
+      REQUIRE(Contains(class_file, "(Ljava/lang/String;)V"));
+    }
+  }
+  GIVEN("A program of the test data comparing results of library functions") {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_test" / "tc";
+    std::filesystem::create_directories(dir);
+    std::filesystem::remove(dir / "Merge.class");
+    std::string output =
+        testing::Run("cd " + dir.string() + " && " TC_PATH " --emit-class " TESTDATA_DIR "/merge.tig 2>&1 && echo ok");
+    THEN("tc writes its class file") {
+      REQUIRE(output == "ok\n");
+      REQUIRE(std::filesystem::exists(dir / "Merge.class"));
+    }
+  }
+  GIVEN("A program of the test data checked on several threads") {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_test" / "tc";
+    std::filesystem::create_directories(dir);
+    std::string output = testing::Run("cd " + dir.string() + " && " TC_PATH " --emit-class --threads=4 " TESTDATA_DIR
+                                      "/queens.tig 2>&1 && echo ok");
+    THEN("tc writes its class file") { REQUIRE(output == "ok\n"); }
+  }
+  GIVEN("A program using an undeclared variable") {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_test" / "tc";
+    std::filesystem::create_directories(dir);
+    std::filesystem::remove(dir / "Undeclared.class");
+    std::ofstream((dir / "undeclared.tig").string()) << "printi(undeclared)";
+    std::string output = testing::Run("cd " + dir.string() + " && " TC_PATH " --emit-class undeclared.tig 2>&1; echo $?");
+    THEN("tc reports the checker error and writes no class file") {
+      REQUIRE(output == "Variable not found: undeclared\n1\n");
+      REQUIRE(!std::filesystem::exists(dir / "Undeclared.class"));
+    }
+  }
+  GIVEN("A string with a null character") {
+    THEN("it is in modified UTF-8") { REQUIRE(Contains(Compile(R"(print("a\000b"))"), "a\xc0\x80" "b")); }
+  }
+  GIVEN("Functions of the same name in different scopes") {
+    std::string class_file = Compile(R"(
+let
+  function f(): int = let function f(): int = 1 in f() end
+  function main() = ()
+in
+  printi(f()); main()
+end)");
+    THEN("their methods have different names") {
+      REQUIRE(Contains(class_file, "f_"));
+      REQUIRE(Contains(class_file, "main_"));
+    }
+  }
+  GIVEN("Variables used by nested functions") {
+    std::vector<bytecode::ClassFile> class_files = CompileClasses(R"(
+let
+  var total := 0
+  function count(n: int): int =
+    let
+      var seen := 0
+      function add(i: int) = (seen := seen + i; total := total + 1)
+    in
+      for i := 1 to n do add(i); seen
+    end
+in
+  printi(count(10)); printi(total)
+end)");
+    REQUIRE(class_files.size() == 2);
+    const std::string& scope_class = class_files[1].class_name;
+    THEN("variables of the main program are static fields") { REQUIRE(Contains(class_files[0].bytes, "total")); }
+    THEN("assigned variables of functions are fields of an object of their scope") {
+      REQUIRE(scope_class.starts_with("Scope"));
+      REQUIRE(Contains(class_files[1].bytes, "seen"));
+      REQUIRE(Contains(class_files[0].bytes, "(L" + scope_class + ";I)V"));
+    }
+  }
+  GIVEN("Record types") {
+    std::vector<bytecode::ClassFile> class_files = CompileClasses(R"(
+let
+  type list = {first: int, rest: list}
+  var empty: list := nil
+  var l := list {first = 1, rest = list {first = 2, rest = empty}}
+in
+  printi(l.rest.first);
+  let
+    type list = {name: string}
+    var n := list {name = "x"}
+  in
+    print(n.name)
+  end
+end)");
+    THEN("each is a class with a field for each of its fields") {
+      REQUIRE(Names(class_files) == std::vector<std::string>{"Main", "list", Names(class_files)[2]});
+      REQUIRE(Names(class_files)[2].starts_with("list_"));
+      REQUIRE(Contains(class_files[1].bytes, "first"));
+      REQUIRE(Contains(class_files[1].bytes, "Llist;"));
+      REQUIRE(Contains(class_files[2].bytes, "name"));
+    }
+  }
+  GIVEN("Conditions of ifs and whiles") {
+    std::string class_file = Compile(R"(
+      let function f(a: int, b: int) = if a = 0 & b < a then print("x")
+          function g(a: int, b: int) = while not(a > b) | a = 5 do a := a + 1
+      in f(1, 2); g(1, 2) end)");
+    THEN("comparisons, &, | and not jump on their operands without values to test") {
+      REQUIRE(Contains(class_file, Code({_iload_0, _ifne, 0, 13, _iload_1, _iload_0, _if_icmpge, 0, 8})));
+      REQUIRE(Contains(class_file, Code({_iload_0, _iload_1, _if_icmple, 0, 8, _iload_0, _iconst_5, _if_icmpne, 0, 9,
+                                         _iinc, 0, 1, _goto})));
+    }
+  }
+  GIVEN("Calls of library functions of a few instructions") {
+    std::string class_file = Compile(R"(
+      let function f(s: string): int = size(concat(s, substring(s, ord("0"), 1))) + ord(s) + not(ord(s))
+      in f("a") end)");
+    THEN("they are those instructions instead of calls of class Std") {
+      REQUIRE(!Contains(class_file, "Std"));
+      REQUIRE(Contains(class_file, Code({_aload_0, _aload_0, _bipush, 48, _dup, _iconst_1, _iadd, _invokevirtual})));
+      for (const char* method : {"length", "charAt", "concat", "substring"}) {
+        REQUIRE(Contains(class_file, method));
+      }
+    }
+  }
+  GIVEN("A deep program") {
+    std::shared_ptr<syntax::Expr> expr = testing::Parse(testing::DeepProgram(1000));
+    REQUIRE(expr != nullptr);
+    std::unique_ptr<Checked> checked = Check(expr);
+    THEN("it is compiled") {
+      REQUIRE(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types)[0].bytes.substr(0, 4) ==
+              "\xca\xfe\xba\xbe");
+    }
+  }
+  GIVEN("A program with jumps longer than 16 bit offsets hold") {
+    std::shared_ptr<syntax::Expr> expr = testing::Parse(testing::DeepProgram(3000));
+    REQUIRE(expr != nullptr);
+    std::unique_ptr<Checked> checked = Check(expr);
+    THEN("it is compiled") {
+      REQUIRE(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types)[0].bytes.size() > 0x8000);
+    }
+  }
+  GIVEN("A program with more code than a method can have") {
+    std::shared_ptr<syntax::Expr> expr = testing::Parse(testing::DeepProgram(10000));
+    REQUIRE(expr != nullptr);
+    std::unique_ptr<Checked> checked = Check(expr);
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types), std::length_error);
+    }
+  }
+  GIVEN("Lets, sequences, calls and loop bodies nested deeply") {
+    THEN("those nested a third as deep as the limit are compiled") {
+      for (const std::string& text : testing::DeepNestings(java::kMaxNesting / 3)) {
+        std::unique_ptr<Checked> checked = Check(testing::Parse(text));
+        REQUIRE(checked->errors.empty());
+        REQUIRE(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types).size() > 0);
+      }
+    }
+    THEN("those nested far deeper are an error rather than exhausting the stack") {
+      for (const std::string& text : testing::DeepNestings(java::kMaxNesting * 100)) {
+        std::unique_ptr<Checked> checked = Check(testing::Parse(text));
+        REQUIRE_THROWS_AS(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types), std::length_error);
+      }
+    }
+  }
+  GIVEN("A call of an undeclared function") {
+    std::shared_ptr<syntax::Expr> expr = testing::Parse("undeclared(1)");
+    REQUIRE(expr != nullptr);
+    std::unique_ptr<Checked> checked = Check(expr);
+    THEN("the checker reports it") {
+      REQUIRE(checked->errors == std::vector<std::string>{"Function not found: undeclared"});
+    }
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(bytecode::Compile(*checked->expr, *checked->symbols, *checked->types),
+                        std::invalid_argument);
+    }
+  }
+}
+
+SCENARIO("Programs of the test data", "[bytecode]") {
+  GIVEN("Each program") {
+    std::vector<TestProgram> programs = Programs();
+    THEN("it parses and passes the checker, unless it has errors") {
+      for (const auto& [name, has_errors, checked] : programs) {
+        if (has_errors) continue;
+        INFO(name);
+        REQUIRE(checked != nullptr);
+        REQUIRE(checked->errors.empty());
+      }
+    }
+    THEN("its methods pass the analysis of the class writer, unless it has errors") {
+      for (const auto& [name, has_errors, checked] : programs) {
+        if (has_errors) continue;
+        INFO(name);
+        for (const bytecode::ClassFile& class_file :
+             bytecode::Compile(*checked->expr, *checked->symbols, *checked->types)) {
+          REQUIRE(class_file.bytes.substr(0, 4) == "\xca\xfe\xba\xbe");
+        }
+      }
+    }
+  }
+  GIVEN("A JVM") {
+    if (testing::Run("command -v java && command -v javac").empty()) SKIP("java and javac are not installed");
+    THEN("each program prints what its Java source prints") {
+      std::string std_dir = testing::CompileStd();
+      REQUIRE(!std_dir.empty());
+      std::filesystem::path input = std::filesystem::temp_directory_path() / "bytecode_test" / "input.txt";
+      std::filesystem::create_directories(input.parent_path());
+      // Numbers for the programs reading them, like merge.tig.
+      std::ofstream(input.string()) << "3 5 8 13\n2 4 6 8 10\n";
+      for (const auto& [name, has_errors, checked] : Programs()) {
+        if (has_errors) continue;
+        INFO(name);
+        // Programs have classes of the same names, so each gets directories
+        // of its own.
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "bytecode_test" / name;
+        std::filesystem::create_directories(dir / "class");
+        std::filesystem::create_directories(dir / "java");
+        std::string class_name = "T" + name;
+        for (const bytecode::ClassFile& class_file :
+             bytecode::Compile(*checked->expr, *checked->symbols, *checked->types, class_name)) {
+          std::ofstream((dir / "class" / (class_file.class_name + ".class")).string(), std::ios::binary)
+              << class_file.bytes;
+        }
+        std::ofstream((dir / "java" / (class_name + ".java")).string())
+            << java::Compile(*checked->expr, *checked->symbols, *checked->types, class_name);
+        std::string java_dir = (dir / "java").string();
+        std::string javac_output = testing::Run("javac -cp " + std_dir + " -d " + java_dir + " " + java_dir + "/" +
+                                                class_name + ".java 2>&1 && echo ok");
+        INFO(javac_output);
+        REQUIRE(javac_output.ends_with("ok\n"));
+        auto run = [&](const std::string& class_dir) {
+          return testing::Run("timeout 10 java -cp " + class_dir + ":" + std_dir + " " + class_name +
+                              " < " + input.string() + " 2>/dev/null");
+        };
+        REQUIRE(run((dir / "class").string()) == run(java_dir));
+      }
+    }
+  }
+}
+
+}  // namespace
@@ -1,19 +1,25 @@
 #include "checker.h"
 
 #include <algorithm>
+#include <array>
 #include <functional>
 #include <iostream>
 #include <sstream>
-#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 
 #include "debug_string.h"
+#include "parallel.h"
 #include "symbol_table.h"
 #include "syntax.h"
 #include "type_finder.h"
+#include "types.h"
 
 namespace {
 using namespace syntax;
+using types::SameType;
 using Errors = std::vector<std::string>;
 
 // @brief A stream that adds its content to an error list upon destruction.
@@ -38,28 +44,116 @@ struct Checker {
   TypeFinder& get_type;
 };
 
-// @brief Traverses an AST subtree and applies a checker to each node.
-//
-// Performs a pre-order traversal starting from `root`. Invokes the provided
-// `checker` on the current node, then recursively on its children.
-// NOTE: This performs a DEEP traversal. Use `VisitChildren` internally to
-// ensure recursion continues through all node types.
+// Calls the `Leave` member of checkers that track nesting, if any.
 template <class C, class Node>
-void CheckBelow(const Node& root, C&& checker) {
-  checker(root);
-  VisitChildren(root, [&](const auto& child) {
-    CheckBelow(child, checker);
-    return true;
-  });
+void Leave(C& checker, const Node& node) {
+  if constexpr (requires { checker.Leave(node); }) checker.Leave(node);
+}
+
+// Calls the `Resume` member of checkers that carry state from the enclosing
+// nodes into a subtree checked on its own, if any.
+template <class C>
+void Resume(C& checker, const C& outer) {
+  if constexpr (requires { checker.Resume(outer); }) checker.Resume(outer);
 }
 
-// Runs several checkers sequentially.
+// @brief Traverses an AST subtree and applies the checkers to each node.
+//
+// Performs a pre-order traversal starting from `root`. Invokes every one of
+// the `checkers` on the current node, then on its children, and finally calls
+// their `Leave` members on the current node. Skips nodes, and their subtrees,
+// for which `defer` returns true.
+// NOTE: This performs a DEEP traversal with the explicit stack of `Traverse`,
+// so the depth of the tree does not matter.
+template <class... C, class D>
+void CheckBelow(NodePtr root, std::tuple<C...>& checkers, D& defer) {
+  Traverse(
+      root,
+      [&](const auto& node) {
+        if (defer(node)) return false;
+        std::apply([&](C&... c) { (c(node), ...); }, checkers);
+        return true;
+      },
+      [&](const auto& node) { std::apply([&](C&... c) { (Leave(c, node), ...); }, checkers); });
+}
+
+// Runs several checkers in a single traversal. Each reports to an error list of
+// its own, so that errors are listed checker by checker in the given order, as
+// if each had a traversal of its own.
+//
+// With more than one thread, function declarations outside of functions are
+// checked as separate tasks, each with its own checkers, error lists, and
+// TypeFinder sharing the cache of the given one. The errors of a task are
+// spliced into the lists where the function occurs, so they are the same as
+// with one thread. Errors of the TypeFinders of tasks are appended to those of
+// the given one in the order of the functions.
 template <class... C>
-void CheckBelow(const Expr& root, Errors& errors, const SymbolTable& t, TypeFinder& tf) {
-  (CheckBelow<C>(root, C{errors, t, tf}), ...);
+Errors CheckBelow(const Expr& root, const SymbolTable& t, TypeFinder& tf, int threads) {
+  using Checkers = std::tuple<C...>;
+  using ErrorLists = std::array<Errors, sizeof...(C)>;
+  constexpr auto kIndices = std::index_sequence_for<C...>{};
+  auto make_checkers = [&t]<size_t... I>(ErrorLists& errors, TypeFinder& types, std::index_sequence<I...>) {
+    return Checkers{C{errors[I], t, types}...};
+  };
+
+  // A function declaration checked on its own.
+  struct Task {
+    const Declaration* function;
+    // Checkers where the function occurs, and the lengths of their error lists.
+    Checkers outer;
+    std::array<size_t, sizeof...(C)> position;
+    ErrorLists errors;
+    Errors type_errors;
+  };
+
+  ErrorLists errors;
+  Checkers checkers = make_checkers(errors, tf, kIndices);
+  std::vector<Task> tasks;
+  auto defer = [&](const auto& node) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(node)>, Declaration>) {
+      const auto* f = std::get_if<FunctionDeclaration>(&node);
+      if (threads <= 1 || !f) return false;
+      // Fixes the inferred result type before calls in other tasks need it.
+      if (!f->type_id) tf(*f->body);
+      Task& task = tasks.emplace_back(Task{&node, checkers, {}, {}, {}});
+      for (size_t i = 0; i < errors.size(); ++i) task.position[i] = errors[i].size();
+      return true;
+    }
+    return false;
+  };
+  CheckBelow(&root, checkers, defer);
+
+  ParallelFor(tasks.size(), threads, [&](size_t i) {
+    Task& task = tasks[i];
+    TypeFinder types(tf, task.type_errors);
+    Checkers task_checkers = make_checkers(task.errors, types, kIndices);
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      (Resume(std::get<I>(task_checkers), std::get<I>(task.outer)), ...);
+    }(kIndices);
+    auto check_all = [](const auto&) { return false; };
+    CheckBelow(task.function, task_checkers, check_all);
+  });
+
+  auto append = [](Errors& to, auto begin, auto end) {
+    to.insert(to.end(), std::make_move_iterator(begin), std::make_move_iterator(end));
+  };
+  Errors all;
+  for (size_t i = 0; i < errors.size(); ++i) {
+    size_t done = 0;
+    for (Task& task : tasks) {
+      append(all, errors[i].begin() + done, errors[i].begin() + task.position[i]);
+      append(all, task.errors[i].begin(), task.errors[i].end());
+      done = task.position[i];
+    }
+    append(all, errors[i].begin() + done, errors[i].end());
+  }
+  for (Task& task : tasks) append(tf.errors(), task.type_errors.begin(), task.type_errors.end());
+  return all;
 }
 
-static std::unordered_set<std::string_view> kBuiltinTypes{"int", "string"};
+bool IsBuiltinType(const types::Type* type) {
+  return type->kind == types::Type::kInt || type->kind == types::Type::kString;
+}
 
 // Record literal field names, expression types, and the order
 // thereof must exactly match those of the given record type (2.3)
@@ -69,46 +163,43 @@ struct RecordFieldChecker : Checker {
   void operator()(const Expr& e) {
     const RecordLiteral* lit = std::get_if<RecordLiteral>(&e);
     if (!lit) return;
-    const TypeDeclaration* d = symbols.lookupType(e, lit->type_id);
-    while (true) {
-      if (!d) {
-        emit() << "Unknown record type " << lit->type_id;
-        return;
-      }
-      const auto* alias = std::get_if<Identifier>(&d->value);
-      if (!alias) break;
-      if (kBuiltinTypes.contains(*alias)) {
-        emit() << "Type " << lit->type_id << " is not a record";
-        return;
-      }
-      d = symbols.lookupType(e, *alias);
+    const types::Type* type = symbols.getBinding(e).value_type;
+    if (!type || type->kind == types::Type::kUnknown) {
+      emit() << "Unknown record type " << lit->type_id;
+      return;
     }
-    const auto* tf = std::get_if<TypeFields>(&d->value);
-    if (!tf) {
+    if (type->kind != types::Type::kRecord) {
       emit() << "Type " << lit->type_id << " is not a record";
       return;
     }
-    const std::vector<FieldAssignment>& assignments = lit->fields;
-    if (assignments.size() != tf->size()) {
-      emit() << "Type " << d->id << " has " << tf->size() << " fields and literal has " << assignments.size();
+    const types::Type* record = type->canonical;
+    const std::vector<types::Type::Field>& fields = record->fields;
+    ArenaSpan<FieldAssignment> assignments = lit->fields;
+    if (assignments.size() != fields.size()) {
+      emit() << "Type " << record->name << " has " << fields.size() << " fields and literal has " << assignments.size();
       return;
     }
     // > Field names, expression types, and the order thereof must exactly match
     // > those of the given record type.
-    for (size_t i = 0; i < tf->size(); ++i) {
-      if (assignments[i].id != tf->at(i).id) {
-        emit() << "Different names " << assignments[i].id << " and " << tf->at(i).id << " for field #" << (i + 1)
-               << " of record " << d->id;
-      } else if (std::string_view t = get_type(*assignments[i].expr); t != tf->at(i).type_id) {
-        emit() << "Different types " << t << " and " << tf->at(i).type_id << " for field #" << (i + 1) << " of record "
-               << d->id;
+    for (size_t i = 0; i < fields.size(); ++i) {
+      bool is_nil = std::holds_alternative<Nil>(*assignments[i].expr);
+      if (assignments[i].id != fields[i].id) {
+        emit() << "Different names " << assignments[i].id << " and " << fields[i].id << " for field #" << (i + 1)
+               << " of record " << record->name;
+      } else if (is_nil && fields[i].type->kind != types::Type::kRecord) {
+        emit() << "Type " << fields[i].type->name << " is not a record type";
+      } else if (const types::Type* t = get_type(*assignments[i].expr); !is_nil && !SameType(t, fields[i].type)) {
+        emit() << "Different types " << t->name << " and " << fields[i].type->name << " for field #" << (i + 1)
+               << " of record " << record->name;
       }
     }
   }
 };
 
-// Binary operators >, <, >=, and <= may be either both integer or both string
-// (2.5). Operators & and | are lazy logical operators on integers (2.5)
+// Binary operators >, <, >=, and <= may be either both integer or both string,
+// and = and <> compare values of the same type, or records with nil (2.5).
+// Arithmetic operators take integers, and & and | are lazy logical operators
+// on integers (2.5)
 struct BinaryOpChecker : Checker {
   BinaryOpChecker(Errors& errors, const SymbolTable& symbols, TypeFinder& tf) : Checker{errors, symbols, tf} {}
 
@@ -123,6 +214,14 @@ struct BinaryOpChecker : Checker {
       case kNotLessThan:
         CheckComparison(get_type(*b->left), get_type(*b->right), b->op);
         break;
+      case kEqual:
+      case kUnequal:
+        CheckEquality(*b->left, *b->right, b->op);
+        break;
+      case kPlus:
+      case kMinus:
+      case kTimes:
+      case kDivide:
       case kAnd:
       case kOr:
         CheckInt(get_type(*b->left), b->op);
@@ -133,21 +232,30 @@ struct BinaryOpChecker : Checker {
     }
   }
 
-  void CheckComparison(std::string_view left_type, std::string_view right_type, BinaryOp op) {
+  void CheckComparison(const types::Type* left_type, const types::Type* right_type, BinaryOp op) {
     CheckPrimitive(left_type, op);
     CheckPrimitive(right_type, op);
-    if (left_type != right_type) {
-      emit() << "Types of " << op << " should match, but got " << left_type << " and " << right_type;
+    if (!SameType(left_type, right_type)) {
+      emit() << "Types of " << op << " should match, but got " << left_type->name << " and " << right_type->name;
+    }
+  }
+  // Comparisons with nil are checked by the NilChecker.
+  void CheckEquality(const Expr& left, const Expr& right, BinaryOp op) {
+    if (std::holds_alternative<Nil>(left) || std::holds_alternative<Nil>(right)) return;
+    const types::Type* left_type = get_type(left);
+    const types::Type* right_type = get_type(right);
+    if (!SameType(left_type, right_type)) {
+      emit() << "Types of " << op << " should match, but got " << left_type->name << " and " << right_type->name;
     }
   }
-  void CheckPrimitive(std::string_view type, BinaryOp op) {
-    if (!kBuiltinTypes.contains(type)) {
-      emit() << "Operand type of " << op << " must be int or string, but got " << type;
+  void CheckPrimitive(const types::Type* type, BinaryOp op) {
+    if (!IsBuiltinType(type)) {
+      emit() << "Operand type of " << op << " must be int or string, but got " << type->name;
     }
   }
-  void CheckInt(std::string_view type, BinaryOp op) {
-    if (type != "int") {
-      emit() << "Operand type for " << op << " must be int, but got " << type;
+  void CheckInt(const types::Type* type, BinaryOp op) {
+    if (type->kind != types::Type::kInt) {
+      emit() << "Operand type for " << op << " must be int, but got " << type->name;
     }
   }
 };
@@ -168,9 +276,9 @@ struct ConditionalChecker : Checker {
   }
 
   void CheckInt(const Expr& condition) {
-    std::string_view type = get_type(condition);
-    if (type != "int") {
-      emit() << "Conditions must be int, but got " << type;
+    const types::Type* type = get_type(condition);
+    if (type->kind != types::Type::kInt) {
+      emit() << "Conditions must be int, but got " << type->name;
     }
   }
 };
@@ -183,21 +291,20 @@ struct NilChecker : Checker {
   void operator()(const Expr& e) {
     const Binary* b = std::get_if<Binary>(&e);
     if (b && std::get_if<Nil>(b->left.get())) {
-      CheckRecordType(get_type(*b->right), e);
+      CheckRecordType(get_type(*b->right));
     }
     if (b && std::get_if<Nil>(b->right.get())) {
-      CheckRecordType(get_type(*b->left), e);
+      CheckRecordType(get_type(*b->left));
     }
     const Assignment* a = std::get_if<Assignment>(&e);
     if (a && std::get_if<Nil>(a->expr.get())) {
-      CheckRecordType(get_type.GetLValueType(e, *a->l_value), e);
+      CheckRecordType(get_type.GetLValueType(e, *a->l_value));
     }
   }
 
-  void CheckRecordType(std::string_view type, const Expr& e) {
-    const TypeDeclaration* decl = symbols.lookupUnaliasedType(e, type);
-    if (decl == nullptr || !std::get_if<TypeFields>(&decl->value)) {
-      emit() << "Type " << type << " is not a record type";
+  void CheckRecordType(const types::Type* type) {
+    if (type->kind != types::Type::kRecord) {
+      emit() << "Type " << type->name << " is not a record type";
     }
   }
 };
@@ -212,39 +319,31 @@ struct FunctionCallChecker : Checker {
     const FunctionCall* fc = std::get_if<FunctionCall>(&e);
     if (!fc) return;
 
-    const FunctionDeclaration* fd = symbols.lookupFunction(e, fc->id);
-    if (!fd) return;
+    // Functions that are not declared may be library functions.
+    const FunctionDeclaration* fd = symbols.getBinding(e).function();
+    const types::Signature* signature = fd ? &symbols.getSignature(*fd) : types::LibrarySignature(fc->id.str());
+    if (!signature) {
+      // Typing the call reports the function as not found.
+      get_type(e);
+      return;
+    }
 
-    if (fc->arguments.size() != fd->parameter.size()) {
-      emit() << "Function " << fc->id << " expects " << fd->parameter.size() << " arguments, but got "
+    if (fc->arguments.size() != signature->parameters.size()) {
+      emit() << "Function " << fc->id << " expects " << signature->parameters.size() << " arguments, but got "
              << fc->arguments.size();
       return;
     }
 
     for (size_t i = 0; i < fc->arguments.size(); ++i) {
       bool is_nil = std::holds_alternative<Nil>(*fc->arguments[i]);
-      std::string_view arg_type = is_nil ? "nil" : get_type(*fc->arguments[i]);
-      std::string_view declared_type = fd->parameter[i].type_id;
-      std::string_view expected_type = declared_type;
-
-      const TypeDeclaration* td = symbols.lookupType(e, expected_type);
-      while (td) {
-        if (const auto* alias = std::get_if<Identifier>(&td->value)) {
-          expected_type = *alias;
-          td = symbols.lookupType(e, expected_type);
-        } else {
-          break;
-        }
-      }
-
-      if (arg_type != expected_type && arg_type != "NOTYPE" && arg_type != "nil") {
-        emit() << "Argument " << i + 1 << " of function " << fc->id << " expects type " << declared_type << " but got "
-               << arg_type;
-      } else if (arg_type == "nil") {
-        const TypeDeclaration* decl = symbols.lookupUnaliasedType(e, declared_type);
-        if (!decl || !std::get_if<TypeFields>(&decl->value)) {
-          emit() << "Type " << declared_type << " is not a record type";
-        }
+      const types::Type* arg_type = is_nil ? types::Nil() : get_type(*fc->arguments[i]);
+      const types::Type* declared_type = signature->parameters[i];
+
+      if (!is_nil && arg_type != types::Unit() && !SameType(arg_type, declared_type)) {
+        emit() << "Argument " << i + 1 << " of function " << fc->id << " expects type " << declared_type->name
+               << " but got " << arg_type->name;
+      } else if (is_nil && declared_type->kind != types::Type::kRecord) {
+        emit() << "Type " << declared_type->name << " is not a record type";
       }
     }
   }
@@ -282,54 +381,35 @@ struct DeclarationChecker : Checker {
 
   void operator()(const VariableDeclaration& v) {
     bool is_nil = std::holds_alternative<Nil>(*v.value);
-    std::string_view type = is_nil ? "nil" : get_type(*v.value);
+    const types::Type* type = is_nil ? types::Nil() : get_type(*v.value);
 
-    if (type == "NOTYPE") {
+    if (type == types::Unit()) {
       emit() << "Variable " << v.id << " initialized with no value";
     }
-    if (v.type_id) {
-      std::string_view declared_type = *v.type_id;
-      const TypeDeclaration* td = symbols.lookupType(*v.value, declared_type);
-      while (td) {
-        if (const auto* alias = std::get_if<Identifier>(&td->value)) {
-          declared_type = *alias;
-          td = symbols.lookupType(*v.value, declared_type);
-        } else {
-          break;
-        }
-      }
-
-      if (type != declared_type && type != "NOTYPE" && type != "nil") {
-        // Basic string mismatch check resolved.
-        emit() << "Variable " << v.id << " declared type " << *v.type_id << " but initialized with " << type;
-      } else {
-        if (type == "nil") {
-          // Check for nil assignment to record
-          const TypeDeclaration* decl = symbols.lookupUnaliasedType(*v.value, *v.type_id);
-          if (!decl || !std::get_if<TypeFields>(&decl->value)) {
-            emit() << "Nil may only be used for records with known type";
-          }
-        }
+    if (const types::Type* declared_type = symbols.getType(v)) {
+      if (!is_nil && type != types::Unit() && !SameType(type, declared_type)) {
+        emit() << "Variable " << v.id << " declared type " << declared_type->name << " but initialized with "
+               << type->name;
+      } else if (is_nil && declared_type->kind != types::Type::kRecord) {
+        // Check for nil assignment to record
+        emit() << "Nil may only be used for records with known type";
       }
     } else {  // No type declared
-      if (type == "nil") {
+      if (is_nil) {
         emit() << "Nil may only be used for records with known type";
       }
     }
   }
 
   void operator()(const FunctionDeclaration& f) {
-    std::string_view body_type = get_type(*f.body);
-    if (f.type_id) {
-      // TODO: This uses strict string comparison and does not currently resolve
-      // type aliases. If a function returns an alias (e.g., `myint`) but is
-      // declared to return the base type (`int`), or vice-versa, this will
-      // incorrectly emit an error.
-      if (body_type != *f.type_id) {
-        emit() << "Function " << f.id << " declared to return " << *f.type_id << " but body returns " << body_type;
+    const types::Type* body_type = get_type(*f.body);
+    if (const types::Type* result_type = symbols.getSignature(f).result) {
+      if (!SameType(body_type, result_type)) {
+        emit() << "Function " << f.id << " declared to return " << result_type->name << " but body returns "
+               << body_type->name;
       }
     } else {
-      if (body_type != "NOTYPE") {
+      if (body_type != types::Unit()) {
         emit() << "Procedure " << f.id << " body must not return a value";
       }
     }
@@ -338,7 +418,7 @@ struct DeclarationChecker : Checker {
  private:
   using DeclPtr = std::variant<const TypeDeclaration*, const VariableDeclaration*, const FunctionDeclaration*>;
 
-  std::vector<std::vector<DeclPtr>> GroupDeclarations(const std::vector<std::unique_ptr<Declaration>>& decls) {
+  std::vector<std::vector<DeclPtr>> GroupDeclarations(ArenaSpan<ArenaPtr<Declaration>> decls) {
     std::vector<std::vector<DeclPtr>> chunks;
     if (decls.empty()) return chunks;
 
@@ -359,7 +439,7 @@ struct DeclarationChecker : Checker {
   }
 
   void CheckTypeGroup(const std::vector<DeclPtr>& group) {
-    std::unordered_set<std::string_view> names;
+    std::unordered_set<Symbol> names;
     for (const auto& d : group) {
       const auto* td = std::get<const TypeDeclaration*>(d);
       if (!names.insert(td->id).second) {
@@ -381,7 +461,7 @@ struct DeclarationChecker : Checker {
     // e.g. type a = b; type b = a;
     // Start BFS/DFS from start. If we hit start again without passing
     // record/array, illegal. Only traverse references within the group.
-    std::unordered_set<std::string_view> visited;
+    std::unordered_set<Symbol> visited;
     std::vector<const TypeDeclaration*> q;
     q.push_back(start);
     visited.insert(start->id);
@@ -409,7 +489,7 @@ struct DeclarationChecker : Checker {
   }
 
   void CheckFunctionGroup(const std::vector<DeclPtr>& group) {
-    std::unordered_set<std::string_view> names;
+    std::unordered_set<Symbol> names;
     for (const auto& d : group) {
       const auto* fd = std::get<const FunctionDeclaration*>(d);
       if (!names.insert(fd->id).second) {
@@ -424,37 +504,27 @@ struct DeclarationChecker : Checker {
 // - Loop body must not return a value (2.8)
 // - For loop variable may not be assigned to (2.8)
 // - Break expression is illegal outside loop bodies
-struct StructureChecker {
-  StructureChecker(Errors& errors, const SymbolTable& symbols, TypeFinder& tf)
-      : errors(errors), symbols(symbols), get_type(tf) {}
+struct StructureChecker : Checker {
+  StructureChecker(Errors& errors, const SymbolTable& symbols, TypeFinder& tf) : Checker{errors, symbols, tf} {}
 
-  Errors& errors;
-  const SymbolTable& symbols;
-  TypeFinder& get_type;
   int loops_entered = 0;
+  // Bodies of the loops visited, innermost last. Their conditions and bounds
+  // are not inside the loop.
+  std::vector<const Expr*> loop_bodies;
 
-  Emitter emit() { return {errors}; }
-
-  void Check(const Expr& e) {
+  void operator()(const auto&) {}
+  void operator()(const Expr& e) {
+    if (!loop_bodies.empty() && loop_bodies.back() == &e) loops_entered++;
     if (const auto* loop = std::get_if<While>(&e)) {
-      if (get_type(*loop->body) != "NOTYPE") {
+      if (get_type(*loop->body) != types::Unit()) {
         emit() << "Loop body must not return a value";
       }
-      Check(*loop->condition);
-      loops_entered++;
-      Check(*loop->body);
-      loops_entered--;
-      return;
+      loop_bodies.push_back(loop->body.get());
     } else if (const auto* loop = std::get_if<For>(&e)) {
-      if (get_type(*loop->body) != "NOTYPE") {
+      if (get_type(*loop->body) != types::Unit()) {
         emit() << "Loop body must not return a value";
       }
-      Check(*loop->start);
-      Check(*loop->end);
-      loops_entered++;
-      Check(*loop->body);
-      loops_entered--;
-      return;
+      loop_bodies.push_back(loop->body.get());
     } else if (const auto* ite = std::get_if<IfThenElse>(&e)) {
       CheckBranchTypes(*ite->then_expr, *ite->else_expr);
     } else if (std::get_if<Break>(&e)) {
@@ -463,30 +533,32 @@ struct StructureChecker {
       }
     } else if (const auto* assign = std::get_if<Assignment>(&e)) {
       if (const auto* id = std::get_if<Identifier>(assign->l_value.get())) {
-        StorageLocation loc = symbols.lookupStorageLocation(e, *id);
+        StorageLocation loc = symbols.getBinding(e).storage();
         if (std::holds_alternative<const For*>(loc)) {
           emit() << "For loop variable " << *id << " may not be assigned to";
         }
       }
     }
-
-    // Generic recursion
-    VisitChildren(e, [&](const auto& child) {
-      Check(child);
-      return true;
-    });
   }
 
-  template <class T>
-  void Check(const T& e) {
-    VisitChildren(e, [&](const auto& child) {
-      Check(child);
-      return true;
-    });
+  void Leave(const Expr& e) {
+    if (!loop_bodies.empty() && loop_bodies.back() == &e) {
+      loops_entered--;
+      loop_bodies.pop_back();
+    }
   }
 
+  // Breaks in functions declared in a loop body count as inside the loop.
+  void Resume(const StructureChecker& outer) { loops_entered = outer.loops_entered; }
+
   void CheckBranchTypes(const Expr& then_e, const Expr& else_e) {
-    if (get_type(then_e) != get_type(else_e)) {
+    // Nil is a value of any record type.
+    bool then_nil = std::holds_alternative<Nil>(then_e);
+    if (then_nil != std::holds_alternative<Nil>(else_e) &&
+        get_type(then_nil ? else_e : then_e)->kind == types::Type::kRecord) {
+      return;
+    }
+    if (!SameType(get_type(then_e), get_type(else_e))) {
       // If one is void, it's fine? No, "Branches must be of the same type OR
       // both not return a value". "Both not return a value" == Both void. So if
       // both void -> Same type. If one void, one int -> different type ->
@@ -502,10 +574,20 @@ struct StructureChecker {
 
 }  // namespace
 
-Errors ListErrors(const Expr& root, const SymbolTable& t, TypeFinder& tf) {
-  Errors errors;
-  CheckBelow<DeclarationChecker, RecordFieldChecker, BinaryOpChecker, ConditionalChecker, NilChecker,
-             FunctionCallChecker>(root, errors, t, tf);
-  StructureChecker(errors, t, tf).Check(root);
-  return errors;
+Errors ListErrors(const Expr& root, const SymbolTable& t, TypeFinder& tf, int threads) {
+  return CheckBelow<DeclarationChecker, RecordFieldChecker, BinaryOpChecker, ConditionalChecker, NilChecker,
+                    FunctionCallChecker, StructureChecker>(root, t, tf, threads);
+}
+
+Errors ListErrorsPerChecker(const Expr& root, const SymbolTable& t, TypeFinder& tf) {
+  Errors (*const checks[])(const Expr&, const SymbolTable&, TypeFinder&, int) = {
+      &CheckBelow<DeclarationChecker>, &CheckBelow<RecordFieldChecker>, &CheckBelow<BinaryOpChecker>,
+      &CheckBelow<ConditionalChecker>, &CheckBelow<NilChecker>, &CheckBelow<FunctionCallChecker>,
+      &CheckBelow<StructureChecker>};
+  Errors all;
+  for (auto check : checks) {
+    Errors errors = check(root, t, tf, 1);
+    all.insert(all.end(), std::make_move_iterator(errors.begin()), std::make_move_iterator(errors.end()));
+  }
+  return all;
 }
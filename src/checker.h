@@ -9,13 +9,18 @@
 // Checks Tiger program constraints statically. Specifically:
 // - Record literal field names, expression types, and the order
 //   thereof must exactly match those of the given record type (2.3)
+// - Nil fields of record literals must be of record type (2.3)
 // - Binary operators >, <, >=, and <= may be either both integer or
 //   both string (2.5)
+// - Operators = and <> compare values of the same type, or a record
+//   with nil (2.5)
+// - Arithmetic operators take integers, and all binary operators give an
+//   integer (2.5)
 // - Operators & and | are lazy logical operators on integers (2.5)
 // - Nil may only be used for records with known type (2.7)
 // - Conditionals must evaluate to integers (2.8)
-// - If-then-else branches must be of the same type or both not return
-//   a value (2.8)
+// - If-then-else branches must be of the same type, or a record and nil,
+//   or both not return a value (2.8)
 // - Loop body must not return a value (2.8)
 // - For loop variable may not be assigned to (2.8)
 // - Break expression is illegal outside loop bodies
@@ -45,5 +50,16 @@
 //   sequence of function declarations to which it belongs (3.3)
 // - (3.3) [Common sense indicates that values of a called function
 //   should have compatible types]
+// - Calls of library functions (4) have the arguments of their
+//   signatures in types::LibrarySignature, and calls of other functions
+//   that are not declared are errors
+//
+// Function declarations are checked concurrently on the given number of
+// threads. The result does not depend on it, but with several threads the
+// TypeFinder lists the errors it finds in functions after the others.
+std::vector<std::string> ListErrors(const syntax::Expr& e, const SymbolTable& t, TypeFinder& tf, int threads = 1);
 
-std::vector<std::string> ListErrors(const syntax::Expr& e, const SymbolTable& t, TypeFinder& tf);
+// Returns the errors of ListErrors on one thread, but runs each checker in a
+// traversal of its own, as ListErrors did before the checkers shared one. It
+// is kept as the baseline of the checker benchmark.
+std::vector<std::string> ListErrorsPerChecker(const syntax::Expr& e, const SymbolTable& t, TypeFinder& tf);
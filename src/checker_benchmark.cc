@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "checker.h"
+#include "symbol_table.h"
+#include "testing/testing.h"
+#include "type_finder.h"
+
+namespace {
+
+// Number of nodes of all kinds in the tree.
+size_t CountNodes(const syntax::Expr& root) {
+  size_t count = 0;
+  syntax::Walk(root, [&](const auto&) { ++count; });
+  return count;
+}
+
+TEST_CASE("Check a program with a million nodes", "[checker]") {
+  auto root = testing::Parse(testing::SyntheticProgram(30000));
+  REQUIRE(root != nullptr);
+  auto symbols = SymbolTable::Build(*root);
+  std::cout << "Checking " << CountNodes(*root) << " nodes" << std::endl;
+
+  // Types are cached, so the second check of the same program times only the
+  // traversal and the rules.
+  std::vector<std::string> type_errors;
+  TypeFinder types(*symbols, type_errors);
+  REQUIRE(ListErrors(*root, *symbols, types).empty());
+  REQUIRE(type_errors.empty());
+
+  BENCHMARK("ListErrors") {
+    std::vector<std::string> errors;
+    TypeFinder fresh_types(*symbols, errors);
+    return ListErrors(*root, *symbols, fresh_types).size();
+  };
+  BENCHMARK("ListErrors with types cached") { return ListErrors(*root, *symbols, types).size(); };
+  // Baseline of a traversal per checker, as checks were run before.
+  BENCHMARK("ListErrorsPerChecker") {
+    std::vector<std::string> errors;
+    TypeFinder fresh_types(*symbols, errors);
+    return ListErrorsPerChecker(*root, *symbols, fresh_types).size();
+  };
+  BENCHMARK("ListErrorsPerChecker with types cached") { return ListErrorsPerChecker(*root, *symbols, types).size(); };
+
+  int threads = std::max(2u, std::thread::hardware_concurrency());
+  BENCHMARK("ListErrors on " + std::to_string(threads) + " threads") {
+    std::vector<std::string> errors;
+    TypeFinder fresh_types(*symbols, errors);
+    return ListErrors(*root, *symbols, fresh_types, threads).size();
+  };
+}
+}  // namespace
@@ -1,5 +1,6 @@
 #include "checker.h"
 
+#include <string>
 #include <string_view>
 
 #include "catch2/catch_test_macros.hpp"
@@ -8,7 +9,7 @@
 namespace {
 
 std::vector<std::string> Check(const char* text) {
-  std::unique_ptr<syntax::Expr> e = testing::Parse(text);
+  std::shared_ptr<syntax::Expr> e = testing::Parse(text);
   REQUIRE(e != nullptr);
   auto st = SymbolTable::Build(*e);
   std::vector<std::string> errors;
@@ -18,6 +19,19 @@ std::vector<std::string> Check(const char* text) {
   return errors;
 }
 
+// Returns the errors of checking the given program on the given number of
+// threads, followed by those of the TypeFinder.
+std::vector<std::string> CheckOnThreads(const char* text, int threads) {
+  std::shared_ptr<syntax::Expr> e = testing::Parse(text);
+  REQUIRE(e != nullptr);
+  auto st = SymbolTable::Build(*e);
+  std::vector<std::string> type_errors;
+  TypeFinder tf(*st, type_errors);
+  std::vector<std::string> errors = ListErrors(*e, *st, tf, threads);
+  errors.insert(errors.end(), type_errors.begin(), type_errors.end());
+  return errors;
+}
+
 bool StartsWith(std::string_view text, std::string_view prefix) { return text.substr(0, prefix.size()) == prefix; }
 
 SCENARIO("Static checking", "[checker]") {
@@ -51,6 +65,14 @@ SCENARIO("Static checking", "[checker]") {
     REQUIRE(errors.size() == 1);
     REQUIRE(errors[0] == "Different types string and int for field #1 of record Bulk");
   }
+  GIVEN("Nil for fields") {
+    REQUIRE(Check("let type List = {head:int, tail:List} in List {head=1, tail=nil} end").empty());
+    std::vector<std::string> errors = Check(
+        "let type Bulk = {height:int, weight:int} in "
+        "Bulk {height=nil, weight=200} end");
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors[0] == "Type int is not a record type");
+  }
   GIVEN("Wrong type") {
     std::vector<std::string> errors = Check(
         "let type Bulk = {height:int, weight:int} in "
@@ -85,6 +107,32 @@ SCENARIO("Static checking", "[checker]") {
     REQUIRE(or_errors[0] == "Operand type for | must be int, but got string");
     REQUIRE(or_errors[1] == "Operand type for | must be int, but got string");
   }
+  GIVEN("Comparisons with =") {
+    REQUIRE(Check("\"a\" = \"b\"").empty());
+    std::vector<std::string> errors = Check("1 <> \"b\"");
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors[0] == "Types of <> should match, but got int and string");
+  }
+  GIVEN("Arithmetic on a string") {
+    std::vector<std::string> errors = Check("3 + \"var\"");
+    REQUIRE(errors.size() == 1);
+    REQUIRE(errors[0] == "Operand type for + must be int, but got string");
+  }
+  GIVEN("Calls of library functions") {
+    THEN("their results have the types of their signatures") {
+      REQUIRE(Check(R"(
+let var c := getchar()
+in if ord(c) >= ord("0") & size(concat(c, chr(1))) = 2 | not(c = "") then print(substring(c, 0, 1))
+end)")
+                  .empty());
+    }
+    THEN("their arguments are checked") {
+      std::vector<std::string> errors = Check("(printi(\"1\"); print())");
+      REQUIRE(errors.size() == 2);
+      REQUIRE(errors[0] == "Argument 1 of function printi expects type int but got string");
+      REQUIRE(errors[1] == "Function print expects 1 arguments, but got 0");
+    }
+  }
   GIVEN("int condition") {
     auto errors = Check("if 1 < 2 then printi(1)");
     REQUIRE(errors.size() == 0);
@@ -227,6 +275,9 @@ end)");
       REQUIRE(errors.size() == 1);
       REQUIRE(errors[0] == "If-then-else branches must have same type");
     }
+    WHEN("If-then-else of a record and nil") {
+      REQUIRE(Check("let type r = {a: int} in if 1 then r{a=1} else nil end").empty());
+    }
     WHEN("If-then-else void mismatch") {
       auto errors = Check("if 1 then 5 else ()");
       REQUIRE(errors.size() == 1);
@@ -277,6 +328,56 @@ end)");
     }
   }
 
+  GIVEN("Errors in several functions") {
+    const char* program = R"(
+let
+  var limit := 10
+  function f(a: int): int = if a < "a" then 1 else ""
+  function g() = while limit do (limit := limit - 1; break)
+  function h(): string = f(limit)
+  function p() = h()
+  function q(): int = undefined + 1
+in
+  while 1 do
+    let function r() = break
+    in r(); f("x"); g(); q() end;
+  break
+end)";
+    std::vector<std::string> sequential = CheckOnThreads(program, 1);
+    REQUIRE(sequential.size() == 9);
+    REQUIRE(sequential.back() == "Variable not found: undefined");
+    THEN("checking on several threads finds the same errors in the same order") {
+      for (int threads : {2, 8}) REQUIRE(CheckOnThreads(program, threads) == sequential);
+    }
+    THEN("checking with a traversal per checker finds the same errors in the same order") {
+      std::shared_ptr<syntax::Expr> e = testing::Parse(program);
+      auto st = SymbolTable::Build(*e);
+      std::vector<std::string> type_errors;
+      TypeFinder tf(*st, type_errors);
+      TypeFinder separate_tf(*st, type_errors);
+      REQUIRE(ListErrorsPerChecker(*e, *st, separate_tf) == ListErrors(*e, *st, tf));
+    }
+  }
+  // Build with -DTSAN=ON to run this under ThreadSanitizer.
+  GIVEN("Many functions using the same outer declarations") {
+    std::string program =
+        "let type point = {x: int, y: int} var origin := point{x=0, y=0} var scale := 3\n"
+        "  function norm(p: point): int = p.x * scale + p.y\n";
+    for (int i = 0; i < 200; ++i) {
+      program += "  function f" + std::to_string(i) + "(a: int): int = norm(point{x=a, y=origin.y}) + scale + " +
+                 std::to_string(i) + "\n";
+    }
+    program += "in f0(1) end";
+    std::vector<std::string> sequential = CheckOnThreads(program.c_str(), 1);
+    REQUIRE(sequential.empty());
+    THEN("checking on several threads finds the same errors") {
+      for (int threads : {2, 8}) REQUIRE(CheckOnThreads(program.c_str(), threads) == sequential);
+    }
+  }
+  GIVEN("A program nested a million levels deep") {
+    std::string program = testing::DeepProgram(1000000);
+    THEN("checking it does not exhaust the stack") { REQUIRE(Check(program.c_str()).empty()); }
+  }
   GIVEN("Function call checks") {
     WHEN("Valid function call") {
       auto errors = Check("let function f(a:int, b:string):int = a in f(5, \"hello\") end");
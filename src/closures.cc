@@ -0,0 +1,137 @@
+#include "closures.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <variant>
+
+namespace java {
+
+using syntax::Overloaded;
+
+std::string Sanitize(syntax::Symbol id) {
+  static const std::unordered_set<syntax::Symbol> kJavaKeywords = [] {
+    std::unordered_set<syntax::Symbol> symbols;
+    for (std::string_view keyword : {
+      "abstract",  "assert",   "boolean",  "break",    "byte",    "case",         "catch",     "char",       "class",
+      "const",     "continue", "default",  "do",       "double",  "else",         "enum",      "extends",    "final",
+      "finally",   "float",    "for",      "goto",     "if",      "implements",   "import",    "instanceof", "int",
+      "interface", "long",     "native",   "new",      "package", "private",      "protected", "public",     "return",
+      "short",     "static",   "strictfp", "super",    "switch",  "synchronized", "this",      "throw",      "throws",
+      "transient", "try",      "void",     "volatile", "while"}) {
+      symbols.insert(syntax::Symbol(keyword));
+    }
+    return symbols;
+  }();
+  return kJavaKeywords.count(id) ? "_" + std::string(id.str()) : std::string(id.str());
+}
+
+Closures FindClosures(const syntax::Expr& root, const SymbolTable& t, TypeFinder& tf) {
+  using Key = std::pair<int, int>;  // Scope id and slot, or -1 for the object.
+  struct Use {
+    const Scope* scope;
+    const Scope* target;
+    int slot;
+  };
+  std::vector<Use> uses;
+  std::vector<std::pair<const Scope*, const Scope*>> calls;  // Scopes of call and callee.
+  std::set<std::pair<const Scope*, int>> assigned;
+  std::map<Key, const types::Type*> value_types;
+  std::set<Key> globals;
+  syntax::Walk(root, Overloaded{[&](const syntax::Expr& e) {
+                                  const Binding& b = t.getBinding(e);
+                                  const Scope* scope = t.getScope(e);
+                                  if (!scope || !b.scope) return;
+                                  if (const auto* fd = b.function()) {
+                                    if (const Scope* callee = t.getScope(*fd)) calls.emplace_back(scope, callee);
+                                    return;
+                                  }
+                                  StorageLocation storage = b.storage();
+                                  if (std::holds_alternative<std::nullptr_t>(storage)) return;
+                                  const auto* a = std::get_if<syntax::Assignment>(&e);
+                                  if (a && std::holds_alternative<syntax::Identifier>(*a->l_value)) {
+                                    assigned.emplace(b.scope, b.slot);
+                                  }
+                                  if (!b.scope->captured[b.slot]) return;
+                                  const auto* var = std::get_if<const syntax::VariableDeclaration*>(&storage);
+                                  value_types[{b.scope->id, b.slot}] = b.value_type ? b.value_type : tf(**var);
+                                  // Loop variables stay Java locals of the for statement.
+                                  if (b.scope->function_scope->depth == 0 &&
+                                      !std::holds_alternative<const syntax::For*>(storage)) {
+                                    globals.emplace(b.scope->id, b.slot);
+                                  } else {
+                                    uses.push_back({scope, b.scope, b.slot});
+                                  }
+                                },
+                                [](const auto&) {}});
+  Closures closures;
+  for (const auto& [scope, slot] : assigned) {
+    if (!scope->captured[slot] || globals.count({scope->id, slot})) continue;
+    auto [it, inserted] = closures.in_object.try_emplace(scope, scope->slots.size(), false);
+    it->second[slot] = true;
+  }
+  // Free variables of functions by scope of parameters, ordered by key.
+  std::unordered_map<const Scope*, std::set<Key>> needs;
+  // Adds the given key of the given target scope to the functions around the
+  // given scope of use that the target scope is outside of. Returns true if
+  // any did not have it yet.
+  auto add = [&](const Scope* use, const Scope* target, Key key) {
+    bool changed = false;
+    for (const Scope* f = use->function_scope; f->depth > target->depth; f = f->parent->function_scope) {
+      changed |= needs[f].insert(key).second;
+    }
+    return changed;
+  };
+  for (const Use& u : uses) {
+    add(u.scope, u.target, {u.target->id, closures.InObject(u.target, u.slot) ? -1 : u.slot});
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto [use, callee] : calls) {
+      auto it = needs.find(callee);
+      if (it == needs.end()) continue;
+      // Copies, as calls may add to the needs of the callee.
+      for (Key key : std::vector<Key>(it->second.begin(), it->second.end())) {
+        changed |= add(use, t.scopes()[key.first].get(), key);
+      }
+    }
+  }
+  // Values are passed under their own name, unless the function declares or
+  // needs another name like it. Likewise, static fields have their own name,
+  // unless another scope declares it.
+  std::unordered_map<const Scope*, std::unordered_map<syntax::Symbol, int>> names;
+  std::unordered_map<syntax::Symbol, int> all_names;
+  for (const auto& scope : t.scopes()) {
+    for (syntax::Symbol name : scope->slots) {
+      names[scope->function_scope][name]++;
+      all_names[name]++;
+    }
+  }
+  for (auto [id, slot] : globals) {
+    syntax::Symbol name = t.scopes()[id]->slots[slot];
+    closures.globals.push_back({t.scopes()[id].get(), slot, value_types[{id, slot}],
+                                all_names[name] > 1 ? Sanitize(name) + "_" + std::to_string(id) : Sanitize(name)});
+  }
+  for (const auto& [f, keys] : needs) {
+    for (Key key : keys) {
+      if (key.second >= 0) names[f][t.scopes()[key.first]->slots[key.second]]++;
+    }
+  }
+  for (const auto& [f, keys] : needs) {
+    std::vector<FreeVariable>& free = closures.free[f];
+    for (auto [id, slot] : keys) {
+      const Scope* scope = t.scopes()[id].get();
+      if (slot < 0) {
+        free.push_back({scope, slot, nullptr, "_scope" + std::to_string(id)});
+      } else {
+        syntax::Symbol name = scope->slots[slot];
+        free.push_back({scope, slot, value_types[{id, slot}],
+                        names[f][name] > 1 ? Sanitize(name) + "_" + std::to_string(id) : Sanitize(name)});
+      }
+    }
+  }
+  return closures;
+}
+
+}  // namespace java
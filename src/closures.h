@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "symbol_table.h"
+#include "syntax.h"
+#include "type_finder.h"
+#include "types.h"
+
+// Closure conversion shared by the generators of Java source and of class
+// files.
+namespace java {
+
+// Returns the given name, changed if it is a Java keyword.
+std::string Sanitize(syntax::Symbol id);
+
+// Deepest nesting of expressions the generators compile. They recurse on
+// nested expressions, except along chains of binary operators and of else-ifs,
+// and throw past this depth rather than exhaust the stack.
+constexpr int kMaxNesting = 1000;
+
+// Counts one more level of nesting in the given depth while it lives. Throws
+// std::length_error if that is more than kMaxNesting.
+class Nesting {
+ public:
+  explicit Nesting(int& depth) : depth_(depth) {
+    if (depth_ == kMaxNesting) {
+      throw std::length_error("expression nested more than " + std::to_string(kMaxNesting) + " levels deep");
+    }
+    ++depth_;
+  }
+  Nesting(const Nesting&) = delete;
+  Nesting& operator=(const Nesting&) = delete;
+  ~Nesting() { --depth_; }
+
+ private:
+  int& depth_;
+};
+
+// Storage of a function around it that a function uses, directly or in the
+// functions it calls. Callers pass it as an argument.
+struct FreeVariable {
+  // Scope declaring the storage.
+  const Scope* scope;
+  // Slot of a name that is never assigned, whose value is passed, or -1 for
+  // the object of the scope, passed for names that are assigned.
+  int slot;
+  // Type of the value, or null for the object.
+  const types::Type* type;
+  // Name of the parameter.
+  std::string name;
+};
+
+// Storage of the main program used by functions, which is a static field of the
+// generated class.
+struct Global {
+  const Scope* scope;
+  int slot;
+  const types::Type* type;
+  // Name of the field.
+  std::string name;
+};
+
+// Closure conversion. Scopes of the main program are active at most once at a
+// time, so names of them used by functions are static fields. Other names used
+// by functions nested in the one declaring them and assigned anywhere live in
+// an object of class Scope<id> for their scope. All other storage lives in
+// Java locals. Rather than a static link to the object of an enclosing scope,
+// every function takes each object and value of enclosing functions it needs
+// as a parameter of its own, so that any use of a name is a local, a static
+// field, or a single field access.
+struct Closures {
+  // Returns true if the name in the given slot of the given scope lives in the
+  // object of the scope.
+  bool InObject(const Scope* scope, int slot) const {
+    auto it = in_object.find(scope);
+    return it != in_object.end() && it->second[slot];
+  }
+  bool InObject(const Scope* scope, syntax::Symbol name) const {
+    auto slot = std::find(scope->slots.begin(), scope->slots.end(), name);
+    return slot != scope->slots.end() && InObject(scope, static_cast<int>(slot - scope->slots.begin()));
+  }
+  bool HasObject(const Scope* scope) const { return in_object.count(scope) != 0; }
+
+  // Returns the static field for the name in the given slot of the given
+  // scope, or null if it is not one.
+  const Global* FindGlobal(const Scope* scope, int slot) const {
+    for (const Global& g : globals) {
+      if (g.scope == scope && g.slot == slot) return &g;
+    }
+    return nullptr;
+  }
+  const Global* FindGlobal(const Scope* scope, syntax::Symbol name) const {
+    auto slot = std::find(scope->slots.begin(), scope->slots.end(), name);
+    return slot == scope->slots.end() ? nullptr : FindGlobal(scope, static_cast<int>(slot - scope->slots.begin()));
+  }
+
+  // Returns the free variables of the function with the given scope of
+  // parameters, outer scopes first.
+  const std::vector<FreeVariable>& Free(const Scope* function_scope) const {
+    static const std::vector<FreeVariable> kNone;
+    auto it = free.find(function_scope);
+    return it == free.end() ? kNone : it->second;
+  }
+
+  std::unordered_map<const Scope*, std::vector<bool>> in_object;
+  std::unordered_map<const Scope*, std::vector<FreeVariable>> free;
+  // In order of scope and slot.
+  std::vector<Global> globals;
+};
+
+// Finds the static fields, the storage in objects and the free variables of
+// all functions. A function needs the storage it uses from scopes around it,
+// and the storage around it needed by the functions it calls, directly or in
+// functions nested in it.
+Closures FindClosures(const syntax::Expr& root, const SymbolTable& t, TypeFinder& tf);
+
+}  // namespace java
@@ -27,13 +27,13 @@ std::ostream& AppendDebugString(const syntax::Declaration& d, std::ostream& out,
                      out << sep << param.id << ": " << param.type_id;
                      sep = ", ";
                    }
-                   out << "): " << f.type_id.value_or("NOTYPE") << std::endl << options.indent;
+                   out << "): " << f.type_id.value_or(syntax::kNoType) << std::endl << options.indent;
                    DebugStringOptions body_options = options;
                    body_options.indent += options.indent;
                    out << Str{*f.body, body_options};
                  },
                  [&](const syntax::VariableDeclaration& v) {
-                   out << "var " << v.id << ": " << v.type_id.value_or("NOTYPE") << " := " << Str{*v.value, options};
+                   out << "var " << v.id << ": " << v.type_id.value_or(syntax::kNoType) << " := " << Str{*v.value, options};
                  },
                  [&](const syntax::TypeDeclaration& t) { out << "type " << t.id << " = " << Str{t.value, options}; }},
              d);
@@ -46,7 +46,7 @@ std::ostream& AppendDebugString(const syntax::Expr& e, std::ostream& out, DebugS
       syntax::Overloaded{
           [&](const syntax::StringConstant& c) { out << "\"" << c.value << "\""; },
           [&](const syntax::IntegerConstant& c) { out << c; }, [&](const syntax::Nil&) { out << "nil"; },
-          [&](const std::unique_ptr<syntax::LValue>& l_value) { AppendDebugString(*l_value, out, options); },
+          [&](const syntax::ArenaPtr<syntax::LValue>& l_value) { AppendDebugString(*l_value, out, options); },
           [&](const syntax::Negated& n) { out << "-" << Str{*n.expr, options}; },
           [&](const syntax::Binary& b) {
             out << Str{*b.left, options} << " " << b.op << " " << Str{*b.right, options};
@@ -1,19 +1,41 @@
 #include "driver.h"
 
+#include <cerrno>
+#include <cstring>
+
 #include "parser.hh"
 
 Driver::~Driver() = default;
 
 int Driver::parse(const std::string& f) {
   file = f;
+  std::unique_ptr<SourceBuffer> source = SourceBuffer::FromFile(f);
+  if (!source) {
+    error("cannot open " + f + ": " + strerror(errno));
+    return 1;
+  }
+  return parseSource(std::move(source));
+}
+
+int Driver::parseBuffer(std::string_view text) { return parseSource(SourceBuffer::FromText(text)); }
+
+int Driver::parseSource(std::shared_ptr<SourceBuffer> source) {
+  ast_ = std::make_shared<Ast>();
+  ast_->source = std::move(source);
   scan_begin();
-  yy::Parser parser(*this);
+  yy::Parser parser(*this, scanner_);
   parser.set_debug_level(options_.trace_parsing);
   int res = parser.parse();
   scan_end();
+  ast_.reset();
   return res;
 }
 
+void Driver::set_result(syntax::ArenaPtr<syntax::Expr> root) {
+  ast_->root = root;
+  result = std::shared_ptr<syntax::Expr>(ast_, root.get());
+}
+
 void Driver::error(const yy::location& l, const std::string& m) { std::cerr << l << ": " << m << std::endl; }
 
 void Driver::error(const std::string& m) { std::cerr << m << std::endl; }
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 
 #include "parser.hh"
+#include "source_buffer.h"
 #include "syntax.h"
 
 // Tell Flex the lexer's prototype ...
-#define YY_DECL yy::Parser::symbol_type yylex(Driver& driver)
+#define YY_DECL yy::Parser::symbol_type yylex(Driver& driver, yyscan_t yyscanner)
 // ... and declare it for the parser's sake.
 YY_DECL;
 
@@ -14,30 +17,66 @@ struct DriverOptions {
   bool trace_scanning = false;
   bool trace_parsing = false;
 };
-// Conducting the whole scanning and parsing of Tiger compiler.
+
+// A parsed program: the root expression together with the source text its
+// string constants point into and the arena holding its nodes.
+// Destroying it frees the whole tree at once.
+struct Ast {
+  std::shared_ptr<SourceBuffer> source;
+  syntax::Arena arena;
+  syntax::NodeCounts counts;
+  syntax::ArenaPtr<syntax::Expr> root;
+};
+
+// Conducting the whole scanning and parsing of Tiger compiler. All scanner and
+// parser state lives in the Driver, so separate Drivers may parse
+// concurrently on separate threads.
 class Driver {
  public:
   Driver(DriverOptions options = {}) : options_(options) {}
   virtual ~Driver();
 
-  std::unique_ptr<syntax::Expr> result;
+  // Root of the parsed program. Shares ownership of the Ast, so the source
+  // text and the arena stay alive as long as the tree.
+  std::shared_ptr<syntax::Expr> result;
 
-  // Handling the scanner.
+  // Handling the scanner, which scans the source buffer in place.
   void scan_begin();
   void scan_end();
 
-  // Run the parser on file F.
+  // Run the parser on file F, which is mapped into memory.
   // Return 0 on success.
   int parse(const std::string& f);
 
+  // Run the parser on the given source text.
+  // Return 0 on success.
+  int parseBuffer(std::string_view text);
+
+  // Arena and node numbering for the tree being parsed.
+  syntax::Arena& arena() { return ast_->arena; }
+  syntax::NodeCounts& counts() { return ast_->counts; }
+
+  // Called by the parser with the root of the tree.
+  void set_result(syntax::ArenaPtr<syntax::Expr> root);
+
   // The name of the file being parsed.
   // Used later to pass the file name to the location tracker.
   std::string file;
 
+  // The location of the current token.
+  yy::location location;
+
+  // Nesting depth of the comment being scanned.
+  int comment_depth = 0;
+
   // Error handling.
   void error(const yy::location& l, const std::string& m);
   void error(const std::string& m);
 
  private:
+  int parseSource(std::shared_ptr<SourceBuffer> source);
+
   DriverOptions options_;
+  std::shared_ptr<Ast> ast_;
+  yyscan_t scanner_ = nullptr;
 };
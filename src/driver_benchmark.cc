@@ -0,0 +1,27 @@
+#include <iostream>
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "driver.h"
+#include "testing/heap_counter.h"
+#include "testing/testing.h"
+
+namespace {
+
+// Parses the given text and destroys the tree again.
+bool ParseAndDestroy(std::string_view text) {
+  Driver driver;
+  return driver.parseBuffer(text) == 0;
+}
+
+TEST_CASE("Parse and destroy a large program", "[driver]") {
+  std::string text = testing::SyntheticProgram(10000);
+
+  size_t before = testing::HeapAllocated().allocations;
+  REQUIRE(ParseAndDestroy(text));
+  std::cout << "Heap allocations for parsing " << text.size() << " bytes: "
+            << testing::HeapAllocated().allocations - before << std::endl;
+
+  BENCHMARK("parse+destroy 10000 functions") { return ParseAndDestroy(text); };
+}
+}  // namespace
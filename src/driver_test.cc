@@ -0,0 +1,154 @@
+#include "driver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+#include "debug_string.h"
+#include "testing/testing.h"
+
+namespace {
+
+constexpr const char* kPrograms[] = {
+    R"(
+let
+  var N := 8
+  type intArray = array of int
+  var row := intArray [ N ] of 0
+  var col := intArray [ N ] of 0
+  var diag1 := intArray [ N+N-1 ] of 0
+  var diag2 := intArray [ N+N-1 ] of 0
+  function printboard() =
+    (for i := 0 to N-1 do
+      (for j := 0 to N-1 do print(if col[i]=j then " O" else " .");
+       print("\n"));
+     print("\n"))
+  function try(c:int) =
+    if c=N then printboard()
+    else for r := 0 to N-1 do
+       if row[r]=0 & diag1[r+c]=0 & diag2[r+7-c]=0
+       then (row[r] := 1; diag1[r+c] := 1;
+             diag2[r+7-c] := 1; col[c] := r;
+             try(c+1);
+             row[r] := 0; diag1[r+c] := 0;
+             diag2[r+7-c] := 0)
+in try(0) end
+)",
+    R"(
+/* nested /* comments */ are skipped */
+let
+  type rec = { name: string, next: rec }
+  var r := rec { name = "a", next = nil }
+  function f(a: int): int = if a > 0 then g(a - 1) else 0
+  function g(a: int): int = if a > 0 then f(a - 1) else 1
+in
+  r.next := rec { name = "b", next = nil };
+  while f(3) <> 0 do break;
+  print(r.next.name)
+end
+)",
+};
+
+// Writes the given text to a file in the temporary directory and returns its
+// name.
+std::string WriteTempFile(const std::string& name, std::string_view text) {
+  std::string file_name = (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream(file_name) << text;
+  return file_name;
+}
+
+std::string ParseToString(const std::string& file_name) {
+  Driver driver;
+  if (driver.parse(file_name) != 0 || !driver.result) return "<parse error>";
+  return DebugString(*driver.result);
+}
+
+SCENARIO("Driver", "[driver]") {
+  GIVEN("Source text in memory") {
+    const char* kText = "let var greeting := \"hello\" in print(greeting) end";
+    std::shared_ptr<syntax::Expr> result;
+    {
+      std::string text = kText;
+      Driver driver;
+      REQUIRE(driver.parseBuffer(text) == 0);
+      result = driver.result;
+    }
+    // Strings point into the source, which the result owns.
+    REQUIRE(result != nullptr);
+    REQUIRE(DebugString(*result) == DebugString(*testing::Parse(kText)));
+    const auto& let = std::get<syntax::Let>(*result);
+    const auto& var = std::get<syntax::VariableDeclaration>(*let.declaration[0]);
+    REQUIRE(var.id == "greeting");
+    REQUIRE(std::get<syntax::StringConstant>(*var.value).value == "hello");
+  }
+
+  GIVEN("A mapped file ending on a page boundary") {
+    std::string text = "let var x := 1 in x end";
+    text.append(4096 - text.size(), ' ');
+    std::string file_name = WriteTempFile("driver_test_page.tig", text);
+    REQUIRE(ParseToString(file_name) == DebugString(*testing::Parse(text)));
+  }
+
+  GIVEN("A parsed program") {
+    auto root = testing::Parse(kPrograms[0]);
+    REQUIRE(root != nullptr);
+    std::vector<syntax::NodeId> exprs, lets, functions;
+    syntax::Walk(*root, syntax::Overloaded{[&](const syntax::Expr& e) {
+                                             exprs.push_back(e.node_id);
+                                             if (const auto* let = std::get_if<syntax::Let>(&e)) {
+                                               lets.push_back(let->node_id);
+                                             }
+                                           },
+                                           [&](const syntax::Declaration& d) {
+                                             if (const auto* f = std::get_if<syntax::FunctionDeclaration>(&d)) {
+                                               functions.push_back(f->node_id);
+                                             }
+                                           },
+                                           [](const auto&) {}});
+    THEN("nodes of each kind are numbered densely") {
+      for (auto* ids : {&exprs, &lets, &functions}) {
+        std::sort(ids->begin(), ids->end());
+        for (size_t i = 0; i < ids->size(); ++i) REQUIRE((*ids)[i] == i);
+      }
+      REQUIRE(functions.size() == 2);
+      REQUIRE(root->node_id == exprs.back());
+    }
+  }
+
+  GIVEN("A missing file") {
+    Driver driver;
+    REQUIRE(driver.parse("/nonexistent/missing.tig") != 0);
+    REQUIRE(driver.result == nullptr);
+  }
+
+  GIVEN("Concurrent parses of the same programs") {
+    std::vector<std::string> files;
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < std::size(kPrograms); ++i) {
+      files.push_back(WriteTempFile("driver_test_" + std::to_string(i) + ".tig", kPrograms[i]));
+      expected.push_back(ParseToString(files.back()));
+      REQUIRE(expected.back() != "<parse error>");
+    }
+
+    constexpr int kThreads = 8;
+    constexpr int kIterations = 50;
+    std::atomic<int> mismatches = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&] {
+        for (int i = 0; i < kIterations; ++i) {
+          for (size_t p = 0; p < files.size(); ++p) {
+            if (ParseToString(files[p]) != expected[p]) mismatches++;
+          }
+        }
+      });
+    }
+    for (std::thread& t : threads) t.join();
+    REQUIRE(mismatches == 0);
+  }
+}
+}  // namespace
@@ -1,8 +1,13 @@
 #include "emit.h"
 
+#include <algorithm>
 #include <functional>
+#include <initializer_list>
 #include <optional>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 // Implementation following
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html and example
@@ -27,6 +32,42 @@ inline void Put4(std::ostream& os, u4 v) {
   Put2(os, v & 0xffff);
 }
 
+// Growable buffer that a class file is written to in one pass. Lengths that
+// precede what they measure are reserved, and filled in once it is written.
+class ByteBuffer {
+ public:
+  explicit ByteBuffer(size_t capacity) { bytes_.reserve(capacity); }
+
+  void Put1(u1 v) { bytes_.push_back(static_cast<char>(v)); }
+  void Put2(u2 v) {
+    Put1(v >> 8);
+    Put1(v & 255);
+  }
+  void Put4(u4 v) {
+    Put2(v >> 16);
+    Put2(v & 0xffff);
+  }
+  void Write(std::string_view data) { bytes_.append(data); }
+
+  // Reserves four bytes for a length and returns their position.
+  size_t ReserveLength() {
+    size_t at = bytes_.size();
+    Put4(0);
+    return at;
+  }
+  // Sets the length at the given position to the number of bytes after it.
+  void FillLength(size_t at) {
+    u4 length = bytes_.size() - at - 4;
+    for (int i = 0; i < 4; ++i) bytes_[at + i] = static_cast<char>(length >> (24 - 8 * i));
+  }
+
+  size_t size() const { return bytes_.size(); }
+  std::string_view bytes() const { return bytes_; }
+
+ private:
+  std::string bytes_;
+};
+
 struct CodeAttribute;
 
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.7
@@ -55,22 +96,24 @@ struct AttributeInfo {
   };
   virtual ~AttributeInfo() = default;
   u2 attribute_name_index;
-  void Emit(std::ostream& os) const {
-    Put2(os, attribute_name_index);
-    std::string info_bytes = InfoBytes();
-    Put4(os, info_bytes.length());
-    os.write(info_bytes.data(), info_bytes.length());
+  void Emit(ByteBuffer& buffer) const {
+    buffer.Put2(attribute_name_index);
+    size_t length = buffer.ReserveLength();
+    EmitInfo(buffer);
+    buffer.FillLength(length);
   }
-  // Emit length and info bytes
-  virtual std::string InfoBytes() const = 0;
+  // Emit info bytes
+  virtual void EmitInfo(ByteBuffer& buffer) const = 0;
+  // Returns an upper bound of the length of the attribute.
+  virtual size_t Size() const = 0;
   virtual Tag tag() const = 0;
   virtual std::optional<CodeAttribute*> code() { return {}; }
 };
 
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.7.3
 struct CodeAttribute : AttributeInfo {
-  CodeAttribute(u2 code_name_index, std::string_view instructions)
-      : max_stack(10), max_locals(10), code_bytes(instructions) {
+  CodeAttribute(u2 code_name_index, u2 max_stack, u2 max_locals, std::string_view instructions)
+      : max_stack(max_stack), max_locals(max_locals), code_bytes(instructions) {
     attribute_name_index = code_name_index;
   }
 
@@ -79,49 +122,70 @@ struct CodeAttribute : AttributeInfo {
   std::string code_bytes;
   std::vector<std::unique_ptr<AttributeInfo>> attributes;
 
-  std::string InfoBytes() const override {
-    std::ostringstream os;
-    Put2(os, max_stack);
-    Put2(os, max_locals);
-    Put4(os, code_bytes.length());
-    os.write(code_bytes.data(), code_bytes.length());
-    Put2(os, 0);  // exception table length
-    Put2(os, attributes.size());
-    for (const auto& a : attributes) a->Emit(os);
-    return os.str();
+  void EmitInfo(ByteBuffer& buffer) const override {
+    buffer.Put2(max_stack);
+    buffer.Put2(max_locals);
+    buffer.Put4(code_bytes.length());
+    buffer.Write(code_bytes);
+    buffer.Put2(0);  // exception table length
+    buffer.Put2(attributes.size());
+    for (const auto& a : attributes) a->Emit(buffer);
+  }
+  size_t Size() const override {
+    size_t size = 18 + code_bytes.length();
+    for (const auto& a : attributes) size += a->Size();
+    return size;
   }
   Tag tag() const override { return AttributeInfo::kCode; }
   std::optional<CodeAttribute*> code() override { return this; }
 };
 
+// https://docs.oracle.com/javase/specs/jvms/se8/html/jvms-4.html#jvms-4.7.4
+struct StackMapTableAttribute : AttributeInfo {
+  StackMapTableAttribute(u2 name_index, u2 count, std::string entries) : count(count), entries(std::move(entries)) {
+    attribute_name_index = name_index;
+  }
+
+  u2 count;
+  // Encoded stack_map_frame entries.
+  std::string entries;
+
+  void EmitInfo(ByteBuffer& buffer) const override {
+    buffer.Put2(count);
+    buffer.Write(entries);
+  }
+  size_t Size() const override { return 8 + entries.length(); }
+  Tag tag() const override { return AttributeInfo::kStackMapTable; }
+};
+
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.6
 struct MethodInfo {
   u2 access_flags;
   u2 name_index;
   u2 descriptor_index;
   std::vector<std::unique_ptr<AttributeInfo>> attributes;
-  void Emit(std::ostream& os) const {
-    Put2(os, access_flags);
-    Put2(os, name_index);
-    Put2(os, descriptor_index);
-    Put2(os, attributes.size());
-    for (const auto& a : attributes) a->Emit(os);
+  void Emit(ByteBuffer& buffer) const {
+    buffer.Put2(access_flags);
+    buffer.Put2(name_index);
+    buffer.Put2(descriptor_index);
+    buffer.Put2(attributes.size());
+    for (const auto& a : attributes) a->Emit(buffer);
+  }
+  size_t Size() const {
+    size_t size = 8;
+    for (const auto& a : attributes) size += a->Size();
+    return size;
   }
 };
 
-struct Utf8Constant;
-struct StringConstant;
-struct ClassConstant;
-struct MethodRefConstant;
-struct NameAndTypeConstant;
-struct IntegerConstant;
-
 // Items in constant pool
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.4.
 struct Constant {
   u2 index;
   virtual ~Constant() = default;
-  virtual void Emit(std::ostream& os) const = 0;
+  virtual void Emit(ByteBuffer& buffer) const = 0;
+  // Returns an upper bound of the number of bytes Emit writes.
+  virtual size_t Size() const { return 5; }
   enum Tag {
     kUtf8 = 1,
     kInteger = 3,
@@ -139,36 +203,20 @@ struct Constant {
     kInvokeDynamic = 18
   };
   virtual Tag tag() const = 0;
-
-  // Match methods help find an instance based on member data
-  virtual bool Matches(std::string_view) const { return false; }
-  virtual bool Matches(u2) const { return false; }
-  virtual bool Matches(u2, u2) const { return false; }
-  virtual bool Matches(int) const { return false; }
-
-  // Safe cast by virtual method
-  virtual std::optional<Utf8Constant*> utf8() { return {}; }
-  virtual std::optional<StringConstant*> string() { return {}; }
-  virtual std::optional<ClassConstant*> clazz() { return {}; }
-  virtual std::optional<MethodRefConstant*> methodRef() { return {}; }
-  virtual std::optional<NameAndTypeConstant*> nameAndType() { return {}; }
-  virtual std::optional<IntegerConstant*> integer() { return {}; }
 };
 
 struct Ref : Constant {
   u2 class_index;
   u2 name_and_type_index;
-  bool Matches(u2 first, u2 second) const override { return class_index == first && name_and_type_index == second; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    Put2(os, class_index);
-    Put2(os, name_and_type_index);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put2(class_index);
+    buffer.Put2(name_and_type_index);
   }
 };
 
 struct MethodRefConstant : Ref, public Invocable {
   Tag tag() const override { return kMethodref; }
-  std::optional<MethodRefConstant*> methodRef() override { return this; }
   void Invoke(std::ostream& os) const override {
     os.put(char(Instruction::_invokestatic));
     Put2(os, index);
@@ -178,11 +226,9 @@ struct MethodRefConstant : Ref, public Invocable {
 struct StringConstant : Constant, Pushable {
   u2 string_index;
   Tag tag() const override { return kString; }
-  bool Matches(u2 index) const override { return index == string_index; }
-  std::optional<StringConstant*> string() override { return this; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    Put2(os, string_index);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put2(string_index);
   }
 
   void Push(std::ostream& os) const override {
@@ -199,11 +245,9 @@ struct StringConstant : Constant, Pushable {
 struct IntegerConstant : Constant, Pushable {
   u4 bytes;
   Tag tag() const override { return kInteger; }
-  bool Matches(int) const override { return false; }
-  std::optional<IntegerConstant*> integer() override { return this; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    Put4(os, bytes);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put4(bytes);
   }
 
   void Push(std::ostream& os) const override {
@@ -217,85 +261,833 @@ struct IntegerConstant : Constant, Pushable {
   }
 };
 
+// Int pushed by the instruction holding it, which is shorter than loading a
+// constant.
+struct ShortInteger : Pushable {
+  explicit ShortInteger(int16_t value) : value(value) {}
+  int16_t value;
+  void Push(std::ostream& os) const override {
+    if (value >= -1 && value <= 5) {
+      os.put(Instruction::_iconst_0 + value);
+    } else if (value >= INT8_MIN && value <= INT8_MAX) {
+      os.put(Instruction::_bipush);
+      os.put(value);
+    } else {
+      os.put(Instruction::_sipush);
+      Put2(os, value);
+    }
+  }
+};
+
 struct ClassConstant : Constant {
   u2 name_index;
   Tag tag() const override { return kClass; }
-  bool Matches(u2 index) const override { return index == name_index; }
-  std::optional<ClassConstant*> clazz() override { return this; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    Put2(os, name_index);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put2(name_index);
   }
 };
 
 struct Utf8Constant : Constant {
-  std::string text;
+  // Views text kept by the program for all of its classes.
+  std::string_view text;
   Tag tag() const override { return kUtf8; }
-  bool Matches(std::string_view match_text) const override { return text == match_text; }
-  std::optional<Utf8Constant*> utf8() override { return this; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    u2 length = text.length();
-    Put2(os, length);
-    os.write(text.data(), length);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put2(text.length());
+    buffer.Write(text);
   }
+  size_t Size() const override { return 3 + text.length(); }
 };
 
 struct NameAndTypeConstant : Constant {
   u2 name_index;
   u2 descriptor_index;
   Tag tag() const override { return kNameAndType; }
-  bool Matches(u2 first, u2 second) const override { return name_index == first && descriptor_index == second; }
-  std::optional<NameAndTypeConstant*> nameAndType() override { return this; }
-  void Emit(std::ostream& os) const override {
-    os.put(tag());
-    Put2(os, name_index);
-    Put2(os, descriptor_index);
+  void Emit(ByteBuffer& buffer) const override {
+    buffer.Put1(tag());
+    buffer.Put2(name_index);
+    buffer.Put2(descriptor_index);
   }
 };
 
-class LibraryFunction : public Invocable {};
-
-const std::unordered_map<std::string_view, const char*> kTypeByLibraryFunctionName = {
-    {"print", "(Ljava/lang/String;)V"},
-    {"printi", "(I)V"},
-    {"flush", "()V"},
-    {"getChar", "()Ljava/lang/String;"},
-    {"ord", "(Ljava/lang/String;)I"},
-    {"chr", "(I)Ljava/lang/String;"},
-    {"size", "(Ljava/lang/String;)I"},
-    {"substring", "(Ljava/lang/String;II)Ljava/lang/String;"},
-    {"concat", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;"},
-    {"not", "(I)I"},
-    {"exit", "(I)V"}};
-
-std::optional<const char*> LibraryFunctionType(std::string_view name) {
-  if (auto found = kTypeByLibraryFunctionName.find(name); found != kTypeByLibraryFunctionName.end()) {
-    return found->second;
+// Returns the number of stack or local variable slots taken by a value of the
+// type that starts with the given descriptor character.
+int SlotCount(char type) { return type == 'J' || type == 'D' ? 2 : type == 'V' ? 0 : 1; }
+
+// Field descriptors of the parameters and of the result of a method, like
+// "I", "[Ljava/lang/String;" and "V" for "(I[Ljava/lang/String;)V".
+struct MethodDescriptor {
+  std::vector<std::string_view> parameters;
+  std::string_view result;
+};
+
+// Returns the parts of the given method descriptor. Throws
+// std::invalid_argument if it is malformed.
+MethodDescriptor ParseMethodDescriptor(std::string_view descriptor) {
+  MethodDescriptor parsed;
+  size_t i = 1;
+  while (i < descriptor.size() && descriptor[i] != ')') {
+    size_t start = i;
+    while (i < descriptor.size() && descriptor[i] == '[') ++i;
+    if (i < descriptor.size() && descriptor[i] == 'L') i = descriptor.find(';', i);
+    if (i >= descriptor.size()) break;
+    parsed.parameters.push_back(descriptor.substr(start, ++i - start));
   }
-  return {};
+  if (descriptor.empty() || descriptor[0] != '(' || i + 1 >= descriptor.size()) {
+    throw std::invalid_argument("malformed method descriptor " + std::string(descriptor));
+  }
+  parsed.result = descriptor.substr(i + 1);
+  return parsed;
+}
+
+// https://docs.oracle.com/javase/specs/jvms/se8/html/jvms-4.html#jvms-4.7.4
+// Type of a local variable or an operand stack slot as the verifier sees it.
+// The second slot of a long or double is Top.
+struct VerificationType {
+  enum Tag : u1 {
+    kTop = 0,
+    kInteger = 1,
+    kFloat = 2,
+    kDouble = 3,
+    kLong = 4,
+    kNull = 5,
+    kUninitializedThis = 6,
+    kObject = 7,
+    kUninitialized = 8
+  };
+  Tag tag = kTop;
+  // Class constant of an object, or offset of the new instruction that created
+  // an uninitialized one.
+  u2 data = 0;
+
+  bool operator==(const VerificationType&) const = default;
+  bool IsWide() const { return tag == kLong || tag == kDouble; }
+  bool IsReference() const { return tag >= kNull; }
+  void Emit(std::ostream& os) const {
+    os.put(tag);
+    if (tag == kObject || tag == kUninitialized) Put2(os, data);
+  }
+};
+
+// Returns the verification type of values of the given primitive type.
+VerificationType::Tag PrimitiveTag(char type) {
+  switch (type) {
+    case 'J':
+      return VerificationType::kLong;
+    case 'F':
+      return VerificationType::kFloat;
+    case 'D':
+      return VerificationType::kDouble;
+    default:
+      return VerificationType::kInteger;
+  }
+}
+
+// Types of the local variables and of the operand stack before an instruction.
+struct FrameState {
+  std::vector<VerificationType> locals;
+  std::vector<VerificationType> stack;
+};
+
+// Returns the given slots as a stack map frame lists them: one entry for a long
+// or double, and for locals no trailing Tops.
+std::vector<VerificationType> FrameEntries(const std::vector<VerificationType>& slots, bool locals) {
+  std::vector<VerificationType> entries;
+  for (size_t i = 0; i < slots.size(); i += slots[i].IsWide() ? 2 : 1) entries.push_back(slots[i]);
+  while (locals && !entries.empty() && entries.back().tag == VerificationType::kTop) entries.pop_back();
+  return entries;
+}
+
+// Operand stack slots an instruction pops and pushes, and its length in bytes.
+struct StackEffect {
+  int pop;
+  int push;
+  size_t length;
+};
+
+// Types in the order of typed opcodes like iload, lload, ... saload.
+constexpr char kOpcodeTypes[] = "IJFDABCS";
+
+// Source and destination types of conversions, like int to long for i2l.
+constexpr char kConversions[][2] = {{'I', 'J'}, {'I', 'F'}, {'I', 'D'}, {'J', 'I'}, {'J', 'F'},
+                                    {'J', 'D'}, {'F', 'I'}, {'F', 'J'}, {'F', 'D'}, {'D', 'I'},
+                                    {'D', 'J'}, {'D', 'F'}, {'I', 'B'}, {'I', 'C'}, {'I', 'S'}};
+
+// Returns the stack effect of the given opcode if it depends on neither the
+// constant pool nor the operands, or a length of 0.
+StackEffect FixedStackEffect(u1 op) {
+  auto slots = [](int type) { return SlotCount(kOpcodeTypes[type]); };
+  if (op == _nop) return {0, 0, 1};
+  if (op >= _aconst_null && op <= _dconst_1) {
+    return {0, op == _lconst_0 || op == _lconst_1 || op >= _dconst_0 ? 2 : 1, 1};
+  }
+  if (op == _bipush || op == _ldc) return {0, 1, 2};
+  if (op == _sipush || op == _ldc_w) return {0, 1, 3};
+  if (op == _ldc2_w) return {0, 2, 3};
+  if (op >= _iload && op <= _aload) return {0, slots(op - _iload), 2};
+  if (op >= _iload_0 && op <= _aload_3) return {0, slots((op - _iload_0) / 4), 1};
+  if (op >= _iaload && op <= _saload) return {2, slots(op - _iaload), 1};
+  if (op >= _istore && op <= _astore) return {slots(op - _istore), 0, 2};
+  if (op >= _istore_0 && op <= _astore_3) return {slots((op - _istore_0) / 4), 0, 1};
+  if (op >= _iastore && op <= _sastore) return {2 + slots(op - _iastore), 0, 1};
+  switch (op) {
+    case _pop:
+      return {1, 0, 1};
+    case _pop2:
+      return {2, 0, 1};
+    case _dup:
+      return {1, 2, 1};
+    case _dup_x1:
+      return {2, 3, 1};
+    case _dup_x2:
+      return {3, 4, 1};
+    case _dup2:
+      return {2, 4, 1};
+    case _dup2_x1:
+      return {3, 5, 1};
+    case _dup2_x2:
+      return {4, 6, 1};
+    case _swap:
+      return {2, 2, 1};
+  }
+  if (op >= _iadd && op <= _drem) return {2 * slots((op - _iadd) % 4), slots((op - _iadd) % 4), 1};
+  if (op >= _ineg && op <= _dneg) return {slots(op - _ineg), slots(op - _ineg), 1};
+  if (op >= _ishl && op <= _lushr) return {1 + slots((op - _ishl) % 2), slots((op - _ishl) % 2), 1};
+  if (op >= _iand && op <= _lxor) return {2 * slots((op - _iand) % 2), slots((op - _iand) % 2), 1};
+  if (op == _iinc) return {0, 0, 3};
+  if (op >= _i2l && op <= _i2s) return {SlotCount(kConversions[op - _i2l][0]), SlotCount(kConversions[op - _i2l][1]), 1};
+  if (op == _lcmp || op == _dcmpl || op == _dcmpg) return {4, 1, 1};
+  if (op == _fcmpl || op == _fcmpg) return {2, 1, 1};
+  if ((op >= _ifeq && op <= _ifle) || op == _ifnull || op == _ifnonnull) return {1, 0, 3};
+  if (op >= _if_icmpeq && op <= _if_acmpne) return {2, 0, 3};
+  if (op == _goto) return {0, 0, 3};
+  if (op == _goto_w) return {0, 0, 5};
+  if (op >= _ireturn && op <= _areturn) return {op == _lreturn || op == _dreturn ? 2 : 1, 0, 1};
+  switch (op) {
+    case _return:
+      return {0, 0, 1};
+    case _new:
+      return {0, 1, 3};
+    case _newarray:
+      return {1, 1, 2};
+    case _anewarray:
+    case _checkcast:
+    case _instanceof:
+      return {1, 1, 3};
+    case _arraylength:
+      return {1, 1, 1};
+    case _athrow:
+    case _monitorenter:
+    case _monitorexit:
+      return {1, 0, 1};
+  }
+  return {0, 0, 0};
 }
 
+// Returns the type of the value the given opcode pushes if it follows from the
+// opcode alone, or Top.
+VerificationType::Tag FixedResult(u1 op) {
+  if (op == _aconst_null) return VerificationType::kNull;
+  if (op >= _iconst_m1 && op <= _iconst_5) return VerificationType::kInteger;
+  if (op == _lconst_0 || op == _lconst_1) return VerificationType::kLong;
+  if (op >= _fconst_0 && op <= _fconst_2) return VerificationType::kFloat;
+  if (op == _dconst_0 || op == _dconst_1) return VerificationType::kDouble;
+  if (op == _bipush || op == _sipush) return VerificationType::kInteger;
+  if (op >= _iaload && op <= _saload && op != _aaload) return PrimitiveTag(kOpcodeTypes[op - _iaload]);
+  if (op >= _iadd && op <= _drem) return PrimitiveTag(kOpcodeTypes[(op - _iadd) % 4]);
+  if (op >= _ineg && op <= _dneg) return PrimitiveTag(kOpcodeTypes[op - _ineg]);
+  if (op >= _ishl && op <= _lxor) return PrimitiveTag(kOpcodeTypes[(op - _ishl) % 2]);
+  if (op >= _i2l && op <= _i2s) return PrimitiveTag(kConversions[op - _i2l][1]);
+  if (op >= _lcmp && op <= _dcmpg) return VerificationType::kInteger;
+  if (op == _arraylength || op == _instanceof) return VerificationType::kInteger;
+  return VerificationType::kTop;
+}
+
+struct FieldRefConstant : Ref, Field {
+  Tag tag() const override { return kFieldref; }
+  void Load(std::ostream& os) const override {
+    os.put(char(Instruction::_getstatic));
+    Put2(os, index);
+  }
+  void Store(std::ostream& os) const override {
+    os.put(char(Instruction::_putstatic));
+    Put2(os, index);
+  }
+};
+
+// Field of objects, accessed with getfield and putfield.
+struct InstanceField : Field {
+  explicit InstanceField(u2 field_ref_index) : field_ref_index(field_ref_index) {}
+  u2 field_ref_index;
+  void Load(std::ostream& os) const override {
+    os.put(char(Instruction::_getfield));
+    Put2(os, field_ref_index);
+  }
+  void Store(std::ostream& os) const override {
+    os.put(char(Instruction::_putfield));
+    Put2(os, field_ref_index);
+  }
+};
+
+// Creation of an object with new and its constructor taking no arguments.
+struct NewObject : Pushable {
+  NewObject(u2 class_index, u2 constructor_index) : class_index(class_index), constructor_index(constructor_index) {}
+  u2 class_index;
+  u2 constructor_index;
+  void Push(std::ostream& os) const override {
+    os.put(char(Instruction::_new));
+    Put2(os, class_index);
+    os.put(Instruction::_dup);
+    os.put(char(Instruction::_invokespecial));
+    Put2(os, constructor_index);
+  }
+};
+
+// Invocation of an instance method with invokevirtual.
+struct VirtualInvocation : Invocable {
+  explicit VirtualInvocation(u2 method_ref_index) : method_ref_index(method_ref_index) {}
+  u2 method_ref_index;
+  void Invoke(std::ostream& os) const override {
+    os.put(char(Instruction::_invokevirtual));
+    Put2(os, method_ref_index);
+  }
+};
+
+// https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.5
+struct FieldInfo {
+  u2 access_flags;
+  u2 name_index;
+  u2 descriptor_index;
+  void Emit(ByteBuffer& buffer) const {
+    buffer.Put2(access_flags);
+    buffer.Put2(name_index);
+    buffer.Put2(descriptor_index);
+    buffer.Put2(0);  // attributes count
+  }
+};
+
+// Method of class Std implementing a library function of Tiger.
+struct LibraryMethod {
+  std::string_view name;
+  std::string_view type;
+};
+
+const std::unordered_map<std::string_view, LibraryMethod> kMethodByLibraryFunctionName = {
+    {"print", {"print", "(Ljava/lang/String;)V"}},
+    {"printi", {"printi", "(I)V"}},
+    {"flush", {"flush", "()V"}},
+    {"getchar", {"getChar", "()Ljava/lang/String;"}},
+    {"ord", {"ord", "(Ljava/lang/String;)I"}},
+    {"chr", {"chr", "(I)Ljava/lang/String;"}},
+    {"size", {"size", "(Ljava/lang/String;)I"}},
+    {"substring", {"substring", "(Ljava/lang/String;II)Ljava/lang/String;"}},
+    {"concat", {"concat", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;"}},
+    {"not", {"not", "(I)I"}},
+    {"exit", {"exit", "(I)V"}}};
+
 struct JvmProgram : Program {
-  JvmProgram() = default;
+  // Makes the first class of a program, or a class of the program of the given
+  // one.
+  explicit JvmProgram(std::string_view class_name, JvmProgram* program = nullptr)
+      : class_name(class_name), program(program ? program : this) {}
   ~JvmProgram() override = default;
 
+  std::string_view Name() const override { return class_name; }
+
+  Program& DefineClass(std::string_view name) override {
+    auto named = [&](const auto& c) { return c->class_name == name; };
+    if (name == program->class_name || std::any_of(program->classes.begin(), program->classes.end(), named)) {
+      throw std::invalid_argument("class " + std::string(name) + " is defined");
+    }
+    return *program->classes.emplace_back(std::make_unique<JvmProgram>(name, program));
+  }
+
+  std::vector<Program*> Classes() override {
+    std::vector<Program*> result;
+    for (const auto& c : program->classes) result.push_back(c.get());
+    return result;
+  }
+
   const Pushable& DefineStringConstant(std::string_view text) override { return stringConstant(text); }
-  const Pushable& DefineIntegerConstant(int i) override { return integerConstant(i); }
+  const Pushable& DefineIntegerConstant(int i) override {
+    if (i < INT16_MIN || i > INT16_MAX) return integerConstant(i);
+    auto& pushable = short_integers[i];
+    if (!pushable) pushable = std::make_unique<ShortInteger>(i);
+    return *pushable;
+  }
 
   const Invocable* LookupLibraryFunction(std::string_view name) override {
-    if (auto found = LibraryFunctionType(name); found) {
-      return &methodRefConstant("Std", name, *found);
+    if (auto found = kMethodByLibraryFunctionName.find(name); found != kMethodByLibraryFunctionName.end()) {
+      return &methodRefConstant("Std", found->second.name, found->second.type);
     }
     return nullptr;
   }
 
+  const Invocable& LookupMethod(std::string_view class_name, std::string_view name, std::string_view descriptor,
+                                Dispatch dispatch) override {
+    MethodRefConstant& method = methodRefConstant(class_name, name, descriptor);
+    if (dispatch == Dispatch::kStatic) return method;
+    auto& invocation = virtual_by_method_ref[method.index];
+    if (!invocation) invocation = std::make_unique<VirtualInvocation>(method.index);
+    return *invocation;
+  }
+
+  const Field& DefineStaticField(std::string_view name, std::string_view descriptor) override {
+    AddField(ACC_STATIC, name, descriptor);
+    return fieldRefConstant(class_name, name, descriptor);
+  }
+
+  const Field& DefineField(std::string_view name, std::string_view descriptor) override {
+    AddField(0, name, descriptor);
+    return LookupField(class_name, name, descriptor, Dispatch::kVirtual);
+  }
+
+  const Field& LookupField(std::string_view class_name, std::string_view name, std::string_view descriptor,
+                           Dispatch dispatch) override {
+    FieldRefConstant& field = fieldRefConstant(class_name, name, descriptor);
+    if (dispatch == Dispatch::kStatic) return field;
+    auto& instance_field = instance_by_field_ref[field.index];
+    if (!instance_field) instance_field = std::make_unique<InstanceField>(field.index);
+    return *instance_field;
+  }
+
+  const Pushable& LookupConstructor(std::string_view class_name) override {
+    u2 class_index = classConstant(class_name).index;
+    auto& constructor = new_by_class[class_index];
+    if (!constructor) {
+      constructor = std::make_unique<NewObject>(class_index, methodRefConstant(class_name, "<init>", "()V").index);
+    }
+    return *constructor;
+  }
+
+  void AddField(u2 flags, std::string_view name, std::string_view descriptor) {
+    u2 name_index = utf8Constant(name).index;
+    for (const FieldInfo& field : fields) {
+      if (field.name_index == name_index) throw std::invalid_argument("field " + std::string(name) + " is defined");
+    }
+    fields.push_back({flags, name_index, utf8Constant(descriptor).index});
+  }
+
+  uint16_t DefineClassConstant(std::string_view class_name) override { return classConstant(class_name).index; }
+
   void DefineFunction(u2 flags, std::string_view name, std::string_view descriptor,
                       std::string_view code_bytes) override {
+    CodeAnalysis analysis = AnalyzeCode(flags, name, descriptor, code_bytes);
     methods.push_back(methodInfo(flags, name, descriptor));
-    methods.rbegin()->attributes.emplace_back(std::make_unique<CodeAttribute>(utf8Constant("Code").index, code_bytes));
+    auto code = std::make_unique<CodeAttribute>(utf8Constant("Code").index, analysis.max_stack, analysis.max_locals,
+                                                code_bytes);
+    if (analysis.frame_count > 0) {
+      code->attributes.emplace_back(std::make_unique<StackMapTableAttribute>(
+          utf8Constant("StackMapTable").index, analysis.frame_count, std::move(analysis.frames)));
+    }
+    methods.rbegin()->attributes.emplace_back(std::move(code));
+  };
+
+  // Returns the constant with the given index. Throws std::invalid_argument if
+  // there is none or it has another tag.
+  const Constant& ConstantAt(u2 index, std::initializer_list<Constant::Tag> tags) const {
+    if (index > 0 && index <= constant_pool.size()) {
+      const Constant& c = *constant_pool[index - 1];
+      if (std::find(tags.begin(), tags.end(), c.tag()) != tags.end()) return c;
+    }
+    throw std::invalid_argument("constant " + std::to_string(index) + " has an unexpected tag");
+  }
+
+  std::string_view Text(u2 utf8_index) const {
+    return static_cast<const Utf8Constant&>(ConstantAt(utf8_index, {Constant::kUtf8})).text;
+  }
+
+  std::string_view ClassName(u2 class_index) const {
+    return Text(static_cast<const ClassConstant&>(ConstantAt(class_index, {Constant::kClass})).name_index);
+  }
+
+  // Returns the name and descriptor of the field or method that the constant
+  // with the given index refers to.
+  std::pair<std::string_view, std::string_view> RefNameAndType(u2 index) const {
+    const auto& ref = static_cast<const Ref&>(
+        ConstantAt(index, {Constant::kFieldref, Constant::kMethodref, Constant::kInterfaceMethodref}));
+    const auto& name_and_type = static_cast<const NameAndTypeConstant&>(*constant_pool[ref.name_and_type_index - 1]);
+    return {Text(name_and_type.name_index), Text(name_and_type.descriptor_index)};
+  }
+
+  VerificationType ObjectType(std::string_view class_name) {
+    return {VerificationType::kObject, classConstant(class_name).index};
+  }
+
+  // Returns the verification type of values of the given field descriptor.
+  VerificationType FieldType(std::string_view descriptor) {
+    if (descriptor[0] == 'L') return ObjectType(descriptor.substr(1, descriptor.size() - 2));
+    if (descriptor[0] == '[') return ObjectType(descriptor);
+    return {PrimitiveTag(descriptor[0])};
+  }
+
+  // Returns the type of a value that is of either given type, or nothing if
+  // there is none.
+  std::optional<VerificationType> Merge(VerificationType a, VerificationType b) {
+    if (a == b) return a;
+    if (a.tag == VerificationType::kNull && b.tag == VerificationType::kObject) return b;
+    if (a.tag == VerificationType::kObject && b.tag == VerificationType::kNull) return a;
+    if (a.tag == VerificationType::kObject && b.tag == VerificationType::kObject) return ObjectType("java/lang/Object");
+    return {};
+  }
+
+  // Frame size and stack map frames of the code of a method.
+  struct CodeAnalysis {
+    u2 max_stack;
+    u2 max_locals;
+    u2 frame_count;
+    // StackMapTable entries.
+    std::string frames;
   };
 
+  // Analyzes the code of the given method. Follows all paths through the code,
+  // tracking the types of the locals and the stack before each instruction, and
+  // merging them where paths meet. Throws std::invalid_argument if the stacks
+  // of paths reaching an instruction differ in height or types, some code is
+  // unreachable, or the code is malformed otherwise.
+  CodeAnalysis AnalyzeCode(u2 flags, std::string_view name, std::string_view descriptor, std::string_view code) {
+    auto fail = [&](size_t offset, const std::string& what) {
+      throw std::invalid_argument("method " + std::string(name) + " at " + std::to_string(offset) + ": " + what);
+    };
+    auto byte = [&](size_t i) -> u1 {
+      if (i >= code.size()) fail(i, "truncated instruction");
+      return static_cast<u1>(code[i]);
+    };
+    auto u2_at = [&](size_t i) { return static_cast<u2>(byte(i) << 8 | byte(i + 1)); };
+    auto s4 = [&](size_t i) {
+      return static_cast<int32_t>(u4{byte(i)} << 24 | u4{byte(i + 1)} << 16 | u4{byte(i + 2)} << 8 | byte(i + 3));
+    };
+    if (code.size() > 0xffff) {
+      throw std::length_error("method " + std::string(name) + " has " + std::to_string(code.size()) +
+                              " bytes of code, more than 65535");
+    }
+
+    FrameState initial;
+    if (!(flags & ACC_STATIC)) {
+      initial.locals.push_back(name == "<init>" ? VerificationType{VerificationType::kUninitializedThis}
+                                                : ObjectType(class_name));
+    }
+    for (std::string_view parameter : ParseMethodDescriptor(descriptor).parameters) {
+      initial.locals.push_back(FieldType(parameter));
+      if (initial.locals.back().IsWide()) initial.locals.emplace_back();
+    }
+    size_t max_locals = initial.locals.size();
+    size_t max_stack = 0;
+    // Types before each instruction, where one starts.
+    std::vector<std::optional<FrameState>> frames(code.size());
+    std::vector<size_t> lengths(code.size());
+    // Offsets of instruction operands, which no jump may go to, and of jump
+    // targets, which need stack map frames.
+    std::vector<bool> operands(code.size());
+    std::vector<bool> targets(code.size());
+    std::vector<size_t> pending;
+    auto flow = [&](size_t from, size_t to, const FrameState& state) {
+      if (to >= code.size()) fail(from, "no instruction at " + std::to_string(to));
+      if (operands[to]) fail(from, "jump into an instruction at " + std::to_string(to));
+      std::optional<FrameState>& frame = frames[to];
+      if (!frame) {
+        frame = state;
+        pending.push_back(to);
+        return;
+      }
+      if (frame->stack.size() != state.stack.size()) {
+        fail(to, "stack height " + std::to_string(state.stack.size()) + " differs from " +
+                     std::to_string(frame->stack.size()));
+      }
+      bool changed = false;
+      for (size_t i = 0; i < state.stack.size(); ++i) {
+        std::optional<VerificationType> merged = Merge(frame->stack[i], state.stack[i]);
+        if (!merged) fail(to, "stack types differ at " + std::to_string(i));
+        changed |= *merged != frame->stack[i];
+        frame->stack[i] = *merged;
+      }
+      if (state.locals.size() < frame->locals.size()) {
+        frame->locals.resize(state.locals.size());
+        changed = true;
+      }
+      for (size_t i = 0; i < frame->locals.size(); ++i) {
+        VerificationType merged = Merge(frame->locals[i], state.locals[i]).value_or(VerificationType{});
+        changed |= merged != frame->locals[i];
+        frame->locals[i] = merged;
+      }
+      if (changed) pending.push_back(to);
+    };
+
+    frames[0] = initial;
+    pending.push_back(0);
+    while (!pending.empty()) {
+      size_t offset = pending.back();
+      pending.pop_back();
+      FrameState state = *frames[offset];
+      auto pop = [&](int slots) {
+        if (static_cast<size_t>(slots) > state.stack.size()) fail(offset, "stack underflow");
+        VerificationType value = slots > 0 ? state.stack[state.stack.size() - slots] : VerificationType{};
+        state.stack.resize(state.stack.size() - slots);
+        return value;
+      };
+      auto push = [&](VerificationType value) {
+        state.stack.push_back(value);
+        if (value.IsWide()) state.stack.emplace_back();
+        max_stack = std::max(max_stack, state.stack.size());
+      };
+      auto load = [&](size_t slot) {
+        if (slot >= state.locals.size() || state.locals[slot].tag == VerificationType::kTop) {
+          fail(offset, "local " + std::to_string(slot) + " is not set");
+        }
+        return state.locals[slot];
+      };
+      auto store = [&](size_t slot, VerificationType value) {
+        size_t end = slot + (value.IsWide() ? 2 : 1);
+        if (state.locals.size() < end) state.locals.resize(end);
+        if (slot > 0 && state.locals[slot - 1].IsWide()) state.locals[slot - 1] = {};
+        state.locals[slot] = value;
+        if (value.IsWide()) state.locals[slot + 1] = {};
+        max_locals = std::max(max_locals, end);
+      };
+      // Replaces the given uninitialized type by that of the initialized object.
+      auto initialize = [&](VerificationType object) {
+        VerificationType initialized = object.tag == VerificationType::kUninitializedThis
+                                           ? ObjectType(class_name)
+                                           : VerificationType{VerificationType::kObject, u2_at(object.data + 1)};
+        std::replace(state.locals.begin(), state.locals.end(), object, initialized);
+        std::replace(state.stack.begin(), state.stack.end(), object, initialized);
+      };
+
+      u1 op = byte(offset);
+      StackEffect effect = FixedStackEffect(op);
+      VerificationType::Tag result = FixedResult(op);
+      // Load, store and iinc instructions with their local, wide or not.
+      u1 local_op = op;
+      size_t slot = 0;
+      if (op == _wide) {
+        local_op = byte(offset + 1);
+        slot = u2_at(offset + 2);
+        if (local_op != _iinc && !(local_op >= _iload && local_op <= _aload) &&
+            !(local_op >= _istore && local_op <= _astore)) {
+          fail(offset, "wide " + std::to_string(local_op));
+        }
+        effect = FixedStackEffect(local_op);
+        effect.length = local_op == _iinc ? 6 : 4;
+      } else if ((op >= _iload && op <= _aload) || (op >= _istore && op <= _astore) || op == _iinc) {
+        slot = byte(offset + 1);
+      } else if (op >= _iload_0 && op <= _aload_3) {
+        local_op = _iload + (op - _iload_0) / 4;
+        slot = (op - _iload_0) % 4;
+      } else if (op >= _istore_0 && op <= _astore_3) {
+        local_op = _istore + (op - _istore_0) / 4;
+        slot = (op - _istore_0) % 4;
+      }
+      std::vector<size_t> jumps;
+      bool falls_through = true;
+
+      if (effect.length == 0 && op != _tableswitch && op != _lookupswitch && !(op >= _getstatic && op <= _invokeinterface) &&
+          op != _multianewarray) {
+        fail(offset, "unsupported instruction " + std::to_string(op));
+      }
+      if (local_op >= _iload && local_op <= _aload) {
+        VerificationType value = load(slot);
+        if (local_op == _aload ? !value.IsReference() : value.tag != PrimitiveTag(kOpcodeTypes[local_op - _iload])) {
+          fail(offset, "local " + std::to_string(slot) + " has another type");
+        }
+        push(value);
+      } else if (local_op >= _istore && local_op <= _astore) {
+        VerificationType value = pop(effect.pop);
+        if (local_op == _astore ? !value.IsReference() : value.tag != PrimitiveTag(kOpcodeTypes[local_op - _istore])) {
+          fail(offset, "stored value has another type");
+        }
+        store(slot, value);
+      } else if (local_op == _iinc) {
+        if (load(slot).tag != VerificationType::kInteger) fail(offset, "local " + std::to_string(slot) + " is no int");
+      } else if (op == _ldc || op == _ldc_w || op == _ldc2_w) {
+        u2 index = op == _ldc ? byte(offset + 1) : u2_at(offset + 1);
+        switch (ConstantAt(index, {Constant::kInteger, Constant::kFloat, Constant::kLong, Constant::kDouble,
+                                   Constant::kString, Constant::kClass})
+                    .tag()) {
+          case Constant::kInteger:
+            push({VerificationType::kInteger});
+            break;
+          case Constant::kFloat:
+            push({VerificationType::kFloat});
+            break;
+          case Constant::kLong:
+            push({VerificationType::kLong});
+            break;
+          case Constant::kDouble:
+            push({VerificationType::kDouble});
+            break;
+          case Constant::kString:
+            push(ObjectType("java/lang/String"));
+            break;
+          default:
+            push(ObjectType("java/lang/Class"));
+        }
+      } else if (op == _aaload) {
+        pop(1);
+        VerificationType array = pop(1);
+        if (array.tag == VerificationType::kNull) {
+          push(array);
+        } else if (array.tag != VerificationType::kObject || ClassName(array.data)[0] != '[') {
+          fail(offset, "aaload from no array");
+        } else {
+          push(FieldType(ClassName(array.data).substr(1)));
+        }
+      } else if (op >= _dup && op <= _dup2_x2) {
+        // Copies the top one or two slots below the top two to four.
+        size_t copied = op >= _dup2 ? 2 : 1;
+        size_t below = copied + (op - (op >= _dup2 ? _dup2 : _dup));
+        if (below > state.stack.size()) fail(offset, "stack underflow");
+        std::vector<VerificationType> top(state.stack.end() - copied, state.stack.end());
+        state.stack.insert(state.stack.end() - below, top.begin(), top.end());
+        max_stack = std::max(max_stack, state.stack.size());
+      } else if (op == _swap) {
+        if (state.stack.size() < 2) fail(offset, "stack underflow");
+        std::swap(state.stack[state.stack.size() - 1], state.stack[state.stack.size() - 2]);
+      } else if ((op >= _ifeq && op <= _if_acmpne) || op == _ifnull || op == _ifnonnull || op == _goto ||
+                 op == _goto_w) {
+        pop(effect.pop);
+        jumps.push_back(offset + (op == _goto_w ? s4(offset + 1) : static_cast<int16_t>(u2_at(offset + 1))));
+        falls_through = op != _goto && op != _goto_w;
+      } else if (op == _tableswitch || op == _lookupswitch) {
+        size_t operand = offset + 1 + (3 - offset % 4);
+        pop(1);
+        jumps.push_back(offset + s4(operand));
+        if (op == _tableswitch) {
+          int64_t count = int64_t{s4(operand + 8)} - s4(operand + 4) + 1;
+          if (count < 0) fail(offset, "tableswitch with negative range");
+          for (int64_t i = 0; i < count; ++i) jumps.push_back(offset + s4(operand + 12 + 4 * i));
+          effect.length = operand + 12 + 4 * count - offset;
+        } else {
+          int32_t count = s4(operand + 4);
+          if (count < 0) fail(offset, "lookupswitch with negative count");
+          for (int32_t i = 0; i < count; ++i) jumps.push_back(offset + s4(operand + 12 + 8 * i));
+          effect.length = operand + 8 + 8 * count - offset;
+        }
+        falls_through = false;
+      } else if ((op >= _ireturn && op <= _return) || op == _athrow) {
+        pop(effect.pop);
+        falls_through = false;
+      } else if (op >= _getstatic && op <= _putfield) {
+        std::string_view type = RefNameAndType(u2_at(offset + 1)).second;
+        if (op == _putstatic || op == _putfield) pop(SlotCount(type[0]));
+        if (op == _getfield || op == _putfield) pop(1);
+        if (op == _getstatic || op == _getfield) push(FieldType(type));
+        effect.length = 3;
+      } else if (op >= _invokevirtual && op <= _invokeinterface) {
+        auto [method_name, type] = RefNameAndType(u2_at(offset + 1));
+        MethodDescriptor method = ParseMethodDescriptor(type);
+        for (auto parameter = method.parameters.rbegin(); parameter != method.parameters.rend(); ++parameter) {
+          pop(SlotCount((*parameter)[0]));
+        }
+        if (op != _invokestatic) {
+          VerificationType receiver = pop(1);
+          if (op == _invokespecial && method_name == "<init>") {
+            if (receiver.tag != VerificationType::kUninitialized &&
+                receiver.tag != VerificationType::kUninitializedThis) {
+              fail(offset, "initializing an initialized object");
+            }
+            initialize(receiver);
+          }
+        }
+        if (method.result != "V") push(FieldType(method.result));
+        effect.length = op == _invokeinterface ? 5 : 3;
+      } else if (op == _new) {
+        push({VerificationType::kUninitialized, static_cast<u2>(offset)});
+      } else if (op == _newarray) {
+        static constexpr std::string_view kArrayTypes = "ZCFDBSIJ";
+        u1 atype = byte(offset + 1);
+        if (atype < 4 || atype > 11) fail(offset, "newarray of type " + std::to_string(atype));
+        pop(1);
+        push(ObjectType("[" + std::string(1, kArrayTypes[atype - 4])));
+      } else if (op == _anewarray) {
+        std::string_view element = ClassName(u2_at(offset + 1));
+        pop(1);
+        push(ObjectType(element[0] == '[' ? "[" + std::string(element) : "[L" + std::string(element) + ";"));
+      } else if (op == _multianewarray) {
+        u2 index = u2_at(offset + 1);
+        ClassName(index);
+        pop(byte(offset + 3));
+        push({VerificationType::kObject, index});
+        effect.length = 4;
+      } else if (op == _checkcast) {
+        u2 index = u2_at(offset + 1);
+        ClassName(index);
+        pop(1);
+        push({VerificationType::kObject, index});
+      } else if (effect.push == 0 || result != VerificationType::kTop) {
+        pop(effect.pop);
+        if (effect.push > 0) push({result});
+      } else {
+        fail(offset, "unsupported instruction " + std::to_string(op));
+      }
+
+      lengths[offset] = effect.length;
+      for (size_t i = offset + 1; i < offset + effect.length && i < code.size(); ++i) {
+        if (frames[i]) fail(i, "jump into an instruction");
+        operands[i] = true;
+      }
+      for (size_t to : jumps) {
+        flow(offset, to, state);
+        targets[to] = true;
+      }
+      if (falls_through) flow(offset, offset + effect.length, state);
+    }
+    if (max_stack > 0xffff || max_locals > 0xffff) fail(0, "frame too large");
+    for (size_t offset = 0; offset < code.size(); offset += lengths[offset]) {
+      if (!frames[offset]) fail(offset, "unreachable code");
+    }
+
+    // https://docs.oracle.com/javase/specs/jvms/se8/html/jvms-4.html#jvms-4.7.4
+    // Each frame is encoded by its offset delta and its difference to the
+    // previous frame, in the shortest form that applies.
+    std::ostringstream os;
+    u2 frame_count = 0;
+    std::vector<VerificationType> previous = FrameEntries(initial.locals, true);
+    std::optional<size_t> previous_offset;
+    for (size_t offset = 0; offset < code.size(); ++offset) {
+      if (!targets[offset]) continue;
+      std::vector<VerificationType> locals = FrameEntries(frames[offset]->locals, true);
+      std::vector<VerificationType> stack = FrameEntries(frames[offset]->stack, false);
+      u2 delta = previous_offset ? offset - *previous_offset - 1 : offset;
+      size_t common = std::min(locals.size(), previous.size());
+      bool extends = std::equal(locals.begin(), locals.begin() + common, previous.begin());
+      if (stack.empty() && locals == previous) {
+        if (delta < 64) {
+          os.put(delta);  // same_frame
+        } else {
+          os.put(char(251));  // same_frame_extended
+          Put2(os, delta);
+        }
+      } else if (stack.size() == 1 && locals == previous) {
+        if (delta < 64) {
+          os.put(64 + delta);  // same_locals_1_stack_item_frame
+        } else {
+          os.put(char(247));  // same_locals_1_stack_item_frame_extended
+          Put2(os, delta);
+        }
+        stack[0].Emit(os);
+      } else if (stack.empty() && extends && locals.size() < previous.size() && previous.size() - locals.size() <= 3) {
+        os.put(251 - (previous.size() - locals.size()));  // chop_frame
+        Put2(os, delta);
+      } else if (stack.empty() && extends && locals.size() > previous.size() && locals.size() - previous.size() <= 3) {
+        os.put(251 + (locals.size() - previous.size()));  // append_frame
+        Put2(os, delta);
+        for (size_t i = previous.size(); i < locals.size(); ++i) locals[i].Emit(os);
+      } else {
+        os.put(char(255));  // full_frame
+        Put2(os, delta);
+        Put2(os, locals.size());
+        for (const VerificationType& local : locals) local.Emit(os);
+        Put2(os, stack.size());
+        for (const VerificationType& item : stack) item.Emit(os);
+      }
+      previous = std::move(locals);
+      previous_offset = offset;
+      ++frame_count;
+    }
+    return {static_cast<u2>(max_stack), static_cast<u2>(max_locals), frame_count, os.str()};
+  }
+
   void DefineConstructor() {
     std::ostringstream os;
     os.put(Instruction::_aload_0);
@@ -306,116 +1098,171 @@ struct JvmProgram : Program {
   }
 
   void Emit(std::ostream& os) override {
-    DefineConstructor();
-    u2 this_class = classConstant("Main").index;
+    if (!has_constructor) DefineConstructor();
+    has_constructor = true;
+    u2 this_class = classConstant(class_name).index;
     u2 super_class = classConstant("java/lang/Object").index;
 
-    Put4(os, 0xcafebabe);
-    Put2(os, 0);   // minor version
-    Put2(os, 50);  // major version
-    Put2(os, static_cast<u2>(constant_pool.size() + 1));
-    for (const auto& c : constant_pool) c->Emit(os);
-    Put2(os, 0x20);  // flags
-    Put2(os, this_class);
-    Put2(os, super_class);
-    Put2(os, 0);  // interfaces count
-    Put2(os, 0);  // field count
-    Put2(os, static_cast<u2>(methods.size()));
-    for (const auto& m : methods) m.Emit(os);
-    Put2(os, 0);  // attributes count
+    size_t capacity = 24 + 8 * fields.size();
+    for (const auto& c : constant_pool) capacity += c->Size();
+    for (const auto& m : methods) capacity += m.Size();
+    ByteBuffer buffer(capacity);
+    buffer.Put4(0xcafebabe);
+    buffer.Put2(0);   // minor version
+    buffer.Put2(52);  // major version
+    buffer.Put2(static_cast<u2>(constant_pool.size() + 1));
+    for (const auto& c : constant_pool) c->Emit(buffer);
+    buffer.Put2(0x20);  // flags
+    buffer.Put2(this_class);
+    buffer.Put2(super_class);
+    buffer.Put2(0);  // interfaces count
+    buffer.Put2(static_cast<u2>(fields.size()));
+    for (const auto& f : fields) f.Emit(buffer);
+    buffer.Put2(static_cast<u2>(methods.size()));
+    for (const auto& m : methods) m.Emit(buffer);
+    buffer.Put2(0);  // attributes count
+    os.write(buffer.bytes().data(), buffer.size());
   }
 
   template <class T>
   T& Adopt(std::unique_ptr<T> t) {
+    // The constant pool count is a u2 one larger than the number of entries.
+    if (constant_pool.size() >= kMaxConstants) {
+      throw std::length_error("constant pool exceeds " + std::to_string(kMaxConstants) + " entries");
+    }
     t->index = 1 + constant_pool.size();
     T* raw_ptr = t.get();
     constant_pool.emplace_back(std::move(t));
     return *raw_ptr;
   }
 
+  // Returns the constant with the given key in the given index, adding the
+  // one made by the given function if there is none.
+  template <class T, class Key, class Make>
+  T& Intern(std::unordered_map<Key, T*>& index, Key key, Make make) {
+    if (auto found = index.find(key); found != index.end()) return *found->second;
+    T& result = Adopt(make());
+    index.emplace(key, &result);
+    return result;
+  }
+
+  // Key of constants made of two indexes.
+  static u4 Pair(u2 first, u2 second) { return u4{first} << 16 | second; }
+
   Utf8Constant& utf8Constant(std::string_view text) {
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kUtf8 && c->Matches(text)) {
-        return **c->utf8();
-      }
+    if (auto found = utf8_by_text.find(text); found != utf8_by_text.end()) return *found->second;
+    if (text.length() > 0xffff) {
+      throw std::length_error("constant of " + std::to_string(text.length()) + " bytes exceeds 65535");
     }
     auto result = std::make_unique<Utf8Constant>();
-    result->text = text;
-    return Adopt(std::move(result));
+    result->text = *program->texts.emplace(text).first;
+    Utf8Constant& adopted = Adopt(std::move(result));
+    // Keys view the text of the constant, which never moves.
+    utf8_by_text.emplace(adopted.text, &adopted);
+    return adopted;
   }
 
   StringConstant& stringConstant(std::string_view text) {
     u2 utf8_index = utf8Constant(text).index;
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kString && c->Matches(utf8_index)) {
-        return **c->string();
-      }
-    }
-    auto result = std::make_unique<StringConstant>();
-    result->string_index = utf8_index;
-    return Adopt(std::move(result));
+    return Intern(string_by_utf8, utf8_index, [&] {
+      auto result = std::make_unique<StringConstant>();
+      result->string_index = utf8_index;
+      return result;
+    });
   }
 
   IntegerConstant& integerConstant(int i) {
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kInteger && c->Matches(i)) {
-        return **c->integer();
-      }
-    }
-    auto result = std::make_unique<IntegerConstant>();
-    result->bytes = i;
-    return Adopt(std::move(result));
+    return Intern(integer_by_value, i, [&] {
+      auto result = std::make_unique<IntegerConstant>();
+      result->bytes = i;
+      return result;
+    });
   }
 
   ClassConstant& classConstant(std::string_view class_name) {
     u2 name_index = utf8Constant(class_name).index;
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kClass && c->Matches(name_index)) {
-        return **c->clazz();
-      }
-    }
-    auto result = std::make_unique<ClassConstant>();
-    result->name_index = name_index;
-    return Adopt(std::move(result));
+    return Intern(class_by_name, name_index, [&] {
+      auto result = std::make_unique<ClassConstant>();
+      result->name_index = name_index;
+      return result;
+    });
   }
 
   NameAndTypeConstant& nameAndTypeConstant(std::string_view name, std::string_view descriptor) {
     u2 name_index = utf8Constant(name).index;
     u2 descriptor_index = utf8Constant(descriptor).index;
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kNameAndType && c->Matches(name_index, descriptor_index)) {
-        return **c->nameAndType();
-      }
-    }
-    auto result = std::make_unique<NameAndTypeConstant>();
-    result->name_index = name_index;
-    result->descriptor_index = descriptor_index;
-    return Adopt(std::move(result));
+    return Intern(name_and_type_by_indexes, Pair(name_index, descriptor_index), [&] {
+      auto result = std::make_unique<NameAndTypeConstant>();
+      result->name_index = name_index;
+      result->descriptor_index = descriptor_index;
+      return result;
+    });
+  }
+
+  FieldRefConstant& fieldRefConstant(std::string_view class_name, std::string_view name, std::string_view type) {
+    u2 class_index = classConstant(class_name).index;
+    u2 name_and_type_index = nameAndTypeConstant(name, type).index;
+    return Intern(field_ref_by_indexes, Pair(class_index, name_and_type_index), [&] {
+      auto result = std::make_unique<FieldRefConstant>();
+      result->class_index = class_index;
+      result->name_and_type_index = name_and_type_index;
+      return result;
+    });
   }
 
   MethodRefConstant& methodRefConstant(std::string_view class_name, std::string_view name, std::string_view type) {
     u2 class_index = classConstant(class_name).index;
     u2 name_and_type_index = nameAndTypeConstant(name, type).index;
-    for (auto& c : constant_pool) {
-      if (c->tag() == ClassConstant::kMethodref && c->Matches(class_index, name_and_type_index)) {
-        return **c->methodRef();
-      }
-    }
-    auto result = std::make_unique<MethodRefConstant>();
-    result->class_index = class_index;
-    result->name_and_type_index = name_and_type_index;
-    return Adopt(std::move(result));
+    return Intern(method_ref_by_indexes, Pair(class_index, name_and_type_index), [&] {
+      auto result = std::make_unique<MethodRefConstant>();
+      result->class_index = class_index;
+      result->name_and_type_index = name_and_type_index;
+      return result;
+    });
   }
 
   MethodInfo methodInfo(u2 flags, std::string_view name, std::string_view descriptor) {
     return {flags, utf8Constant(name).index, utf8Constant(descriptor).index, {}};
   }
 
+  static constexpr size_t kMaxConstants = 0xfffe;
+
+  // Name of the class, like "Main".
+  std::string class_name;
+  // First class of the program, which keeps the other classes and the text of
+  // the UTF-8 constants of all of them.
+  JvmProgram* program;
+  std::vector<std::unique_ptr<JvmProgram>> classes;
+  std::unordered_set<std::string> texts;
+  bool has_constructor = false;
+
   std::vector<std::unique_ptr<Constant>> constant_pool;
+  // Constants of each tag by the data they are made of.
+  std::unordered_map<std::string_view, Utf8Constant*> utf8_by_text;
+  std::unordered_map<u2, StringConstant*> string_by_utf8;
+  std::unordered_map<int, IntegerConstant*> integer_by_value;
+  std::unordered_map<u2, ClassConstant*> class_by_name;
+  std::unordered_map<u4, NameAndTypeConstant*> name_and_type_by_indexes;
+  std::unordered_map<u4, FieldRefConstant*> field_ref_by_indexes;
+  std::unordered_map<u4, MethodRefConstant*> method_ref_by_indexes;
+  std::unordered_map<int, std::unique_ptr<ShortInteger>> short_integers;
+  std::unordered_map<u2, std::unique_ptr<VirtualInvocation>> virtual_by_method_ref;
+  std::unordered_map<u2, std::unique_ptr<InstanceField>> instance_by_field_ref;
+  std::unordered_map<u2, std::unique_ptr<NewObject>> new_by_class;
+  std::vector<FieldInfo> fields;
   std::vector<MethodInfo> methods;
 };
 }  // namespace
 
-std::unique_ptr<Program> Program::JavaProgram() { return std::make_unique<JvmProgram>(); }
+std::optional<std::string_view> LibraryFunctionType(std::string_view name) {
+  if (auto found = kMethodByLibraryFunctionName.find(name); found != kMethodByLibraryFunctionName.end()) {
+    return found->second.type;
+  }
+  return {};
+}
+
+std::unique_ptr<Program> Program::JavaProgram(std::string_view class_name) {
+  return std::make_unique<JvmProgram>(class_name);
+}
 
 }  // namespace emit
@@ -1,5 +1,7 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <sstream>
 #include <string_view>
@@ -29,6 +31,25 @@ class Invocable {
   }
 };
 
+// Fields of a class. Those of objects take the object from below the value on
+// the JVM stack.
+class Field {
+ public:
+  virtual ~Field() = default;
+  // Adds an instruction pushing the value of the field on the JVM stack.
+  virtual void Load(std::ostream& os) const = 0;
+  // Adds an instruction popping a value from the JVM stack into the field.
+  virtual void Store(std::ostream& os) const = 0;
+};
+
+// How an invocation selects the method it calls, or a field access the field:
+// static ones of the class, or virtual ones of the object on the stack.
+enum class Dispatch { kStatic, kVirtual };
+
+// Returns the descriptor of the library function with the given Tiger name,
+// like "(I)V" for printi, or nothing if there is none.
+std::optional<std::string_view> LibraryFunctionType(std::string_view name);
+
 // https://docs.oracle.com/javase/specs/jvms/se7/html/jvms-4.html#jvms-4.6
 enum Flag {
   ACC_PUBLIC = 0x0001,        // Declared public; may be accessed from outside its package.
@@ -45,17 +66,56 @@ enum Flag {
   ACC_SYNTHETIC = 0x1000,     // Declared synthetic; not present in the source code.
 };
 
+// Program of one class, which may define further classes. Each distinct
+// constant is added to the constant pool of the class using it once, and
+// further uses share it. Functions adding constants throw std::length_error
+// when the pool would get more entries than a class file can index.
 struct Program {
-  // Returns Program instance for Java class files.
-  static std::unique_ptr<Program> JavaProgram();
+  // Returns Program instance for Java class files of the given class.
+  static std::unique_ptr<Program> JavaProgram(std::string_view class_name = "Main");
 
   virtual ~Program() = default;
 
+  // Returns the name of the class.
+  virtual std::string_view Name() const = 0;
+  // Adds a class with a constructor taking no arguments, and returns it. Its
+  // constant pool is its own, but the text of constants equal to those of
+  // other classes of the program is kept once. Throws std::invalid_argument if
+  // the program has a class of the same name.
+  virtual Program& DefineClass(std::string_view class_name) = 0;
+  // Returns the classes added by DefineClass in order.
+  virtual std::vector<Program*> Classes() = 0;
+
   // Writes Java class file to given stream
   virtual void Emit(std::ostream& os) = 0;
   virtual const Pushable& DefineStringConstant(std::string_view text) = 0;
+  // Ints that iconst, bipush or sipush hold are pushed by those and take no
+  // constant.
   virtual const Pushable& DefineIntegerConstant(int i) = 0;
   virtual const Invocable* LookupLibraryFunction(std::string_view name) = 0;
+  // Returns the method with the given name and descriptor of the given class,
+  // which may be this one.
+  virtual const Invocable& LookupMethod(std::string_view class_name, std::string_view name,
+                                        std::string_view descriptor, Dispatch dispatch) = 0;
+  // Defines a static field or a field of objects of the class. Both throw
+  // std::invalid_argument if there is one of the same name.
+  virtual const Field& DefineStaticField(std::string_view name, std::string_view descriptor) = 0;
+  virtual const Field& DefineField(std::string_view name, std::string_view descriptor) = 0;
+  // Returns the field with the given name and descriptor of the given class,
+  // which may be this one.
+  virtual const Field& LookupField(std::string_view class_name, std::string_view name, std::string_view descriptor,
+                                   Dispatch dispatch) = 0;
+  // Returns the instructions pushing a new object of the given class, made by
+  // its constructor taking no arguments.
+  virtual const Pushable& LookupConstructor(std::string_view class_name) = 0;
+  // Returns the index of the constant for the given class or array type, which
+  // instructions like anewarray and checkcast take as operand.
+  virtual uint16_t DefineClassConstant(std::string_view class_name) = 0;
+  // Defines a method with the given code. Its max_stack, max_locals and stack
+  // map frames follow from the code. Throws std::invalid_argument if paths
+  // through the code reach an instruction with stacks of different heights or
+  // types, some code is unreachable, or the code is malformed otherwise, and
+  // std::length_error if it has more than 65535 bytes.
   virtual void DefineFunction(uint16_t flags, std::string_view name, std::string_view descriptor,
                               std::string_view code_bytes) = 0;
 };
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "emit.h"
+#include "instruction.h"
+#include "testing/heap_counter.h"
+
+namespace {
+
+// Emits a class using the given number of distinct integer constants twice
+// each, all too large for sipush. Returns the size of the class file.
+size_t EmitConstants(int count) {
+  auto program = emit::Program::JavaProgram();
+  for (int use = 0; use < 2; ++use) {
+    for (int i = 0; i < count; ++i) program->DefineIntegerConstant((1 << 16) + i);
+  }
+  std::ostringstream os;
+  program->Emit(os);
+  return os.str().size();
+}
+
+// Time per constant should stay the same as the constant pool grows.
+TEST_CASE("Emit classes with many constants", "[emit]") {
+  for (int count = 10000; count <= 60000; count += 10000) {
+    REQUIRE(EmitConstants(count) > 5u * count);
+    BENCHMARK(std::to_string(count) + " constants") { return EmitConstants(count); };
+  }
+}
+
+// Returns a program of the given number of methods of nearly 64 KiB of code
+// each, the most a method can have.
+std::unique_ptr<emit::Program> LargeMethods(int count) {
+  auto program = emit::Program::JavaProgram();
+  std::string code;
+  for (int i = 0; i < 32000; ++i) code += {static_cast<char>(_iconst_1), static_cast<char>(_pop)};
+  code.push_back(static_cast<char>(_return));
+  for (int i = 0; i < count; ++i) {
+    program->DefineFunction(emit::ACC_STATIC, "f" + std::to_string(i), "()V", code);
+  }
+  return program;
+}
+
+size_t Emit(emit::Program& program) {
+  std::ostringstream os;
+  program.Emit(os);
+  return os.str().size();
+}
+
+// Time and memory per method should not exceed what writing its code takes.
+TEST_CASE("Emit classes with large methods", "[emit]") {
+  auto program = LargeMethods(100);
+  REQUIRE(Emit(*program) > 6400000u);
+
+  testing::HeapUsage before = testing::HeapAllocated();
+  Emit(*program);
+  testing::HeapUsage after = testing::HeapAllocated();
+  std::cout << "Heap for emitting 100 methods of 64000 bytes: " << after.allocations - before.allocations
+            << " allocations, " << after.bytes - before.bytes << " bytes" << std::endl;
+
+  BENCHMARK("100 methods of 64000 bytes") { return Emit(*program); };
+}
+
+}  // namespace
@@ -0,0 +1,251 @@
+#include "emit.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+#include "instruction.h"
+#include "testing/testing.h"
+
+namespace {
+
+using emit::Program;
+using testing::Code;
+
+// Returns the class file of the given program.
+std::string ClassFile(Program& program) {
+  std::ostringstream os;
+  program.Emit(os);
+  return os.str();
+}
+
+// Returns the constant pool count of the given class file, which is one more
+// than the number of entries.
+int ConstantPoolCount(const std::string& class_file) {
+  return static_cast<uint8_t>(class_file[8]) << 8 | static_cast<uint8_t>(class_file[9]);
+}
+
+// Returns max_stack and max_locals of the method with the given code in the
+// given class file.
+std::pair<int, int> FrameSize(const std::string& class_file, const std::string& code) {
+  size_t at = class_file.find(code);
+  REQUIRE(at != std::string::npos);
+  REQUIRE(at >= 8);
+  auto u2 = [&](size_t i) {
+    return static_cast<uint8_t>(class_file[i]) << 8 | static_cast<uint8_t>(class_file[i + 1]);
+  };
+  return {u2(at - 8), u2(at - 6)};
+}
+
+// Returns the major version of the given class file.
+int MajorVersion(const std::string& class_file) {
+  return static_cast<uint8_t>(class_file[6]) << 8 | static_cast<uint8_t>(class_file[7]);
+}
+
+SCENARIO("Constant pool", "[emit]") {
+  GIVEN("A program using constants repeatedly") {
+    auto program = Program::JavaProgram();
+    const emit::Pushable& seven = program->DefineIntegerConstant(7);
+    const emit::Pushable& text = program->DefineStringConstant("seven");
+    THEN("equal constants are shared") {
+      REQUIRE(&program->DefineIntegerConstant(7) == &seven);
+      REQUIRE(&program->DefineStringConstant("seven") == &text);
+      REQUIRE(program->LookupLibraryFunction("printi") == program->LookupLibraryFunction("printi"));
+    }
+    THEN("different constants are not") {
+      REQUIRE(&program->DefineIntegerConstant(8) != &seven);
+      REQUIRE(&program->DefineStringConstant("eight") != &text);
+    }
+    THEN("the class file has each constant once") {
+      int count = ConstantPoolCount(ClassFile(*program));
+      for (int i = 0; i < 100; ++i) {
+        program->DefineIntegerConstant(7);
+        program->DefineStringConstant("seven");
+      }
+      REQUIRE(ConstantPoolCount(ClassFile(*program)) == count);
+    }
+  }
+  GIVEN("A program with as many constants as a class file can index") {
+    auto program = Program::JavaProgram();
+    int count = ConstantPoolCount(ClassFile(*program));
+    // Ints beyond those sipush holds.
+    constexpr int kLarge = 1 << 16;
+    for (int i = 0; count + i < 0xffff; ++i) program->DefineIntegerConstant(kLarge + i);
+    THEN("the constant pool count is at its limit") { REQUIRE(ConstantPoolCount(ClassFile(*program)) == 0xffff); }
+    THEN("one more constant is an error") {
+      REQUIRE_THROWS_AS(program->DefineIntegerConstant(-kLarge), std::length_error);
+      REQUIRE(&program->DefineIntegerConstant(kLarge) == &program->DefineIntegerConstant(kLarge));
+    }
+    THEN("ints that instructions hold can still be pushed") {
+      std::ostringstream os;
+      program->DefineIntegerConstant(-32768).Push(os);
+      REQUIRE(os.str() == Code({_sipush, 0x80, 0}));
+    }
+  }
+  GIVEN("Ints of different sizes") {
+    auto program = Program::JavaProgram();
+    int count = ConstantPoolCount(ClassFile(*program));
+    auto push = [&](int i) {
+      std::ostringstream os;
+      program->DefineIntegerConstant(i).Push(os);
+      return os.str();
+    };
+    THEN("each is pushed by the shortest instruction") {
+      REQUIRE(push(-1) == Code({_iconst_m1}));
+      REQUIRE(push(5) == Code({_iconst_5}));
+      REQUIRE(push(-128) == Code({_bipush, 0x80}));
+      REQUIRE(push(127) == Code({_bipush, 127}));
+      REQUIRE(push(128) == Code({_sipush, 0, 128}));
+      REQUIRE(push(32767) == Code({_sipush, 0x7f, 0xff}));
+      REQUIRE(ConstantPoolCount(ClassFile(*program)) == count);
+      REQUIRE(push(32768).substr(0, 1) == Code({_ldc}));
+      REQUIRE(ConstantPoolCount(ClassFile(*program)) == count + 1);
+    }
+  }
+  GIVEN("A string longer than a constant can hold") {
+    auto program = Program::JavaProgram();
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineStringConstant(std::string(70000, 'x')), std::length_error);
+    }
+  }
+}
+
+SCENARIO("Frame size", "[emit]") {
+  auto program = Program::JavaProgram();
+  constexpr int kStatic = emit::ACC_PUBLIC | emit::ACC_STATIC;
+  GIVEN("A deep expression") {
+    std::string code;
+    for (int i = 0; i < 20; ++i) code.push_back(_iconst_1);
+    for (int i = 0; i < 19; ++i) code.push_back(_iadd);
+    std::ostringstream call;
+    program->LookupLibraryFunction("printi")->Invoke(call);
+    code += call.str() + Code({_return});
+    program->DefineFunction(kStatic, "main", "([Ljava/lang/String;)V", code);
+    THEN("max_stack is its depth") { REQUIRE(FrameSize(ClassFile(*program), code) == std::pair(20, 1)); }
+  }
+  GIVEN("Branches agreeing on the stack height") {
+    // Pushes 1 or 2 depending on a condition, and pops it.
+    std::string code = Code({_iconst_0, _ifeq, 0, 7, _iconst_1, _goto, 0, 4, _iconst_2, _pop, _return});
+    program->DefineFunction(kStatic, "f", "()V", code);
+    THEN("the method is defined") { REQUIRE(FrameSize(ClassFile(*program), code) == std::pair(1, 0)); }
+  }
+  GIVEN("Branches disagreeing on the stack height") {
+    std::string code = Code({_iconst_0, _ifeq, 0, 7, _nop, _goto, 0, 4, _iconst_2, _pop, _return});
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", code), std::invalid_argument);
+    }
+  }
+  GIVEN("Code popping an empty stack") {
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", Code({_pop, _return})), std::invalid_argument);
+    }
+  }
+  GIVEN("Code running off its end") {
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", Code({_iconst_0, _pop})), std::invalid_argument);
+    }
+  }
+  GIVEN("Local variables beyond the parameters") {
+    std::string code = Code({_lconst_0, _lstore, 5, _return});
+    program->DefineFunction(kStatic, "f", "(IJ)V", code);
+    THEN("max_locals covers the last of them") { REQUIRE(FrameSize(ClassFile(*program), code) == std::pair(2, 7)); }
+  }
+  GIVEN("The constructor") {
+    std::string code = Code({_aload_0, _invokespecial});
+    THEN("it uses this") { REQUIRE(FrameSize(ClassFile(*program), code) == std::pair(1, 1)); }
+  }
+}
+
+SCENARIO("Stack map frames", "[emit]") {
+  auto program = Program::JavaProgram();
+  constexpr int kStatic = emit::ACC_PUBLIC | emit::ACC_STATIC;
+  GIVEN("A program") {
+    THEN("its class file has a version checked by the type-checking verifier") {
+      REQUIRE(MajorVersion(ClassFile(*program)) == 52);
+    }
+  }
+  GIVEN("Branches leaving a value on the stack") {
+    program->DefineFunction(kStatic, "f", "()V",
+                            Code({_iconst_0, _ifeq, 0, 7, _iconst_1, _goto, 0, 4, _iconst_2, _pop, _return}));
+    THEN("each jump target has a frame") {
+      // Attribute length 5 with 2 frames: same_frame at 8, and
+      // same_locals_1_stack_item_frame with an int at 9.
+      REQUIRE(ClassFile(*program).find(Code({0, 0, 0, 5, 0, 2, 8, 64 + 0, 1})) != std::string::npos);
+    }
+  }
+  GIVEN("Paths storing null and a string in a local") {
+    std::ostringstream os;
+    os.put(_aconst_null);
+    os.put(_astore_1);
+    os.put(_iload_0);
+    os << Code({_ifeq, 0, 6});
+    program->DefineStringConstant("s").Push(os);
+    os << Code({_astore_1, _aload_1, _pop, _return});
+    program->DefineFunction(kStatic, "f", "(I)V", os.str());
+    THEN("the local is a string where they meet") {
+      // append_frame of one local at offset 9.
+      REQUIRE(ClassFile(*program).find(Code({0, 1, 252, 0, 9, 7})) != std::string::npos);
+    }
+  }
+  GIVEN("Branches leaving values of different types on the stack") {
+    std::string code = Code({_iconst_0, _ifeq, 0, 7, _iconst_1, _goto, 0, 4, _aconst_null, _pop, _return});
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", code), std::invalid_argument);
+    }
+  }
+  GIVEN("Code after a return") {
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", Code({_return, _return})), std::invalid_argument);
+    }
+  }
+  GIVEN("Code loading a local it never stored") {
+    THEN("it is an error") {
+      REQUIRE_THROWS_AS(program->DefineFunction(kStatic, "f", "()V", Code({_iload_0, _pop, _return})),
+                        std::invalid_argument);
+    }
+  }
+}
+
+SCENARIO("Classes", "[emit]") {
+  auto program = Program::JavaProgram();
+  constexpr int kStatic = emit::ACC_PUBLIC | emit::ACC_STATIC;
+  GIVEN("A class with a field, and a method using it") {
+    Program& point = program->DefineClass("Point");
+    point.DefineField("x", "I");
+    std::ostringstream os;
+    program->LookupConstructor("Point").Push(os);
+    os.put(_dup);
+    program->DefineIntegerConstant(7).Push(os);
+    const emit::Field& x = program->LookupField("Point", "x", "I", emit::Dispatch::kVirtual);
+    x.Store(os);
+    x.Load(os);
+    os << Code({_pop, _return});
+    program->DefineFunction(kStatic, "f", "()V", os.str());
+    std::string class_file = ClassFile(*program);
+    THEN("the program has both classes") {
+      REQUIRE(program->Classes() == std::vector<Program*>{&point});
+      REQUIRE(point.Name() == "Point");
+    }
+    THEN("the method creates an object and uses its field") {
+      REQUIRE(FrameSize(class_file, os.str()) == std::pair(3, 0));
+    }
+    THEN("each class has its own constant pool") {
+      std::string point_file = ClassFile(point);
+      REQUIRE(point_file.find("Point") != std::string::npos);
+      REQUIRE(ConstantPoolCount(point_file) < ConstantPoolCount(class_file));
+    }
+    THEN("defining a class or field again is an error") {
+      REQUIRE_THROWS_AS(program->DefineClass("Point"), std::invalid_argument);
+      REQUIRE_THROWS_AS(point.DefineClass("Main"), std::invalid_argument);
+      REQUIRE_THROWS_AS(point.DefineField("x", "I"), std::invalid_argument);
+    }
+  }
+  GIVEN("A class emitted twice") {
+    THEN("it has one constructor") { REQUIRE(ClassFile(*program) == ClassFile(*program)); }
+  }
+}
+
+}  // namespace
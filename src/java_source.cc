@@ -1,54 +1,54 @@
 #include "java_source.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 #include <variant>
 #include <vector>
 
+#include "closures.h"
 #include "debug_string.h"
 #include "symbol_table.h"
 #include "syntax.h"
 #include "type_finder.h"
+#include "types.h"
 
 namespace java {
 
 using syntax::Overloaded;
 
-std::string Sanitize(std::string id) {
-  static std::unordered_set<std::string_view> kJavaKeywords = {
-      "abstract",  "assert",   "boolean",  "break",    "byte",    "case",         "catch",     "char",       "class",
-      "const",     "continue", "default",  "do",       "double",  "else",         "enum",      "extends",    "final",
-      "finally",   "float",    "for",      "goto",     "if",      "implements",   "import",    "instanceof", "int",
-      "interface", "long",     "native",   "new",      "package", "private",      "protected", "public",     "return",
-      "short",     "static",   "strictfp", "super",    "switch",  "synchronized", "this",      "throw",      "throws",
-      "transient", "try",      "void",     "volatile", "while"};
-  return kJavaKeywords.count(id) ? "_" + id : id;
-}
-
-std::string GetJavaType(std::string_view type_id, const syntax::Expr& expr, TypeFinder& types,
-                        const SymbolTable& symbols) {
-  if (type_id.empty() || type_id == "NOTYPE" || type_id == "void") {
-    return "Object";
+// Tiger types without a Java value type of their own.
+bool IsVoidType(const types::Type* type) { return type->kind == types::Type::kUnit; }
+
+std::string GetJavaType(const types::Type* type) {
+  switch (type->kind) {
+    case types::Type::kInt:
+      return "int";
+    case types::Type::kString:
+      return "String";
+    case types::Type::kArray:
+      return GetJavaType(type->canonical->element) + "[]";
+    case types::Type::kRecord:
+    case types::Type::kUnknown:
+      return Sanitize(type->canonical->name);
+    default:
+      return "Object";
   }
-  if (type_id == "int") return "int";
-  if (type_id == "string") return "String";
-  if (const syntax::TypeDeclaration* decl = symbols.lookupUnaliasedType(expr, type_id)) {
-    if (auto arr = std::get_if<syntax::ArrayType>(&decl->value)) {
-      return GetJavaType(arr->element_type_id, expr, types, symbols) + "[]";
-    }
-  }
-  return Sanitize(std::string(type_id));
 }
 
-std::string GetJavaType(const syntax::Expr& expr, TypeFinder& types, const SymbolTable& symbols) {
-  return GetJavaType(types(expr), expr, types, symbols);
-}
-
-std::string GetJavaTypeFromOptional(std::optional<std::string_view> type_id, const syntax::Expr& expr,
-                                    TypeFinder& types, const SymbolTable& symbols) {
-  return type_id ? GetJavaType(*type_id, expr, types, symbols) : GetJavaType(expr, types, symbols);
+// Returns the name of the Java local holding the given name of the given scope.
+// Java locals may not shadow each other, so let variables shadowing a name of
+// the same function get the id of their scope appended.
+std::string LocalName(const Scope* scope, syntax::Symbol name) {
+  for (const Scope* s = scope; s != scope->function_scope;) {
+    s = s->parent;
+    if (s->storage.count(name)) return Sanitize(name) + "_" + std::to_string(scope->id);
+  }
+  return Sanitize(name);
 }
 
 bool NeedsSemicolon(TypeFinder& types, const syntax::Expr& expr) {
@@ -58,131 +58,133 @@ bool NeedsSemicolon(TypeFinder& types, const syntax::Expr& expr) {
     return false;
   }
   if (auto ite = std::get_if<syntax::IfThenElse>(&expr)) {
-    std::string_view type = types(*ite->then_expr);
-    return !type.empty() && type != "void" && type != "Object" && type != "NOTYPE";
+    return !IsVoidType(types(*ite->then_expr));
   }
   return true;
 }
 
-struct ScopesPrinter : syntax::VisitorBase<ScopesPrinter> {
-  using super::operator();
+struct ScopesPrinter {
   const SymbolTable& t;
   TypeFinder& tf;
+  const Closures& closures;
   std::ostream& out;
   std::unordered_set<const Scope*> printed;
   std::vector<const syntax::Expr*> expr_stack;
 
-  ScopesPrinter(const SymbolTable& t, TypeFinder& tf, std::ostream& out) : t(t), tf(tf), out(out) {}
+  ScopesPrinter(const SymbolTable& t, TypeFinder& tf, const Closures& closures, std::ostream& out)
+      : t(t), tf(tf), closures(closures), out(out) {}
+
+  void operator()(const syntax::Expr& root) {
+    syntax::Traverse(
+        &root, [this](const auto& node) { return Enter(node); }, [this](const auto& node) { Leave(node); });
+  }
 
-  bool operator()(const syntax::Expr& expr) {
+  bool Enter(const syntax::Expr& expr) {
     expr_stack.push_back(&expr);
-    bool keep_going = Visit(expr);
-    expr_stack.pop_back();
-    return keep_going;
+    if (const auto* let = std::get_if<syntax::Let>(&expr)) Print(*let);
+    return true;
   }
 
-  bool operator()(const syntax::Declaration& d) { return Visit(d); }
+  bool Enter(const syntax::Declaration& d) {
+    if (const auto* v = std::get_if<syntax::FunctionDeclaration>(&d)) Print(*v);
+    return true;
+  }
+
+  bool Enter(const auto&) { return true; }
+
+  void Leave(const syntax::Expr&) { expr_stack.pop_back(); }
+
+  void Leave(const auto&) {}
 
-  bool operator()(const syntax::FunctionDeclaration& v) {
+  void Print(const syntax::FunctionDeclaration& v) {
     const Scope* scope = t.getScope(v);
     if (scope == nullptr) std::cerr << "No scope for function " << v.id << std::endl;
-    if (scope && printed.count(scope) == 0 && !expr_stack.empty()) {
+    if (scope && closures.HasObject(scope) && printed.count(scope) == 0 && !expr_stack.empty()) {
       printed.insert(scope);
       PrintIntro(*scope);
-      for (const auto& param : v.parameter) {
-        out << "  public " << GetJavaType(param.type_id, *expr_stack.back(), tf, t) << " " << Sanitize(param.id)
-            << ";\n";
+      const types::Signature& signature = t.getSignature(v);
+      for (size_t i = 0; i < v.parameter.size(); ++i) {
+        if (!closures.InObject(scope, v.parameter[i].id)) continue;
+        out << "  public " << GetJavaType(signature.parameters[i]) << " " << Sanitize(v.parameter[i].id) << ";\n";
       }
       out << "}\n\n";
     }
-    return syntax::VisitChildren(v, *this);
   }
 
-  bool operator()(const syntax::Let& let) {
+  void Print(const syntax::Let& let) {
     const Scope* scope = t.getScope(let);
     if (scope == nullptr) std::cerr << "No scope for let " << DebugString(*expr_stack.back()) << std::endl;
-    if (scope && printed.count(scope) == 0) {
+    if (scope && closures.HasObject(scope) && printed.count(scope) == 0) {
       printed.insert(scope);
       PrintIntro(*scope);
       for (const auto& decl : let.declaration) {
         const syntax::VariableDeclaration* var = std::get_if<syntax::VariableDeclaration>(decl.get());
-        if (var) {
-          out << "  public " << GetJavaTypeFromOptional(var->type_id, *var->value, tf, t) << " " << Sanitize(var->id)
-              << ";\n";
+        if (var && closures.InObject(scope, var->id)) {
+          out << "  public " << GetJavaType(tf(*var)) << " " << Sanitize(var->id) << ";\n";
         }
       }
       out << "}\n\n";
     }
-    return syntax::VisitChildren(let, *this);
   }
 
-  bool operator()(const auto& e) { return syntax::VisitChildren(e, *this); }
-
-  void PrintIntro(const Scope& scope) {
-    out << "class Scope" << scope.id << " {\n";
-    if (scope.parent) {
-      out << "  public Scope" << scope.parent->id << " parent;\n";
-    }
-  }
+  void PrintIntro(const Scope& scope) { out << "class Scope" << scope.id << " {\n"; }
 };
 
 struct Compiler {
   const SymbolTable& symbols;
   TypeFinder& types;
+  const Closures& closures;
   std::ostream& out;
   std::ostream& post_body;
   std::string current_lvalue;
 
   const Scope* local_scope = nullptr;
   const syntax::Expr* current_expr = nullptr;
-  const Scope* req_scope = nullptr;
   int indent_level = 2;
+  // Nesting depth of the expression being compiled, counted by Nesting from
+  // that of the compiler creating this one.
+  int depth = 0;
 
   std::string indent() const { return std::string(indent_level * 2, ' '); }
 
-  std::string GetScopePath(const Scope* target_scope) {
-    if (!target_scope || !local_scope) return "";
-    bool is_local = false;
-    for (const Scope* s = local_scope; s && s != req_scope; s = s->parent) {
-      if (s == target_scope) {
-        is_local = true;
-        break;
+  // Returns the Java expression for the given slot of the given scope, or for
+  // its object if the slot is -1.
+  std::string Reference(const Scope* scope, int slot) const {
+    if (scope->function_scope != local_scope->function_scope) {
+      for (const FreeVariable& v : closures.Free(local_scope->function_scope)) {
+        if (v.scope == scope && v.slot == slot) return v.name;
       }
     }
-    if (is_local) {
-      return "_scope" + std::to_string(target_scope->id);
-    }
-    if (!req_scope) return "_scope" + std::to_string(target_scope->id);
-    std::string path = "_scope" + std::to_string(req_scope->id);
-    for (const Scope* s = req_scope; s && s != target_scope; s = s->parent) {
-      path += ".parent";
-    }
-    return path;
+    if (slot < 0) return "_scope" + std::to_string(scope->id);
+    syntax::Symbol name = scope->slots[slot];
+    if (std::holds_alternative<const syntax::For*>(scope->storage.at(name))) return Sanitize(name);
+    return LocalName(scope, name);
   }
 
   void Compile(const syntax::Expr& expr) {
     const syntax::Expr* old_expr = current_expr;
     current_expr = &expr;
+    Nesting nesting(depth);
     std::visit(*this, expr);
     current_expr = old_expr;
   }
   void operator()(const syntax::StringConstant& expr) { out << '"' << expr.value << '"'; }
   void operator()(const syntax::IntegerConstant& expr) { out << expr; }
   void operator()(const syntax::Nil&) { out << "null"; }
-  void operator()(const std::unique_ptr<syntax::LValue>& expr) { (*this)(*expr); }
+  void operator()(const syntax::ArenaPtr<syntax::LValue>& expr) { (*this)(*expr); }
   void operator()(const syntax::LValue& expr) { std::visit(*this, expr); }
 
   void operator()(const syntax::Identifier& expr) {
-    const Scope* def_scope = current_expr ? symbols.getDefiningScope(*current_expr, expr) : nullptr;
+    const Binding* binding = current_expr ? &symbols.getBinding(*current_expr) : nullptr;
+    const Scope* def_scope = binding ? binding->scope : nullptr;
     if (def_scope && local_scope) {
-      // If it's a for loop variable, it's not in the Scope object in the current
-      // translation, so we access it as a local Java variable.
-      auto loc = symbols.lookupStorageLocation(*current_expr, expr);
-      if (std::holds_alternative<const syntax::For*>(loc)) {
-        out << Sanitize(expr);
-        return;
+      if (const Global* global = closures.FindGlobal(def_scope, binding->slot)) {
+        out << global->name;
+      } else if (closures.InObject(def_scope, binding->slot)) {
+        out << Reference(def_scope, -1) << "." << Sanitize(expr);
+      } else {
+        out << Reference(def_scope, binding->slot);
       }
-      out << GetScopePath(def_scope) << "." << Sanitize(expr);
     } else {
       out << Sanitize(expr);
     }
@@ -201,9 +203,8 @@ struct Compiler {
     out << "-";
     Compile(*expr.expr);
   }
-  void operator()(const syntax::Binary& expr) {
-    static constexpr std::string_view kJavaOps[] = {
-        "??",
+  static constexpr std::string_view kJavaOps[] = {
+      "??",
 #define DEF_BINARY_OPERATOR(c, n)       \
   (std::string_view(n) == "="    ? "==" \
    : std::string_view(n) == "<>" ? "!=" \
@@ -212,14 +213,99 @@ struct Compiler {
                                  : n),
 #include "binary_operator.defs"
 #undef DEF_BINARY_OPERATOR
-    };
-    Compile(*expr.left);
-    out << " " << kJavaOps[static_cast<size_t>(expr.op)] << " ";
-    Compile(*expr.right);
+  };
+  static bool IsArithmetic(BinaryOp op) { return op == kPlus || op == kMinus || op == kTimes || op == kDivide; }
+
+  // Emits the given expression as a Java boolean. Comparisons, &, | and not
+  // are the Java operators, or equals and compareTo for strings, so that no
+  // int is made of them only to be tested, and other expressions are compared
+  // with 0.
+  void Condition(const syntax::Expr& expr) {
+    Nesting nesting(depth);
+    if (const auto* binary = std::get_if<syntax::Binary>(&expr)) {
+      if (binary->op == kAnd || binary->op == kOr) {
+        // Chains like a&b&...&c are followed in a loop.
+        std::vector<const syntax::Binary*> chain = {binary};
+        while (const auto* left = std::get_if<syntax::Binary>(chain.back()->left.get())) {
+          if (left->op != binary->op) break;
+          chain.push_back(left);
+        }
+        Condition(*chain.back()->left);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+          out << " " << kJavaOps[static_cast<size_t>(binary->op)] << " ";
+          Condition(*(*it)->right);
+        }
+        return;
+      }
+      if (!IsArithmetic(binary->op)) {
+        // Strings compare their characters, as in class files.
+        if (types(*binary->left)->kind == types::Type::kString) {
+          bool equality = binary->op == kEqual || binary->op == kUnequal;
+          if (binary->op == kUnequal) out << "!";
+          Receiver(*binary->left);
+          out << (equality ? ".equals(" : ".compareTo(");
+          Compile(*binary->right);
+          out << ")";
+          if (!equality) out << " " << kJavaOps[static_cast<size_t>(binary->op)] << " 0";
+          return;
+        }
+        Compile(*binary->left);
+        out << " " << kJavaOps[static_cast<size_t>(binary->op)] << " ";
+        Compile(*binary->right);
+        return;
+      }
+    } else if (const auto* call = std::get_if<syntax::FunctionCall>(&expr)) {
+      if (call->id.str() == "not" && call->arguments.size() == 1 && !symbols.getBinding(expr).function()) {
+        out << "!(";
+        Condition(*call->arguments[0]);
+        out << ")";
+        return;
+      }
+    } else if (const auto* parenthesized = std::get_if<syntax::Parenthesized>(&expr)) {
+      if (parenthesized->exprs.size() == 1) {
+        out << "(";
+        Condition(*parenthesized->exprs[0]);
+        out << ")";
+        return;
+      }
+    }
+    Compile(expr);
+    out << " != 0";
+  }
+
+  void operator()(const syntax::Binary& expr) {
+    // Comparisons are 1 or 0, and a&b is b if a is true and a|b is 1.
+    if (expr.op == kAnd || expr.op == kOr) {
+      out << "(";
+      Condition(*expr.left);
+      out << (expr.op == kAnd ? " ? " : " ? 1 : ");
+      Compile(*expr.right);
+      out << (expr.op == kAnd ? " : 0)" : ")");
+      return;
+    }
+    if (!IsArithmetic(expr.op)) {
+      out << "(";
+      Condition(*current_expr);
+      out << " ? 1 : 0)";
+      return;
+    }
+    // Left operands of chains like 1+1+...+1 are followed in a loop, so that
+    // the length of the chain does not matter.
+    std::vector<const syntax::Binary*> chain = {&expr};
+    while (const auto* left = std::get_if<syntax::Binary>(chain.back()->left.get())) {
+      if (!IsArithmetic(left->op)) break;
+      chain.push_back(left);
+    }
+    Compile(*chain.back()->left);
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      out << " " << kJavaOps[static_cast<size_t>((*it)->op)] << " ";
+      Compile(*(*it)->right);
+    }
   }
   void operator()(const syntax::Assignment& expr) {
     std::ostringstream lval_out;
-    Compiler lval_compiler{symbols, types, lval_out, post_body, "", local_scope, current_expr, req_scope, indent_level};
+    Compiler lval_compiler{symbols,   types,        closures,     lval_out, post_body, "",
+                           local_scope, current_expr, indent_level, depth};
     lval_compiler(*expr.l_value);
     current_lvalue = lval_out.str();
 
@@ -228,20 +314,22 @@ struct Compiler {
     current_lvalue = "";
   }
   void operator()(const syntax::FunctionCall& expr) {
-    const syntax::FunctionDeclaration* fn = current_expr ? symbols.lookupFunction(*current_expr, expr.id) : nullptr;
+    const syntax::FunctionDeclaration* fn = current_expr ? symbols.getBinding(*current_expr).function() : nullptr;
+    if (!fn && CompileIntrinsic(expr)) return;
 
     std::string printFn = Sanitize(expr.id);
-    if (printFn == "print") printFn = "System.out.print";
-    if (printFn == "flush") printFn = "System.out.flush";
+    if (!fn) {
+      // Library functions are methods of class Std, whose output is
+      // buffered.
+      printFn = printFn == "getchar" ? "Std.getChar" : "Std." + printFn;
+    }
 
     out << printFn << "(";
     const char* sep = "";
 
-    if (fn) {
-      const Scope* fn_scope = fn->body ? symbols.getScope(*fn->body) : nullptr;
-      const Scope* fn_req_scope = fn_scope ? fn_scope->parent : nullptr;
-      if (fn_req_scope && local_scope) {
-        out << GetScopePath(fn_req_scope);
+    if (const Scope* fn_scope = fn && local_scope ? symbols.getScope(*fn) : nullptr) {
+      for (const FreeVariable& v : closures.Free(fn_scope)) {
+        out << sep << Reference(v.scope, v.slot);
         sep = ", ";
       }
     }
@@ -253,9 +341,99 @@ struct Compiler {
     }
     out << ")";
   }
-  void operator()(const syntax::RecordLiteral& expr) { out << "new " << Sanitize(expr.type_id) << "()"; }
+  // Whether the value of the given expression is the same when it is
+  // evaluated again, so that it can be emitted twice.
+  static bool IsPure(const syntax::Expr& expr) {
+    const auto* l_value = std::get_if<syntax::ArenaPtr<syntax::LValue>>(&expr);
+    return std::holds_alternative<syntax::IntegerConstant>(expr) ||
+           (l_value && std::holds_alternative<syntax::Identifier>(**l_value));
+  }
+  // Emits the given expression so that a method can be called on its value,
+  // in parentheses unless it is an l-value, a literal or a call.
+  void Receiver(const syntax::Expr& expr) {
+    bool bare = std::holds_alternative<syntax::ArenaPtr<syntax::LValue>>(expr) ||
+                std::holds_alternative<syntax::StringConstant>(expr) ||
+                std::holds_alternative<syntax::FunctionCall>(expr);
+    if (!bare) out << "(";
+    Compile(expr);
+    if (!bare) out << ")";
+  }
+
+  // Emits the given call of a library function that is a few Java operators
+  // or a method of String, like size(s), as those instead of a call of class
+  // Std. Returns whether it is one of those.
+  bool CompileIntrinsic(const syntax::FunctionCall& call) {
+    struct Intrinsic {
+      size_t arity;
+      // Returns false if the call is left to class Std, like those that would
+      // evaluate an argument twice.
+      bool (*compile)(Compiler&, const syntax::FunctionCall&);
+    };
+    static const std::unordered_map<std::string_view, Intrinsic> kIntrinsics = {
+        {"size",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.Receiver(*call.arguments[0]);
+            m.out << ".length()";
+            return true;
+          }}},
+        {"ord",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            const syntax::Expr& s = *call.arguments[0];
+            if (const auto* literal = std::get_if<syntax::StringConstant>(&s)) {
+              std::string_view text = literal->value;
+              if (text.empty() || (text[0] != '\\' && static_cast<unsigned char>(text[0]) < 0x80)) {
+                m.out << (text.empty() ? -1 : text[0]);
+                return true;
+              }
+            }
+            if (!IsPure(s)) return false;
+            m.out << "(";
+            m.Compile(s);
+            m.out << ".isEmpty() ? -1 : ";
+            m.Compile(s);
+            m.out << ".charAt(0))";
+            return true;
+          }}},
+        {"substring",
+         {3,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            if (!IsPure(*call.arguments[1])) return false;
+            m.Receiver(*call.arguments[0]);
+            m.out << ".substring(";
+            m.Compile(*call.arguments[1]);
+            m.out << ", ";
+            m.Compile(*call.arguments[1]);
+            m.out << " + ";
+            m.Compile(*call.arguments[2]);
+            m.out << ")";
+            return true;
+          }}},
+        {"concat",
+         {2,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.Receiver(*call.arguments[0]);
+            m.out << ".concat(";
+            m.Compile(*call.arguments[1]);
+            m.out << ")";
+            return true;
+          }}},
+        {"not",
+         {1,
+          [](Compiler& m, const syntax::FunctionCall& call) {
+            m.out << "(";
+            m.Condition(*call.arguments[0]);
+            m.out << " ? 0 : 1)";
+            return true;
+          }}}};
+    auto intrinsic = kIntrinsics.find(call.id.str());
+    if (intrinsic == kIntrinsics.end() || call.arguments.size() != intrinsic->second.arity) return false;
+    return intrinsic->second.compile(*this, call);
+  }
+  void operator()(const syntax::RecordLiteral&) { out << "new " << GetJavaType(types(*current_expr)) << "()"; }
   void operator()(const syntax::ArrayLiteral& expr) {
-    out << "new " << GetJavaType(*expr.value, types, symbols) << "[";
+    out << "new " << GetJavaType(types(*expr.value)) << "[";
     Compile(*expr.size);
     out << "];\n";
     if (current_lvalue.empty()) return;
@@ -265,7 +443,7 @@ struct Compiler {
   }
   void operator()(const syntax::IfThen& expr) {
     out << "if (";
-    Compile(*expr.condition);
+    Condition(*expr.condition);
     out << ") {\n";
     indent_level++;
     out << indent();
@@ -275,36 +453,56 @@ struct Compiler {
     out << "\n" << indent() << "}";
   }
   void operator()(const syntax::IfThenElse& expr) {
-    std::string_view type = types(*expr.then_expr);
-    if (!type.empty() && type != "void" && type != "Object" && type != "NOTYPE") {
-      out << "(";
-      Compile(*expr.condition);
-      out << " ? ";
-      Compile(*expr.then_expr);
-      out << " : ";
-      Compile(*expr.else_expr);
-      out << ")";
+    // Else branches that are if-then-else expressions of the same kind are
+    // followed in a loop, so that the length of else-if chains does not matter.
+    bool has_value = !IsVoidType(types(*expr.then_expr));
+    const syntax::IfThenElse* link = &expr;
+    auto next_link = [&]() -> const syntax::IfThenElse* {
+      const auto* next = std::get_if<syntax::IfThenElse>(link->else_expr.get());
+      return next && IsVoidType(types(*next->then_expr)) != has_value ? next : nullptr;
+    };
+    if (has_value) {
+      size_t links = 0;
+      for (;;) {
+        out << "(";
+        Condition(*link->condition);
+        out << " ? ";
+        Compile(*link->then_expr);
+        out << " : ";
+        ++links;
+        const syntax::IfThenElse* next = next_link();
+        if (!next) break;
+        link = next;
+      }
+      Compile(*link->else_expr);
+      out << std::string(links, ')');
       return;
     }
     out << "if (";
-    Compile(*expr.condition);
-    out << ") {\n";
-    indent_level++;
-    out << indent();
-    Compile(*expr.then_expr);
-    if (NeedsSemicolon(types, *expr.then_expr)) out << ";";
-    indent_level--;
+    for (;;) {
+      Condition(*link->condition);
+      out << ") {\n";
+      indent_level++;
+      out << indent();
+      Compile(*link->then_expr);
+      if (NeedsSemicolon(types, *link->then_expr)) out << ";";
+      indent_level--;
+      const syntax::IfThenElse* next = next_link();
+      if (!next) break;
+      out << "\n" << indent() << "} else if (";
+      link = next;
+    }
     out << "\n" << indent() << "} else {\n";
     indent_level++;
     out << indent();
-    Compile(*expr.else_expr);
-    if (NeedsSemicolon(types, *expr.else_expr)) out << ";";
+    Compile(*link->else_expr);
+    if (NeedsSemicolon(types, *link->else_expr)) out << ";";
     indent_level--;
     out << "\n" << indent() << "}";
   }
   void operator()(const syntax::While& expr) {
     out << "while (";
-    Compile(*expr.condition);
+    Condition(*expr.condition);
     out << ") {\n";
     indent_level++;
     out << indent();
@@ -329,31 +527,29 @@ struct Compiler {
   void operator()(const syntax::Break&) { out << "break"; }
   void operator()(const syntax::FunctionDeclaration& expr) {
     const Scope* fn_scope = expr.body ? symbols.getScope(*expr.body) : nullptr;
-    const Scope* req_scope = fn_scope ? fn_scope->parent : nullptr;
 
+    const types::Signature& signature = symbols.getSignature(expr);
     std::ostringstream fn_out;
     fn_out << "\n"
-           << indent() << "static "
-           << (expr.type_id ? GetJavaType(*expr.type_id, *current_expr, types, symbols) : "void") << " "
+           << indent() << "static " << (signature.result ? GetJavaType(signature.result) : "void") << " "
            << Sanitize(expr.id) << "(";
     const char* sep = "";
-    if (req_scope) {
-      fn_out << "Scope" << req_scope->id << " _scope" << req_scope->id;
+    for (const FreeVariable& v : closures.Free(fn_scope)) {
+      fn_out << sep << (v.type ? GetJavaType(v.type) : "Scope" + std::to_string(v.scope->id)) << " " << v.name;
       sep = ", ";
     }
-    for (const auto& arg : expr.parameter) {
-      fn_out << sep << GetJavaType(arg.type_id, *current_expr, types, symbols) << " " << Sanitize(arg.id);
+    for (size_t i = 0; i < expr.parameter.size(); ++i) {
+      fn_out << sep << GetJavaType(signature.parameters[i]) << " " << Sanitize(expr.parameter[i].id);
       sep = ", ";
     }
     fn_out << ") {\n";
-    Compiler sub_compiler{symbols, types, fn_out, post_body, "", fn_scope, current_expr, req_scope, indent_level + 1};
-    if (fn_scope) {
+    Compiler sub_compiler{symbols,  types,        closures,         fn_out, post_body, "",
+                          fn_scope, current_expr, indent_level + 1, depth};
+    if (fn_scope && closures.HasObject(fn_scope)) {
       fn_out << sub_compiler.indent() << "Scope" << fn_scope->id << " _scope" << fn_scope->id << " = new Scope"
              << fn_scope->id << "();\n";
-      if (req_scope) {
-        fn_out << sub_compiler.indent() << "_scope" << fn_scope->id << ".parent = _scope" << req_scope->id << ";\n";
-      }
       for (const auto& arg : expr.parameter) {
+        if (!closures.InObject(fn_scope, arg.id)) continue;
         fn_out << sub_compiler.indent() << "_scope" << fn_scope->id << "." << Sanitize(arg.id) << " = "
                << Sanitize(arg.id) << ";\n";
       }
@@ -380,29 +576,37 @@ struct Compiler {
     if (let_scope) {
       out << "{\n";
       indent_level++;
-      out << indent() << "Scope" << let_scope->id << " _scope" << let_scope->id << " = new Scope" << let_scope->id
-          << "();\n";
-      if (let_scope->parent && local_scope) {
-        out << indent() << "_scope" << let_scope->id << ".parent = _scope" << local_scope->id << ";\n";
+      if (closures.HasObject(let_scope)) {
+        out << indent() << "Scope" << let_scope->id << " _scope" << let_scope->id << " = new Scope" << let_scope->id
+            << "();\n";
       }
-      Compiler sub_compiler{symbols, types, out, post_body, "", let_scope, current_expr, req_scope, indent_level};
+      Compiler sub_compiler{symbols, types, closures, out, post_body, "", let_scope, current_expr, indent_level, depth};
 
       for (const auto& decl : expr.declaration) {
         std::visit(Overloaded{
                        [&](const syntax::FunctionDeclaration& fn) { sub_compiler(fn); },
                        [&](const syntax::TypeDeclaration& type) {
-                         if (auto fields = std::get_if<syntax::TypeFields>(&type.value)) {
+                         if (std::holds_alternative<syntax::TypeFields>(type.value)) {
                            post_body << "class " << Sanitize(type.id) << " {\n";
-                           for (auto& field : *fields) {
-                             post_body << "  public " << GetJavaType(field.type_id, *current_expr, types, symbols)
-                                       << " " << Sanitize(field.id) << ";\n";
+                           for (const types::Type::Field& field : symbols.getType(type)->fields) {
+                             post_body << "  public " << GetJavaType(field.type) << " " << Sanitize(field.id)
+                                       << ";\n";
                            }
                            post_body << "}\n\n";
                          }
                        },
                        [&](const syntax::VariableDeclaration& var) {
-                         std::string lval = "_scope" + std::to_string(let_scope->id) + "." + Sanitize(var.id);
-                         out << indent() << lval << " = ";
+                         std::string lval;
+                         if (const Global* global = closures.FindGlobal(let_scope, var.id)) {
+                           lval = global->name;
+                           out << indent() << lval << " = ";
+                         } else if (closures.InObject(let_scope, var.id)) {
+                           lval = "_scope" + std::to_string(let_scope->id) + "." + Sanitize(var.id);
+                           out << indent() << lval << " = ";
+                         } else {
+                           lval = LocalName(let_scope, var.id);
+                           out << indent() << GetJavaType(types(var)) << " " << lval << " = ";
+                         }
                          sub_compiler.current_lvalue = lval;
                          if (var.value) sub_compiler.Compile(*var.value);
                          sub_compiler.current_lvalue = "";
@@ -451,17 +655,18 @@ std::string Compile(const syntax::Expr& expr, const SymbolTable& t, TypeFinder&
 
   head << "import java.util.Arrays;\n\n";
 
-  ScopesPrinter(t, tf, head)(expr);
+  Closures closures = FindClosures(expr, t, tf);
+  ScopesPrinter(t, tf, closures, head)(expr);
 
   body << "class " << class_name << " {\n\n";
+  for (const Global& global : closures.globals) {
+    body << "  static " << GetJavaType(global.type) << " " << global.name << ";\n";
+  }
+  if (!closures.globals.empty()) body << "\n";
   body << "  public static void main(String[] args) {\n";
 
   const Scope* main_scope = t.scopes().empty() ? nullptr : t.scopes()[0].get();
-  Compiler compile{t, tf, body, post_body, "", main_scope, nullptr, nullptr, 2};
-  if (main_scope) {
-    body << compile.indent() << "Scope" << main_scope->id << " _scope" << main_scope->id << " = new Scope"
-         << main_scope->id << "();\n";
-  }
+  Compiler compile{t, tf, closures, body, post_body, "", main_scope, nullptr, 2};
 
   body << compile.indent();
   compile.Compile(expr);
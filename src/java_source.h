@@ -3,12 +3,18 @@
 #include <string>
 #include <vector>
 
+#include "closures.h"
 #include "symbol_table.h"
 #include "syntax.h"
 #include "type_finder.h"
 
 namespace java {
 
+// Returns the Java source of a class of the given name, whose main method runs
+// the given program, which must pass the checker. Throws std::length_error if
+// expressions are nested more than kMaxNesting levels deep. Chains of binary
+// operators and of else-ifs may be longer, but lets, sequences, calls and loops
+// count a level each, and a sequence as the body of a loop another.
 std::string Compile(const syntax::Expr& expr, const SymbolTable& t, TypeFinder& tf,
                     std::string_view class_name = "Main");
 
@@ -1,6 +1,8 @@
 #include "java_source.h"
 
 #include <algorithm>
+#include <stdexcept>
+#include <string>
 
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/matchers/catch_matchers_string.hpp"
@@ -12,7 +14,7 @@ using Catch::Matchers::ContainsSubstring;
 using Catch::Matchers::Equals;
 
 std::string Compile(std::string_view text, std::string_view class_name = "Main") {
-  std::unique_ptr<syntax::Expr> expr = testing::Parse(text);
+  std::shared_ptr<syntax::Expr> expr = testing::Parse(text);
   REQUIRE(expr != nullptr);
   std::unique_ptr<SymbolTable> st = SymbolTable::Build(*expr);
   std::vector<std::string> errors;
@@ -35,26 +37,178 @@ in
 end)"),
                  Equals(R"(import java.util.Arrays;
 
-class Scope1 {
-  public Scope0 parent;
-  public int[] arr1;
-}
-
 class Main {
 
   public static void main(String[] args) {
-    Scope0 _scope0 = new Scope0();
     {
-      Scope1 _scope1 = new Scope1();
-      _scope1.parent = _scope0;
-      _scope1.arr1 = new int[10];
-      Arrays.fill(_scope1.arr1, 0);
-      _scope1.arr1;
+      int[] arr1 = new int[10];
+      Arrays.fill(arr1, 0);
+      arr1;
     }
   }
 }
 )"));
   }
+  GIVEN("Variables used and not used by nested functions") {
+    std::string java = Compile(R"(
+let
+  function run(): int =
+    let
+      var shared := 1
+      var own := 2
+      function f(p: int): int = (shared := shared + p; shared)
+    in
+      let var own := 3 in f(own) + own end
+    end
+in
+  run()
+end)");
+    THEN("only the used ones are fields of a scope object") {
+      REQUIRE_THAT(java, ContainsSubstring("class Scope3 {\n  public int shared;\n}"));
+      REQUIRE_THAT(java, ContainsSubstring("static int f(Scope3 _scope3, int p) {\n            _scope3.shared = "));
+      REQUIRE_THAT(java, ContainsSubstring("int own = 2;"));
+    }
+    THEN("locals shadowing locals of the same method are renamed") {
+      REQUIRE_THAT(java, ContainsSubstring("int own_5 = 3;\n            f(_scope3, own_5) + own_5;"));
+    }
+  }
+  GIVEN("Functions with and without free variables") {
+    std::string java = Compile(R"(
+let
+  function leaf(a: int): int = a + 1
+  function run(): int =
+    let
+      var g := 1
+      function outer(b: int): int =
+        let function inner(): int = (g := g + 1; g + leaf(b)) in inner() end
+    in
+      outer(leaf(2))
+    end
+in
+  run()
+end)");
+    THEN("functions using no enclosing storage take no arguments for it") {
+      REQUIRE_THAT(java, ContainsSubstring("static int leaf(int a) {"));
+      REQUIRE_THAT(java, ContainsSubstring("outer(_scope4, leaf(2));"));
+    }
+    THEN("functions take the objects and values used by them and their nested functions") {
+      REQUIRE_THAT(java, ContainsSubstring("static int outer(Scope4 _scope4, int b) {"));
+      REQUIRE_THAT(java, ContainsSubstring("inner(_scope4, b);"));
+    }
+    THEN("assigned variables are one field access away and others are values") {
+      REQUIRE_THAT(java, ContainsSubstring("static int inner(Scope4 _scope4, int b) {"));
+      REQUIRE_THAT(java, ContainsSubstring("_scope4.g = _scope4.g + 1;\n                _scope4.g + leaf(b);"));
+      REQUIRE_THAT(java, !ContainsSubstring(".parent"));
+    }
+  }
+  GIVEN("Values of enclosing functions with the same name") {
+    std::string java = Compile(R"(
+let
+  function run(n: int): int =
+    let
+      function f(n: int): int =
+        let function g(): int = n + h() in g() end
+      function h(): int = n
+    in
+      f(n)
+    end
+in
+  run(3)
+end)");
+    THEN("parameters for them get the id of their scope appended") {
+      REQUIRE_THAT(java, ContainsSubstring("static int f(int n_2, int n) {"));
+      REQUIRE_THAT(java, ContainsSubstring("static int g(int n_2, int n_4) {\n                n_4 + h(n_2);"));
+      REQUIRE_THAT(java, ContainsSubstring("static int h(int n) {"));
+    }
+  }
+  GIVEN("Variables of the main program used by functions") {
+    std::string java = Compile(R"(
+let
+  var count := 0
+  var i := 1
+  function bump(i: int) = count := count + i
+in
+  bump(i);
+  let var count := 2 in bump(count) end
+end)");
+    THEN("they are static fields") {
+      REQUIRE_THAT(java, ContainsSubstring("class Main {\n\n  static int count_1;\n\n  public static void main("));
+      REQUIRE_THAT(java, ContainsSubstring("count_1 = 0;\n      int i = 1;"));
+      REQUIRE_THAT(java, ContainsSubstring("static void bump(int i) {\n        count_1 = count_1 + i;"));
+      REQUIRE_THAT(java, !ContainsSubstring("Scope"));
+    }
+  }
+  GIVEN("A program nested a million levels deep") {
+    std::string java = Compile(testing::DeepProgram(1000000));
+    THEN("its chains compile without exhausting the stack") {
+      REQUIRE(java.find("int sum = 1 + 1 + 1") != std::string::npos);
+      REQUIRE(java.find("(sum == 0 ? 0 : (sum == 1 ? 1 : ") != std::string::npos);
+    }
+  }
+  GIVEN("Lets, sequences, calls and loop bodies nested deeply") {
+    THEN("those nested a third as deep as the limit are compiled") {
+      for (const std::string& text : testing::DeepNestings(java::kMaxNesting / 3)) {
+        REQUIRE_THAT(Compile(text), ContainsSubstring("class Main {"));
+      }
+    }
+    THEN("those nested far deeper are an error rather than exhausting the stack") {
+      for (const std::string& text : testing::DeepNestings(java::kMaxNesting * 100)) {
+        REQUIRE_THROWS_AS(Compile(text), std::length_error);
+      }
+    }
+  }
+  GIVEN("An else-if chain without value") {
+    REQUIRE_THAT(Compile("if 1 then print(\"a\") else if 2 then print(\"b\") else print(\"c\")"),
+                 ContainsSubstring(R"(if (1 != 0) {
+      Std.print("a");
+    } else if (2 != 0) {
+      Std.print("b");
+    } else {
+      Std.print("c");
+    })"));
+  }
+  GIVEN("Conditions and values of comparisons, & and |") {
+    std::string java = Compile(R"(
+      let var a := 1 var b := 2
+      in while not(a > b) | (a = 5 & b) do a := a + 1;
+         a := a < b; a := a & b = 2; a := a | b
+      end)");
+    THEN("conditions are Java booleans") {
+      REQUIRE_THAT(java, ContainsSubstring("while (!(a > b) || (a == 5 && b != 0)) {"));
+    }
+    THEN("values are ints") {
+      REQUIRE_THAT(java, ContainsSubstring("a = (a < b ? 1 : 0);"));
+      REQUIRE_THAT(java, ContainsSubstring("a = (a != 0 ? (b == 2 ? 1 : 0) : 0);"));
+      REQUIRE_THAT(java, ContainsSubstring("a = (a != 0 ? 1 : b);"));
+    }
+  }
+  GIVEN("Comparisons of strings") {
+    std::string java = Compile(R"(
+      let var s := getchar() var n := 0
+      in if s = "a" | concat(s, s) <> "bb" then n := s < "c"
+      end)");
+    THEN("they compare the characters of the strings") {
+      REQUIRE_THAT(java, ContainsSubstring("if (s.equals(\"a\") || !s.concat(s).equals(\"bb\")) {"));
+      REQUIRE_THAT(java, ContainsSubstring("n = (s.compareTo(\"c\") < 0 ? 1 : 0);"));
+    }
+  }
+  GIVEN("Calls of library functions of a few operators") {
+    std::string java = Compile(R"(
+      let var s := "ab" var i := 0
+      in i := size(concat(s, chr(i + 1))); i := ord(s) + ord("0") + ord(substring(s, i, 1)); i := not(i > 1);
+         s := substring(concat(s, s), i * 2, 1); i := ord(getchar())
+      end)");
+    THEN("they are those operators instead of calls of class Std") {
+      REQUIRE_THAT(java, ContainsSubstring("i = s.concat(Std.chr(i + 1)).length();"));
+      REQUIRE_THAT(java, ContainsSubstring("i = (s.isEmpty() ? -1 : s.charAt(0)) + 48 + "));
+      REQUIRE_THAT(java, ContainsSubstring("Std.ord(s.substring(i, i + 1));"));
+      REQUIRE_THAT(java, ContainsSubstring("i = (i > 1 ? 0 : 1);"));
+    }
+    THEN("those that would evaluate an argument twice are not") {
+      REQUIRE_THAT(java, ContainsSubstring("s = Std.substring(s.concat(s), i * 2, 1);"));
+      REQUIRE_THAT(java, ContainsSubstring("i = Std.ord(Std.getChar());"));
+    }
+  }
   GIVEN("8 Queens") {
     REQUIRE_THAT(Compile(R"(
 let
@@ -82,73 +236,53 @@ in try(0) end
 )"),
                  Equals(R"(import java.util.Arrays;
 
-class Scope1 {
-  public Scope0 parent;
-  public int N;
-  public int[] row;
-  public int[] col;
-  public int[] diag1;
-  public int[] diag2;
-}
-
-class Scope2 {
-  public Scope1 parent;
-}
-
-class Scope3 {
-  public Scope1 parent;
-  public int c;
-}
-
 class Main {
 
+  static int N;
+  static int[] row;
+  static int[] col;
+  static int[] diag1;
+  static int[] diag2;
+
   public static void main(String[] args) {
-    Scope0 _scope0 = new Scope0();
     {
-      Scope1 _scope1 = new Scope1();
-      _scope1.parent = _scope0;
-      _scope1.N = 8;
-      _scope1.row = new int[_scope1.N];
-      Arrays.fill(_scope1.row, 0);
-      _scope1.col = new int[_scope1.N];
-      Arrays.fill(_scope1.col, 0);
-      _scope1.diag1 = new int[_scope1.N + _scope1.N - 1];
-      Arrays.fill(_scope1.diag1, 0);
-      _scope1.diag2 = new int[_scope1.N + _scope1.N - 1];
-      Arrays.fill(_scope1.diag2, 0);
-      _try(_scope1, 0);
+      N = 8;
+      row = new int[N];
+      Arrays.fill(row, 0);
+      col = new int[N];
+      Arrays.fill(col, 0);
+      diag1 = new int[N + N - 1];
+      Arrays.fill(diag1, 0);
+      diag2 = new int[N + N - 1];
+      Arrays.fill(diag2, 0);
+      _try(0);
     }
   }
 
-      static void printboard(Scope1 _scope1) {
-        Scope2 _scope2 = new Scope2();
-        _scope2.parent = _scope1;
-        for (int i = 0; i <= _scope1.N - 1; i++) {
-          for (int j = 0; j <= _scope1.N - 1; j++) {
-            System.out.print((_scope1.col[i] == j ? " O" : " ."));
+      static void printboard() {
+        for (int i = 0; i <= N - 1; i++) {
+          for (int j = 0; j <= N - 1; j++) {
+            Std.print((col[i] == j ? " O" : " ."));
           }
-          System.out.print("\n");
+          Std.print("\n");
         }
-        System.out.print("\n");
+        Std.print("\n");
       }
 
-      static void _try(Scope1 _scope1, int c) {
-        Scope3 _scope3 = new Scope3();
-        _scope3.parent = _scope1;
-        _scope3.c = c;
-        if (_scope3.c == _scope1.N) {
-          printboard(_scope1);
+      static void _try(int c) {
+        if (c == N) {
+          printboard();
         } else {
-          for (int r = 0; r <= _scope1.N - 1; r++) {
-            if (_scope1.row[r] == 0 && _scope1.diag1[r + _scope3.c] == 0 && _scope1.diag2[r + 7 - _scope3.c] == 0) {
-              _scope1.row[r] = 1;
-              _scope1.diag1[r + _scope3.c] = 1;
-              _scope1.diag2[r + 7 - _scope3.c] = 1;
-              _scope1.col[_scope3.c] = r;
-              _try(_scope1, _scope3.c + 1);
-              _scope1.row[r] = 0;
-              _scope1.diag1[r + _scope3.c] = 0;
-              _scope1.diag2[r + 7 - _scope3.c] = 0;
+          for (int r = 0; r <= N - 1; r++) {
+            if (row[r] == 0 && diag1[r + c] == 0 && diag2[r + 7 - c] == 0) {
+              row[r] = 1;
+              diag1[r + c] = 1;
+              diag2[r + 7 - c] = 1;
+              col[c] = r;
+              _try(c + 1);
+              row[r] = 0;
+              diag1[r + c] = 0;
+              diag2[r + 7 - c] = 0;
             }
           }
         }
@@ -0,0 +1,72 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Indices left to one thread. The owner takes them from the front, and other
+// threads steal from the back.
+struct Range {
+  std::mutex mutex;
+  size_t begin = 0;
+  size_t end = 0;
+};
+
+// Returns the next index of the given range, or false if it is empty.
+bool Take(Range& r, size_t& index) {
+  std::lock_guard lock(r.mutex);
+  if (r.begin == r.end) return false;
+  index = r.begin++;
+  return true;
+}
+
+// Moves the back half of the victim's indices to the thief's range, which is
+// empty. Returns false if there was nothing to steal.
+bool Steal(Range& victim, Range& thief) {
+  size_t begin, end;
+  {
+    std::lock_guard lock(victim.mutex);
+    if (victim.begin == victim.end) return false;
+    end = victim.end;
+    begin = victim.begin + (victim.end - victim.begin) / 2;
+    victim.end = begin;
+  }
+  std::lock_guard lock(thief.mutex);
+  thief.begin = begin;
+  thief.end = end;
+  return true;
+}
+
+}  // namespace
+
+void ParallelFor(size_t count, int threads, const std::function<void(size_t)>& task) {
+  size_t n = std::clamp<size_t>(threads, 1, std::max<size_t>(count, 1));
+  if (n == 1) {
+    for (size_t i = 0; i < count; ++i) task(i);
+    return;
+  }
+  std::vector<std::unique_ptr<Range>> ranges;
+  for (size_t t = 0; t < n; ++t) {
+    ranges.push_back(std::make_unique<Range>());
+    ranges[t]->begin = count * t / n;
+    ranges[t]->end = count * (t + 1) / n;
+  }
+  // No task adds indices, so a thread that finds all ranges empty is done.
+  auto work = [&](size_t self) {
+    for (;;) {
+      size_t index;
+      while (Take(*ranges[self], index)) task(index);
+      bool stolen = false;
+      for (size_t k = 1; k < n && !stolen; ++k) stolen = Steal(*ranges[(self + k) % n], *ranges[self]);
+      if (!stolen) return;
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < n; ++t) workers.emplace_back(work, t);
+  work(0);
+  for (auto& w : workers) w.join();
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Calls task(i) for every i in [0, count) on the given number of threads,
+// including the calling one, and returns when all calls are done. The other
+// threads are started by each call and joined before it returns; no pool of
+// threads is kept between calls. Each thread starts with an equal share of the
+// indices and, once done with it, steals half of what is left to another
+// thread, so that tasks of uneven cost keep all threads busy. With one thread,
+// the tasks run in order on the calling thread.
+void ParallelFor(size_t count, int threads, const std::function<void(size_t)>& task);
@@ -0,0 +1,42 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+
+SCENARIO("ParallelFor", "[parallel]") {
+  GIVEN("Tasks of uneven cost on several threads") {
+    constexpr size_t kCount = 1000;
+    std::vector<std::atomic<int>> calls(kCount);
+    ParallelFor(kCount, 8, [&](size_t i) {
+      // The first tasks are the slow ones, so threads must steal to finish.
+      if (i < 10) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      calls[i]++;
+    });
+    THEN("every task runs exactly once") {
+      for (size_t i = 0; i < kCount; ++i) REQUIRE(calls[i] == 1);
+    }
+  }
+  GIVEN("One thread") {
+    std::vector<size_t> order;
+    std::thread::id caller = std::this_thread::get_id();
+    bool on_caller = true;
+    ParallelFor(5, 1, [&](size_t i) {
+      order.push_back(i);
+      on_caller = on_caller && std::this_thread::get_id() == caller;
+    });
+    THEN("tasks run in order on the calling thread") {
+      REQUIRE(order == std::vector<size_t>{0, 1, 2, 3, 4});
+      REQUIRE(on_caller);
+    }
+  }
+  GIVEN("More threads than tasks") {
+    std::atomic<int> calls = 0;
+    ParallelFor(3, 16, [&](size_t) { calls++; });
+    ParallelFor(0, 16, [&](size_t) { calls++; });
+    THEN("every task runs once") { REQUIRE(calls == 3); }
+  }
+}
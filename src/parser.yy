@@ -10,11 +10,18 @@
 {
 #include "syntax.h"
 #include <string>
+#include <string_view>
 class Driver;
 using namespace syntax;
+// Opaque handle of the reentrant scanner, as declared by flex.
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
 }
-// The parsing context.
+// The parsing context and the scanner state, both owned by the Driver.
 %param { Driver& driver }
+%param { yyscan_t yyscanner }
 %locations
 %initial-action
 {
@@ -73,17 +80,17 @@ using namespace syntax;
   WHILE	  "while"
   SEMICOLON ";"
 ;
-%token <std::string> IDENTIFIER "identifier"
-%token <std::string> STRING_CONSTANT "string"
+%token <Symbol> IDENTIFIER "identifier"
+%token <std::string_view> STRING_CONSTANT "string"
 %token <int> NUMBER "number"
-%type  <std::unique_ptr<Expr>> expr
-%type  <std::unique_ptr<LValue>> l_value l_value_not_id
-%type  <std::vector<std::unique_ptr<Expr>>> expr_list expr_list_opt expr_seq expr_seq_opt
+%type  <ArenaPtr<Expr>> expr
+%type  <ArenaPtr<LValue>> l_value l_value_not_id
+%type  <std::vector<ArenaPtr<Expr>>> expr_list expr_list_opt expr_seq expr_seq_opt
 %type  <std::vector<FieldAssignment>> field_list field_list_opt
-%type  <std::vector<std::unique_ptr<Declaration>>> declaration_list
-%type  <std::unique_ptr<Declaration>> declaration type_declaration variable_declaration function_declaration
+%type  <std::vector<ArenaPtr<Declaration>>> declaration_list
+%type  <ArenaPtr<Declaration>> declaration type_declaration variable_declaration function_declaration
 %type  <Type> type
-%type  <TypeFields> type_fields_opt type_fields
+%type  <std::vector<TypeField>> type_fields_opt type_fields
 %type  <TypeField> type_field
 
 %left ";";
@@ -102,16 +109,16 @@ using namespace syntax;
 
 %%
 %start unit;
-unit: expr  { driver.result = $1; }
+unit: expr  { driver.set_result($1); }
 ;
 l_value:
-  "identifier" { $$ = std::make_unique<LValue>($1); }
+  "identifier" { $$ = driver.arena().New<LValue>($1); }
 | l_value_not_id { $$ = $1; }
 ;
 l_value_not_id:
-  l_value "." "identifier" { $$ = std::make_unique<LValue>(RecordField{$1, $3}); }
-| "identifier" "[" expr "]" { $$ = std::make_unique<LValue>(ArrayElement{std::make_unique<LValue>($1), $3}); }
-| l_value_not_id "[" expr "]" { $$ = std::make_unique<LValue>(ArrayElement{$1, $3}); }
+  l_value "." "identifier" { $$ = driver.arena().New<LValue>(RecordField{$1, $3}); }
+| "identifier" "[" expr "]" { $$ = driver.arena().New<LValue>(ArrayElement{driver.arena().New<LValue>($1), $3}); }
+| l_value_not_id "[" expr "]" { $$ = driver.arena().New<LValue>(ArrayElement{$1, $3}); }
 ;
 expr_list:
   expr { $$.emplace_back($1);}
@@ -133,37 +140,37 @@ field_list_opt: %empty {} | field_list { $$ = $1; }
 ;
 expr:
   "string"    {
-    std::string quoted = $1;
-    $$ = std::make_unique<Expr>(StringConstant{quoted.substr(1, quoted.size()-2)});
+    std::string_view quoted = $1;
+    $$ = NewExpr(driver.arena(), driver.counts(), StringConstant{quoted.substr(1, quoted.size()-2)});
   }
-| "number"    { $$ = std::make_unique<Expr>(IntegerConstant{$1}); }
-| "nil"       { $$ = std::make_unique<Expr>(Nil{}); }
-| l_value_not_id { $$ = std::make_unique<Expr>($1); }
-| "identifier" { $$ = std::make_unique<Expr>(std::make_unique<LValue>($1)); }
-| "-" expr     { $$ = std::make_unique<Expr>(Negated{$2}); }
-| expr "+" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kPlus, $3}); }
-| expr "-" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kMinus, $3}); }
-| expr "*" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kTimes, $3}); }
-| expr "/" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kDivide, $3}); }
-| expr "=" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kEqual, $3}); }
-| expr "<>" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kUnequal, $3}); }
-| expr "<" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kLessThan, $3}); }
-| expr ">" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kGreaterThan, $3}); }
-| expr "<=" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kNotGreaterThan, $3}); }
-| expr ">=" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kNotLessThan, $3}); }
-| expr "&" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kAnd, $3}); }
-| expr "|" expr { $$ = std::make_unique<Expr>(Binary{$1, BinaryOp::kOr, $3}); }
-| l_value ":=" expr { $$ = std::make_unique<Expr>(Assignment{std::unique_ptr<LValue>($1), $3}); }
-| "identifier" "(" expr_list_opt ")" { $$ = std::make_unique<Expr>(FunctionCall{$1, $3}); }
-| "(" expr_seq_opt ")" { $$ = std::make_unique<Expr>(Parenthesized{$2}); }
-| "identifier" "{" field_list_opt "}" { $$ = std::make_unique<Expr>(RecordLiteral{$1, $3}); }
-| "identifier" "[" expr "]" "of" expr { $$ = std::make_unique<Expr>(ArrayLiteral{$1, $3, $6}); }
-| "if" expr "then" expr { $$ = std::make_unique<Expr>(IfThen{$2, $4}); }
-| "if" expr "then" expr "else" expr { $$ = std::make_unique<Expr>(IfThenElse{$2, $4, $6}); }
-| "while" expr "do" expr { $$ = std::make_unique<Expr>(While{$2, $4}); }
-| "for" "identifier" ":=" expr "to" expr "do" expr { $$ = std::make_unique<Expr>(For{$2, $4, $6, $8}); }
-| "break" { $$ = std::make_unique<Expr>(Break{}); }
-| "let" declaration_list "in" expr_seq_opt "end" { $$ = std::make_unique<Expr>(Let{$2, $4}); }
+| "number"    { $$ = NewExpr(driver.arena(), driver.counts(), IntegerConstant{$1}); }
+| "nil"       { $$ = NewExpr(driver.arena(), driver.counts(), Nil{}); }
+| l_value_not_id { $$ = NewExpr(driver.arena(), driver.counts(), $1); }
+| "identifier" { $$ = NewExpr(driver.arena(), driver.counts(), driver.arena().New<LValue>($1)); }
+| "-" expr     { $$ = NewExpr(driver.arena(), driver.counts(), Negated{$2}); }
+| expr "+" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kPlus, $3}); }
+| expr "-" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kMinus, $3}); }
+| expr "*" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kTimes, $3}); }
+| expr "/" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kDivide, $3}); }
+| expr "=" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kEqual, $3}); }
+| expr "<>" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kUnequal, $3}); }
+| expr "<" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kLessThan, $3}); }
+| expr ">" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kGreaterThan, $3}); }
+| expr "<=" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kNotGreaterThan, $3}); }
+| expr ">=" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kNotLessThan, $3}); }
+| expr "&" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kAnd, $3}); }
+| expr "|" expr { $$ = NewExpr(driver.arena(), driver.counts(), Binary{$1, BinaryOp::kOr, $3}); }
+| l_value ":=" expr { $$ = NewExpr(driver.arena(), driver.counts(), Assignment{$1, $3}); }
+| "identifier" "(" expr_list_opt ")" { $$ = NewExpr(driver.arena(), driver.counts(), FunctionCall{$1, driver.arena().NewArray($3)}); }
+| "(" expr_seq_opt ")" { $$ = NewExpr(driver.arena(), driver.counts(), Parenthesized{driver.arena().NewArray($2)}); }
+| "identifier" "{" field_list_opt "}" { $$ = NewExpr(driver.arena(), driver.counts(), RecordLiteral{$1, driver.arena().NewArray($3)}); }
+| "identifier" "[" expr "]" "of" expr { $$ = NewExpr(driver.arena(), driver.counts(), ArrayLiteral{$1, $3, $6}); }
+| "if" expr "then" expr { $$ = NewExpr(driver.arena(), driver.counts(), IfThen{$2, $4}); }
+| "if" expr "then" expr "else" expr { $$ = NewExpr(driver.arena(), driver.counts(), IfThenElse{$2, $4, $6}); }
+| "while" expr "do" expr { $$ = NewExpr(driver.arena(), driver.counts(), While{$2, $4}); }
+| "for" "identifier" ":=" expr "to" expr "do" expr { $$ = NewExpr(driver.arena(), driver.counts(), For{$2, $4, $6, $8}); }
+| "break" { $$ = NewExpr(driver.arena(), driver.counts(), Break{}); }
+| "let" declaration_list "in" expr_seq_opt "end" { $$ = NewExpr(driver.arena(), driver.counts(), Let{driver.arena().NewArray($2), driver.arena().NewArray($4)}); }
 ;
 declaration_list:
   declaration { $$.emplace_back($1); }
@@ -175,11 +182,11 @@ declaration:
 | function_declaration { $$ = $1; }
 ;
 type_declaration:
-  "type" "identifier" "=" type { $$ = std::make_unique<Declaration>(TypeDeclaration{$2, $4}); }
+  "type" "identifier" "=" type { $$ = NewDeclaration(driver.arena(), driver.counts(), TypeDeclaration{$2, $4}); }
 ;
 type:
   "identifier" { $$ = TypeId{$1}; }
-| "{" type_fields_opt "}" { $$ = $2; }
+| "{" type_fields_opt "}" { $$ = driver.arena().NewArray($2); }
 | "array" "of" "identifier" { $$ = ArrayType{$3}; }
 ;
 type_fields:
@@ -190,12 +197,12 @@ type_field: "identifier" ":" "identifier" { $$ = {$1, $3}; }
 ;
 type_fields_opt: %empty {} | type_fields { $$ = $1; };
 variable_declaration:
-"var" "identifier" ":=" expr { $$ = std::make_unique<Declaration>(VariableDeclaration{$2, $4, {}}); }
-| "var" "identifier" ":" "identifier" ":=" expr { $$ = std::make_unique<Declaration>(VariableDeclaration{$2, $6, $4}); }
+"var" "identifier" ":=" expr { $$ = NewDeclaration(driver.arena(), driver.counts(), VariableDeclaration{$2, $4, {}}); }
+| "var" "identifier" ":" "identifier" ":=" expr { $$ = NewDeclaration(driver.arena(), driver.counts(), VariableDeclaration{$2, $6, $4}); }
 ;
 function_declaration:
-"function" "identifier" "(" type_fields_opt ")" "=" expr { $$ = std::make_unique<Declaration>(FunctionDeclaration{$2, $4, $7, {}}); }
-| "function" "identifier" "(" type_fields_opt ")" ":" "identifier" "=" expr { $$ = std::make_unique<Declaration>(FunctionDeclaration{$2, $4, $9, $7}); }
+"function" "identifier" "(" type_fields_opt ")" "=" expr { $$ = NewDeclaration(driver.arena(), driver.counts(), FunctionDeclaration{$2, driver.arena().NewArray($4), $7, {}}); }
+| "function" "identifier" "(" type_fields_opt ")" ":" "identifier" "=" expr { $$ = NewDeclaration(driver.arena(), driver.counts(), FunctionDeclaration{$2, driver.arena().NewArray($4), $9, $7}); }
 ;
 %%
 void yy::Parser::error(const location_type& l, const std::string& m) {
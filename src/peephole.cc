@@ -0,0 +1,171 @@
+#include "peephole.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "assembler.h"
+#include "instruction.h"
+
+namespace peephole {
+namespace {
+
+using assembler::Op;
+
+bool IsLoad(uint8_t op) { return op >= _iload && op <= _aload; }
+bool EndsFlow(uint8_t op) { return op == _goto || (op >= _ireturn && op <= _return) || op == _athrow; }
+
+// Returns the int the given instruction pushes if it is a constant that holds
+// it in its operands.
+std::optional<int> IntConstant(const Op& op) {
+  if (op.opcode >= _iconst_m1 && op.opcode <= _iconst_5) return op.opcode - _iconst_0;
+  if (op.opcode == _bipush) return static_cast<int8_t>(op.operands[0]);
+  if (op.opcode == _sipush) {
+    return static_cast<int16_t>(static_cast<uint8_t>(op.operands[0]) << 8 | static_cast<uint8_t>(op.operands[1]));
+  }
+  return {};
+}
+
+// Whether the given instruction pushes one slot and does nothing else.
+bool PushesOnly(const Op& op) {
+  return op.opcode == _iload || op.opcode == _fload || op.opcode == _aload || op.opcode == _aconst_null ||
+         op.opcode == _dup || IntConstant(op).has_value();
+}
+
+// Drops the removed instructions and those that no path from the first
+// reaches. Jumps to removed instructions go to the next one kept.
+void Compact(std::vector<Op>& ops, std::vector<bool>& removed) {
+  std::vector<bool> reached(ops.size());
+  std::vector<size_t> pending = {0};
+  while (!pending.empty()) {
+    size_t i = pending.back();
+    pending.pop_back();
+    for (; i < ops.size() && !reached[i]; ++i) {
+      reached[i] = true;
+      if (ops[i].target >= 0 && !removed[i]) pending.push_back(ops[i].target);
+      if (!removed[i] && EndsFlow(ops[i].opcode)) break;
+    }
+  }
+  std::vector<int> new_index(ops.size() + 1);
+  int kept = 0;
+  for (size_t i = 0; i < ops.size(); ++i) {
+    new_index[i] = kept;
+    if (!reached[i] || removed[i]) continue;
+    if (static_cast<int>(i) != kept) ops[kept] = std::move(ops[i]);
+    ++kept;
+  }
+  new_index[ops.size()] = kept;
+  ops.erase(ops.begin() + kept, ops.end());
+  for (Op& op : ops) {
+    if (op.target >= 0) op.target = new_index[op.target];
+  }
+}
+
+// Rewrites the given instructions once. Returns whether any changed.
+bool Simplify(std::vector<Op>& ops) {
+  bool changed = false;
+  size_t count = ops.size();
+  for (Op& op : ops) {
+    if (op.target < 0) continue;
+    int target = op.target;
+    for (size_t steps = 0; ops[target].opcode == _goto && steps < count; ++steps) target = ops[target].target;
+    if (target != op.target) {
+      op.target = target;
+      changed = true;
+    }
+  }
+
+  std::vector<bool> is_target(count);
+  for (const Op& op : ops) {
+    if (op.target >= 0) is_target[op.target] = true;
+  }
+  std::vector<bool> removed(count);
+  // Whether the instructions after the given one up to the given number of
+  // them follow it on every path.
+  auto straight = [&](size_t i, size_t length) {
+    if (i + length > count) return false;
+    for (size_t j = i + 1; j < i + length; ++j) {
+      if (is_target[j]) return false;
+    }
+    return true;
+  };
+  auto remove = [&](size_t i, size_t length) {
+    for (size_t j = i; j < i + length; ++j) removed[j] = true;
+    changed = true;
+  };
+  for (size_t i = 0; i < count; ++i) {
+    Op& op = ops[i];
+    if (op.target == static_cast<int>(i + 1)) {
+      // goto to the next instruction, or a conditional one that only pops.
+      if (op.opcode == _goto) {
+        remove(i, 1);
+      } else {
+        op = Op(op.opcode >= _if_icmpeq && op.opcode <= _if_acmpne ? _pop2 : _pop);
+        changed = true;
+      }
+      continue;
+    }
+    if (op.target >= 0 && op.opcode != _goto && straight(i, 2) && ops[i + 1].opcode == _goto &&
+        op.target == static_cast<int>(i + 2)) {
+      op.opcode = assembler::Inverted(op.opcode);
+      op.target = ops[i + 1].target;
+      remove(i + 1, 1);
+      ++i;
+      continue;
+    }
+    if (op.opcode == _goto && ops[op.target].opcode >= _ireturn && ops[op.target].opcode <= _return) {
+      op = Op(ops[op.target].opcode);
+      changed = true;
+      continue;
+    }
+    if (straight(i, 4) && ops[i + 3].opcode == _istore) {
+      // i := i + c and i := i - c
+      std::optional<int> increment;
+      int local = ops[i + 3].local;
+      uint8_t arithmetic = ops[i + 2].opcode;
+      if (op.opcode == _iload && op.local == local && (arithmetic == _iadd || arithmetic == _isub)) {
+        increment = IntConstant(ops[i + 1]);
+        if (increment && arithmetic == _isub) increment = -*increment;
+      } else if (ops[i + 1].opcode == _iload && ops[i + 1].local == local && arithmetic == _iadd) {
+        increment = IntConstant(op);
+      }
+      if (increment && *increment >= INT16_MIN && *increment <= INT16_MAX) {
+        op = Op(_iinc);
+        op.local = local;
+        op.increment = *increment;
+        remove(i + 1, 3);
+        i += 3;
+        continue;
+      }
+    }
+    if (straight(i, 2) && IsLoad(op.opcode) && ops[i + 1].opcode == op.opcode - _iload + _istore &&
+        ops[i + 1].local == op.local) {
+      remove(i, 2);
+      ++i;
+      continue;
+    }
+    if (straight(i, 2) && PushesOnly(op) && ops[i + 1].opcode == _pop) {
+      remove(i, 2);
+      ++i;
+      continue;
+    }
+  }
+  Compact(ops, removed);
+  return changed;
+}
+
+}  // namespace
+
+void Optimize(std::vector<Op>& ops) {
+  while (Simplify(ops)) {
+  }
+}
+
+std::string Optimize(std::string_view code) {
+  std::optional<std::vector<Op>> ops = assembler::Decode(code);
+  if (!ops) return std::string(code);
+  Optimize(*ops);
+  return assembler::Encode(*ops);
+}
+
+}  // namespace peephole
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assembler.h"
+
+// Peephole optimization of the code of JVM methods.
+namespace peephole {
+
+// Rewrites the given instructions of a method: jumps to gotos go to where
+// those go, conditional jumps over a goto are inverted, jumps to the next
+// instruction are dropped, gotos to a return are the return, i := i + c is
+// folded into iinc, and loads and constants that are popped right away or
+// stored where they came from are dropped. Repeats this until nothing
+// changes, and drops the code that is then unreachable. Instructions are
+// rewritten only where no jump goes between them.
+void Optimize(std::vector<assembler::Op>& ops);
+
+// Returns the given code optimized, or as it is if it has instructions that
+// assembler::Decode does not know, like tableswitch.
+std::string Optimize(std::string_view code);
+
+}  // namespace peephole
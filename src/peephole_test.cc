@@ -0,0 +1,75 @@
+#include "peephole.h"
+
+#include <cstdint>
+#include <string>
+
+#include "catch2/catch_test_macros.hpp"
+#include "instruction.h"
+#include "testing/testing.h"
+
+namespace {
+
+using testing::Code;
+
+SCENARIO("Peephole optimization", "[peephole]") {
+  GIVEN("Assignments adding constants to an int local") {
+    THEN("they are folded into iinc") {
+      REQUIRE(peephole::Optimize(Code({_iload_1, _iconst_1, _iadd, _istore_1, _return})) ==
+              Code({_iinc, 1, 1, _return}));
+      REQUIRE(peephole::Optimize(Code({_iload_1, _iconst_5, _isub, _istore_1, _return})) ==
+              Code({_iinc, 1, 0xfb, _return}));
+    }
+    THEN("constants taking more than a byte make a wide iinc") {
+      REQUIRE(peephole::Optimize(Code({_sipush, 0x03, 0xe8, _iload, 5, _iadd, _istore, 5, _return})) ==
+              Code({_wide, _iinc, 0, 5, 0x03, 0xe8, _return}));
+    }
+    THEN("those storing into another local are kept") {
+      std::string code = Code({_iload_1, _iconst_1, _iadd, _istore_2, _return});
+      REQUIRE(peephole::Optimize(code) == code);
+    }
+  }
+  GIVEN("Values that are popped or stored where they came from") {
+    THEN("they are dropped") {
+      REQUIRE(peephole::Optimize(Code({_iload_1, _istore_1, _aload_0, _pop, _bipush, 7, _pop, _return})) ==
+              Code({_return}));
+    }
+  }
+  GIVEN("Jumps to the next instruction") {
+    THEN("gotos are dropped, and conditional ones only pop") {
+      REQUIRE(peephole::Optimize(Code({_goto, 0, 3, _iload_0, _iconst_1, _iadd, _ifeq, 0, 3, _return})) ==
+              Code({_iload_0, _iconst_1, _iadd, _pop, _return}));
+    }
+  }
+  GIVEN("A jump to a goto going to a return") {
+    std::string code = Code({_iload_0, _ifeq, 0, 7, _iinc, 0, 1, _return, _goto, 0xff, 0xff});
+    THEN("the jump goes to the return, and the goto is dropped") {
+      REQUIRE(peephole::Optimize(code) == Code({_iload_0, _ifeq, 0, 6, _iinc, 0, 1, _return}));
+    }
+  }
+  GIVEN("A conditional jump over a goto") {
+    std::string code = Code({_iload_0, _ifeq, 0, 6, _goto, 0, 6, _iinc, 0, 1, _iinc, 0, 2, _return});
+    THEN("it is inverted to go where the goto went") {
+      REQUIRE(peephole::Optimize(code) == Code({_iload_0, _ifne, 0, 6, _iinc, 0, 1, _iinc, 0, 2, _return}));
+    }
+  }
+  GIVEN("A goto to a return") {
+    THEN("it is the return") {
+      REQUIRE(peephole::Optimize(Code({_iload_0, _ifeq, 0, 9, _iinc, 0, 1, _goto, 0, 6, _iinc, 0, 2, _return})) ==
+              Code({_iload_0, _ifeq, 0, 7, _iinc, 0, 1, _return, _iinc, 0, 2, _return}));
+    }
+  }
+  GIVEN("Instructions that a jump goes between") {
+    std::string code = Code({_iload_1, _iconst_1, _iadd, _istore_1, _iload_0, _ifeq, 0xff, 0xfc, _return});
+    THEN("they are kept") { REQUIRE(peephole::Optimize(code) == code); }
+  }
+  GIVEN("A loop of a goto to itself") {
+    std::string code = Code({_goto, 0, 0});
+    THEN("it is kept") { REQUIRE(peephole::Optimize(code) == code); }
+  }
+  GIVEN("Code with instructions the optimizer does not know") {
+    std::string code = Code({_iconst_0, _pop, _iconst_0, _lookupswitch, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+    THEN("it is kept") { REQUIRE(peephole::Optimize(code) == code); }
+  }
+}
+
+}  // namespace
@@ -11,17 +11,11 @@
 // not conform to C89.  See Debian bug 333231
 // <http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=333231>.
 # undef yywrap
-# define yywrap() 1
-
-// The location of the current token.
-static yy::location loc;
-
-// For comment nesting.
-static int comment_depth;
+# define yywrap(yyscanner) 1
 
 extern "C" int fileno(FILE *);
 %}
-%option noyywrap nounput batch debug noinput
+%option reentrant noyywrap nounput batch debug noinput
 
 %x C_COMMENT
 
@@ -38,14 +32,16 @@ string \"[^\"]*\"
 %%
 
 %{
-  // Code run each time yylex is called.
+  // Code run each time yylex is called. The location of the current token
+  // lives in the Driver, so concurrent scanners do not share state.
+  yy::location& loc = driver.location;
   loc.step();
 %}
 
 {blank}+   loc.step ();
 [\n]+      loc.lines (yyleng); loc.step ();
 
-"/*"     { comment_depth = 1; BEGIN(C_COMMENT); }
+"/*"     { driver.comment_depth = 1; BEGIN(C_COMMENT); }
 
 "&"      return yy::Parser::make_AND(loc);
 "("      return yy::Parser::make_LPAREN(loc);
@@ -96,8 +92,8 @@ string \"[^\"]*\"
   }
   return yy::Parser::make_NUMBER(n, loc);
 }
-{string}   return yy::Parser::make_STRING_CONSTANT(yytext, loc);
-{id}       return yy::Parser::make_IDENTIFIER(yytext, loc);
+{string}   return yy::Parser::make_STRING_CONSTANT(std::string_view(yytext, yyleng), loc);
+{id}       return yy::Parser::make_IDENTIFIER(syntax::Symbol(std::string_view(yytext, yyleng)), loc);
 .          driver.error(loc, std::string("invalid character '")+yytext+"'");
 <<EOF>>    {
   if (YY_START == C_COMMENT) {
@@ -107,8 +103,8 @@ string \"[^\"]*\"
  }
 
 <C_COMMENT>{
-  "/*"                { comment_depth++; loc.columns(yyleng); }
-  "*/"                { loc.columns(yyleng); if (--comment_depth == 0) BEGIN(INITIAL); }
+  "/*"                { driver.comment_depth++; loc.columns(yyleng); }
+  "*/"                { loc.columns(yyleng); if (--driver.comment_depth == 0) BEGIN(INITIAL); }
   [^*\n/]+            { loc.columns(yyleng); }
   \n                  { loc.lines(yyleng); loc.step(); }
   .                   { loc.columns(yyleng); }
@@ -116,14 +112,15 @@ string \"[^\"]*\"
 %%
 
 void Driver::scan_begin() {
-  loc.initialize();
-  yy_flex_debug = options_.trace_scanning;
-  if (file.empty() || file == "-") {
-    yyin = stdin;
-  } else if (!(yyin = fopen(file.c_str(), "r"))) {
-    error("cannot open " + file + ": " + strerror(errno));
-    exit(EXIT_FAILURE);
-  }
+  location.initialize();
+  comment_depth = 0;
+  yylex_init(&scanner_);
+  yyset_debug(options_.trace_scanning, scanner_);
+  // Scans in place, so tokens are views into the source buffer.
+  yy_scan_buffer(ast_->source->data(), ast_->source->scannable_size(), scanner_);
 }
 
-void Driver::scan_end() { fclose(yyin); }
+void Driver::scan_end() {
+  yylex_destroy(scanner_);
+  scanner_ = nullptr;
+}
@@ -0,0 +1,73 @@
+#include "source_buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+#include <iterator>
+
+namespace {
+// Returns the whole content of the given stream.
+std::string ReadAll(std::istream& in) { return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()}; }
+}  // namespace
+
+std::unique_ptr<SourceBuffer> SourceBuffer::FromText(std::string_view text) {
+  std::unique_ptr<SourceBuffer> result(new SourceBuffer());
+  result->storage_.reserve(text.size() + 2);
+  result->storage_.append(text);
+  result->storage_.append(2, '\0');
+  result->data_ = result->storage_.data();
+  result->size_ = text.size();
+  return result;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::FromFile(const std::string& file_name) {
+  if (file_name.empty() || file_name == "-") return FromText(ReadAll(std::cin));
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    // Pipes and devices cannot be mapped.
+    std::string text;
+    char chunk[1 << 16];
+    for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) > 0;) text.append(chunk, n);
+    close(fd);
+    return FromText(text);
+  }
+  // Reserve room for the text and the two NULs in zero-filled anonymous
+  // memory, then map the file privately over its start. Bytes past the end of
+  // the file in its last page read as zero too, so the NULs are present
+  // whether or not the file ends on a page boundary.
+  size_t size = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t length = (size + 2 + page - 1) / page * page;
+  void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return nullptr;
+  }
+  if (size > 0 && mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    int saved_errno = errno;
+    munmap(base, length);
+    close(fd);
+    errno = saved_errno;
+    return nullptr;
+  }
+  close(fd);
+  std::unique_ptr<SourceBuffer> result(new SourceBuffer());
+  result->data_ = static_cast<char*>(base);
+  result->size_ = size;
+  result->mapped_length_ = length;
+  return result;
+}
+
+SourceBuffer::~SourceBuffer() {
+  if (mapped_length_ > 0) munmap(data_, mapped_length_);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Tiger source text held in memory the way flex scans it in place: writable
+// and followed by two NUL bytes. Identifiers and string constants of a parsed
+// tree point into the text, so the buffer must outlive the tree.
+class SourceBuffer {
+ public:
+  // Returns a buffer holding a copy of the given text.
+  static std::unique_ptr<SourceBuffer> FromText(std::string_view text);
+
+  // Returns a buffer with the content of the named file, or of stdin if the
+  // name is empty or "-". Regular files are mapped privately into memory rather
+  // than read. Returns null and sets errno if the file cannot be read.
+  static std::unique_ptr<SourceBuffer> FromFile(const std::string& file_name);
+
+  ~SourceBuffer();
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+  // Returns the source text, excluding the trailing NUL bytes.
+  std::string_view text() const { return {data_, size_}; }
+
+  // Returns the start of the scannable bytes, which are the text followed by
+  // two NUL bytes. Scanning temporarily writes to them.
+  char* data() { return data_; }
+  size_t scannable_size() const { return size_ + 2; }
+
+ private:
+  SourceBuffer() = default;
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  // Length of the memory mapping at data_, or zero if data_ points into
+  // storage_.
+  size_t mapped_length_ = 0;
+  std::string storage_;
+};
@@ -0,0 +1,97 @@
+#include "symbol.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace syntax {
+namespace {
+
+// Texts interned up front, in the order of the constants in symbol.h.
+constexpr std::string_view kPredefined[] = {"", "int", "string", "nil", "NOTYPE"};
+
+// Thread-safe, append-only table of texts and their ids. Lookups of known
+// texts take a shared lock only, and texts of ids take no lock, as the views of
+// the texts never move once added.
+class Interner {
+ public:
+  Interner() {
+    for (std::string_view text : kPredefined) Add(text);
+  }
+
+  uint32_t Intern(std::string_view text) {
+    {
+      std::shared_lock lock(mutex_);
+      if (auto it = id_by_text_.find(text); it != id_by_text_.end()) return it->second;
+    }
+    std::unique_lock lock(mutex_);
+    if (auto it = id_by_text_.find(text); it != id_by_text_.end()) return it->second;
+    return Add(text);
+  }
+
+  // The id must come from Intern, which has added its text before returning
+  // it.
+  std::string_view Text(uint32_t id) const {
+    auto [chunk, offset] = Locate(id);
+    return chunks_[chunk].load(std::memory_order_acquire)[offset];
+  }
+
+ private:
+  // Views of the texts are kept in chunks, each twice as large as the one
+  // before, so that adding texts never moves those already there.
+  static constexpr uint32_t kFirstChunkSize = 256;
+  static constexpr int kChunks = 25;  // Enough for any uint32_t id.
+
+  // Returns the chunk of the given id and its offset in it.
+  static std::pair<int, uint32_t> Locate(uint32_t id) {
+    int chunk = std::bit_width(id / kFirstChunkSize + 1) - 1;
+    return {chunk, id - kFirstChunkSize * ((uint32_t{1} << chunk) - 1)};
+  }
+
+  // Copies the text into storage that is never freed. Callers must hold the
+  // exclusive lock.
+  uint32_t Add(std::string_view text) {
+    char* copy = static_cast<char*>(storage_.allocate(text.size() + 1, 1));
+    std::memcpy(copy, text.data(), text.size());
+    copy[text.size()] = '\0';
+    std::string_view stored(copy, text.size());
+    uint32_t id = size_++;
+    auto [chunk, offset] = Locate(id);
+    std::string_view* views = chunks_[chunk].load(std::memory_order_relaxed);
+    if (!views) {
+      views = static_cast<std::string_view*>(
+          storage_.allocate(sizeof(std::string_view) * (kFirstChunkSize << chunk), alignof(std::string_view)));
+      chunks_[chunk].store(views, std::memory_order_release);
+    }
+    new (&views[offset]) std::string_view(stored);
+    id_by_text_.emplace(stored, id);
+    return id;
+  }
+
+  std::shared_mutex mutex_;
+  std::pmr::monotonic_buffer_resource storage_;
+  uint32_t size_ = 0;
+  std::array<std::atomic<std::string_view*>, kChunks> chunks_{};
+  std::unordered_map<std::string_view, uint32_t> id_by_text_;
+};
+
+Interner& GetInterner() {
+  // Never destroyed, so symbols stay valid during static destruction.
+  static Interner* interner = new Interner();
+  return *interner;
+}
+
+}  // namespace
+
+uint32_t Symbol::Intern(std::string_view text) { return GetInterner().Intern(text); }
+
+std::string_view Symbol::str() const { return GetInterner().Text(id_); }
+
+}  // namespace syntax
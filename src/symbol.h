@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+namespace syntax {
+
+// Interned name of an identifier or type-id. Symbols with the same text have
+// the same id throughout the process, so comparing and hashing them is integer
+// work. The interner owns the text and keeps it for the rest of the process.
+class Symbol {
+ public:
+  // The empty name.
+  constexpr Symbol() = default;
+
+  // Interns the given text. May be called concurrently from several threads.
+  explicit Symbol(std::string_view text) : id_(Intern(text)) {}
+
+  // Only for the constants below, which are interned before any other text.
+  static constexpr Symbol Predefined(uint32_t id) {
+    Symbol s;
+    s.id_ = id;
+    return s;
+  }
+
+  // Returns the interned text.
+  std::string_view str() const;
+  uint32_t id() const { return id_; }
+  bool empty() const { return id_ == 0; }
+
+  friend bool operator==(Symbol a, Symbol b) { return a.id_ == b.id_; }
+  friend bool operator==(Symbol a, std::string_view b) { return a.str() == b; }
+
+ private:
+  static uint32_t Intern(std::string_view text);
+
+  uint32_t id_ = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, Symbol s) { return os << s.str(); }
+
+// Names of builtin types and pseudo types, in the order they are interned.
+inline constexpr Symbol kInt = Symbol::Predefined(1);
+inline constexpr Symbol kString = Symbol::Predefined(2);
+inline constexpr Symbol kNil = Symbol::Predefined(3);
+// Type of expressions without a value or with errors.
+inline constexpr Symbol kNoType = Symbol::Predefined(4);
+
+}  // namespace syntax
+
+template <>
+struct std::hash<syntax::Symbol> {
+  size_t operator()(syntax::Symbol s) const noexcept { return s.id(); }
+};
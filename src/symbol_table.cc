@@ -1,9 +1,11 @@
 #include "symbol_table.h"
 
+#include <deque>
 #include <iostream>
 #include <sstream>
-#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace {
 using namespace syntax;
@@ -14,28 +16,70 @@ const T* Lookup(const std::unordered_map<K, const T*>& map, K key) {
   return it != map.end() ? it->second : nullptr;
 }
 
-// Owns all Scopes and a map pointing each expression (by its address) to its
+// Scope of each node of one kind, indexed by NodeId.
+using ScopeByNode = std::vector<const Scope*>;
+// Type of each declaration of one kind, indexed by NodeId.
+using TypeByNode = std::vector<const types::Type*>;
+
+template <class T>
+T Lookup(const std::vector<T>& table, NodeId id) {
+  return id < table.size() ? table[id] : T{};
+}
+
+template <class T>
+void Set(std::vector<T>& table, NodeId id, std::type_identity_t<T> value) {
+  if (id >= table.size()) table.resize(id + 1);
+  table[id] = std::move(value);
+}
+
+// Adds or replaces the storage location of the given name, giving new names the
+// next slot.
+void Declare(Scope& scope, Symbol name, StorageLocation location) {
+  auto [it, inserted] = scope.storage.try_emplace(name, location);
+  if (inserted) {
+    scope.slots.push_back(name);
+    scope.captured.push_back(false);
+  } else {
+    it->second = location;
+  }
+}
+
+// Owns all Scopes and tables pointing each expression (by its NodeId) to its
 // scope. Each lookup member function consists of seaching each scope in the
 // parent chain for the symbol.
 class St : public SymbolTable {
  public:
-  St(std::vector<std::unique_ptr<Scope>> scopes, std::unordered_map<const Expr*, const Scope*> scope_by_expr,
-     std::unordered_map<const Let*, const Scope*> scope_by_let,
-     std::unordered_map<const FunctionDeclaration*, const Scope*> scope_by_function)
+  St(std::vector<std::unique_ptr<Scope>> scopes, ScopeByNode scope_by_expr, ScopeByNode scope_by_let,
+     ScopeByNode scope_by_function)
       : scopes_(std::move(scopes)),
         scope_by_expr_(std::move(scope_by_expr)),
         scope_by_let_(std::move(scope_by_let)),
         scope_by_function_(std::move(scope_by_function)) {}
 
-  const FunctionDeclaration* lookupFunction(const Expr& expr, std::string_view name) const override {
-    for (const Scope* s = Lookup(scope_by_expr_, &expr); s; s = s->parent) {
+  void set_bindings(std::vector<Binding> bindings) { binding_by_expr_ = std::move(bindings); }
+
+  void set_types(std::deque<types::Type> types, TypeByNode type_by_declaration, TypeByNode type_by_variable,
+                 std::vector<types::Signature> signature_by_function) {
+    types_ = std::move(types);
+    type_by_declaration_ = std::move(type_by_declaration);
+    type_by_variable_ = std::move(type_by_variable);
+    signature_by_function_ = std::move(signature_by_function);
+  }
+
+  const Binding& getBinding(const Expr& use) const override {
+    static const Binding kUnbound;
+    return use.node_id < binding_by_expr_.size() ? binding_by_expr_[use.node_id] : kUnbound;
+  }
+
+  const FunctionDeclaration* lookupFunction(const Expr& expr, Symbol name) const override {
+    for (const Scope* s = Lookup(scope_by_expr_, expr.node_id); s; s = s->parent) {
       if (const auto* d = Lookup(s->function, name); d) return d;
     }
     return nullptr;
   }
 
-  StorageLocation lookupStorageLocation(const Expr& expr, std::string_view name) const override {
-    for (const Scope* s = Lookup(scope_by_expr_, &expr); s; s = s->parent) {
+  StorageLocation lookupStorageLocation(const Expr& expr, Symbol name) const override {
+    for (const Scope* s = Lookup(scope_by_expr_, expr.node_id); s; s = s->parent) {
       if (auto it = s->storage.find(name); it != s->storage.end()) {
         return it->second;
       }
@@ -43,12 +87,12 @@ class St : public SymbolTable {
     return nullptr;
   }
 
-  const Scope* getScope(const Expr& expr) const override { return Lookup(scope_by_expr_, &expr); }
-  const Scope* getScope(const FunctionDeclaration& v) const override { return Lookup(scope_by_function_, &v); }
-  const Scope* getScope(const Let& v) const override { return Lookup(scope_by_let_, &v); }
+  const Scope* getScope(const Expr& expr) const override { return Lookup(scope_by_expr_, expr.node_id); }
+  const Scope* getScope(const FunctionDeclaration& v) const override { return Lookup(scope_by_function_, v.node_id); }
+  const Scope* getScope(const Let& v) const override { return Lookup(scope_by_let_, v.node_id); }
 
-  const Scope* getDefiningScope(const Expr& expr, std::string_view name) const override {
-    for (const Scope* s = Lookup(scope_by_expr_, &expr); s; s = s->parent) {
+  const Scope* getDefiningScope(const Expr& expr, Symbol name) const override {
+    for (const Scope* s = Lookup(scope_by_expr_, expr.node_id); s; s = s->parent) {
       if (s->storage.find(name) != s->storage.end()) {
         return s;
       }
@@ -56,27 +100,29 @@ class St : public SymbolTable {
     return nullptr;
   }
 
-  const VariableDeclaration* lookupVariable(const Expr& expr, std::string_view name) const override {
+  const VariableDeclaration* lookupVariable(const Expr& expr, Symbol name) const override {
     StorageLocation d = lookupStorageLocation(expr, name);
     if (auto v = std::get_if<const VariableDeclaration*>(&d); v) return *v;
     return nullptr;
   }
 
-  const TypeDeclaration* lookupType(const Expr& expr, std::string_view name) const override {
-    for (const Scope* s = Lookup(scope_by_expr_, &expr); s; s = s->parent) {
+  const TypeDeclaration* lookupType(const Expr& expr, Symbol name) const override {
+    for (const Scope* s = Lookup(scope_by_expr_, expr.node_id); s; s = s->parent) {
       if (const auto* d = Lookup(s->type, name); d) return d;
     }
     return nullptr;
   }
 
-  const TypeDeclaration* lookupUnaliasedType(const Expr& expr, std::string_view name) const override {
-    const TypeDeclaration* decl = lookupType(expr, name);
-    while (decl) {
-      const auto* alias = std::get_if<Identifier>(&decl->value);
-      if (!alias) return decl;
-      decl = lookupType(expr, *alias);
-    }
-    return nullptr;
+  const types::Type* getType(const TypeDeclaration& v) const override {
+    return Lookup(type_by_declaration_, v.node_id);
+  }
+  const types::Type* getType(const VariableDeclaration& v) const override {
+    return Lookup(type_by_variable_, v.node_id);
+  }
+
+  const types::Signature& getSignature(const FunctionDeclaration& v) const override {
+    static const types::Signature kUndeclared;
+    return v.node_id < signature_by_function_.size() ? signature_by_function_[v.node_id] : kUndeclared;
   }
 
   std::string toString() const override {
@@ -87,80 +133,95 @@ class St : public SymbolTable {
 
   const std::vector<std::unique_ptr<Scope>>& scopes() const override { return scopes_; }
 
+  NodeId exprCount() const override { return binding_by_expr_.size(); }
+
  private:
   std::vector<std::unique_ptr<Scope>> scopes_;
-  std::unordered_map<const Expr*, const Scope*> scope_by_expr_;
-  std::unordered_map<const Let*, const Scope*> scope_by_let_;
-  std::unordered_map<const FunctionDeclaration*, const Scope*> scope_by_function_;
+  ScopeByNode scope_by_expr_;
+  ScopeByNode scope_by_let_;
+  ScopeByNode scope_by_function_;
+  std::vector<Binding> binding_by_expr_;
+  // Types of declarations and undeclared names, which never move.
+  std::deque<types::Type> types_;
+  TypeByNode type_by_declaration_;
+  TypeByNode type_by_variable_;
+  std::vector<types::Signature> signature_by_function_;
 };
 
-// A visitor that creates and populates all the Scopes. FunctionDeclaration and
-// Let create a new Scope. The `Build` function transfers ownership of the
-// Scopes and the map of Expr to Scope to the returned SymbolTable.
-struct StBuilder : VisitorBase<StBuilder> {
-  using super::operator();
-
-  template <class T>
-  bool operator()(const T& v) {
-    return VisitChildren(v, *this);
+// Creates and populates all the Scopes in one traversal of the tree.
+// FunctionDeclaration and Let create a new Scope, which is current until the
+// traversal leaves them. The `Build` function transfers ownership of the
+// Scopes and the tables of node to Scope to the returned SymbolTable.
+struct StBuilder {
+  void Visit(const Expr& root) {
+    root_ = &root;
+    Traverse(
+        &root, [this](const auto& node) { return Enter(node); }, [this](const auto& node) { Leave(node); });
   }
 
-  bool operator()(const Expr& v) {
-    scope_by_expr[&v] = current;
-    return Visit(v);
+  bool Enter(const Expr& v) {
+    // The root has no scope of its own.
+    if (&v != root_) Set(scope_by_expr, v.node_id, current);
+    if (const auto* let = std::get_if<Let>(&v)) {
+      Open();
+      Set(scope_by_let, let->node_id, current);
+      // Add all declarations to the new scope before visiting any of them.
+      for (const auto& decl : let->declaration) {
+        std::visit(Overloaded{[&](const TypeDeclaration& d) { current->type[d.id] = &d; },
+                              [&](const FunctionDeclaration& d) { current->function[d.id] = &d; },
+                              [&](const VariableDeclaration& d) { Declare(*current, d.id, &d); }},
+                   *decl);
+      }
+    } else if (const auto* loop = std::get_if<For>(&v)) {
+      // TODO: A For loop should semantically have its own scope to handle
+      // shadowing and capturing of the loop variable by nested functions.
+      // For now, we share the parent scope to stay compatible with the
+      // Java code generator, but we add the variable to the symbol table
+      // so the checker can prevent assignments to it.
+      Declare(*current, loop->id, loop);
+    }
+    return true;
   }
 
-  bool operator()(const FunctionDeclaration& v) {
-    current->function[v.id] = &v;
-    Scope* prev = current;
-    scopes.emplace_back(std::make_unique<Scope>(scopes.size(), current));
-    current = scopes.back().get();
-    scope_by_function[&v] = current;
-    for (const TypeField& p : v.parameter) {
-      current->storage[p.id] = &p;
-    }
-    if (!VisitChildren(v, *this)) return false;
-    current = prev;
+  bool Enter(const Declaration& d) {
+    std::visit(Overloaded{[&](const FunctionDeclaration& v) {
+                            current->function[v.id] = &v;
+                            Open();
+                            current->function_scope = current;
+                            Set(scope_by_function, v.node_id, current);
+                            for (const TypeField& p : v.parameter) {
+                              Declare(*current, p.id, &p);
+                            }
+                          },
+                          [&](const VariableDeclaration& v) { Declare(*current, v.id, &v); },
+                          [&](const TypeDeclaration& v) { current->type[v.id] = &v; }},
+               d);
     return true;
   }
 
-  bool operator()(const VariableDeclaration& v) {
-    current->storage[v.id] = &v;
-    return VisitChildren(v, *this);
+  bool Enter(const auto&) { return true; }
+
+  void Leave(const Expr& v) {
+    if (std::holds_alternative<Let>(v)) Close();
   }
 
-  bool operator()(const TypeDeclaration& v) {
-    current->type[v.id] = &v;
-    return true;
+  void Leave(const Declaration& d) {
+    if (std::holds_alternative<FunctionDeclaration>(d)) Close();
   }
 
-  bool operator()(const Let& v) {
-    Scope* prev = current;
+  void Leave(const auto&) {}
+
+  // Makes a new scope nested in the current one current.
+  void Open() {
+    enclosing_.push_back(current);
     scopes.emplace_back(std::make_unique<Scope>(scopes.size(), current));
     current = scopes.back().get();
-    scope_by_let[&v] = current;
-
-    // First pass: add all declarations to the new scope.
-    for (const auto& decl : v.declaration) {
-      std::visit(Overloaded{[&](const TypeDeclaration& d) { current->type[d.id] = &d; },
-                            [&](const FunctionDeclaration& d) { current->function[d.id] = &d; },
-                            [&](const VariableDeclaration& d) { current->storage[d.id] = &d; }},
-                 *decl);
-    }
-    // Second pass: visit children to handle nested scopes and expressions.
-    if (!VisitChildren(v, *this)) return false;
-    current = prev;
-    return true;
   }
 
-  bool operator()(const For& v) {
-    // TODO: A For loop should semantically have its own scope to handle
-    // shadowing and capturing of the loop variable by nested functions.
-    // For now, we share the parent scope to stay compatible with the
-    // Java code generator, but we add the variable to the symbol table
-    // so the checker can prevent assignments to it.
-    current->storage[v.id] = &v;
-    return VisitChildren(v, *this);
+  // Makes the parent of the current scope current again.
+  void Close() {
+    current = enclosing_.back();
+    enclosing_.pop_back();
   }
 
   St Build() {
@@ -168,15 +229,247 @@ struct StBuilder : VisitorBase<StBuilder> {
   }
 
   std::vector<std::unique_ptr<Scope>> scopes;
-  std::unordered_map<const Expr*, const Scope*> scope_by_expr;
-  std::unordered_map<const Let*, const Scope*> scope_by_let;
-  std::unordered_map<const FunctionDeclaration*, const Scope*> scope_by_function;
+  ScopeByNode scope_by_expr;
+  ScopeByNode scope_by_let;
+  ScopeByNode scope_by_function;
   Scope* current = (scopes.emplace_back(std::make_unique<Scope>()), scopes[0].get());
+
+ private:
+  const Expr* root_ = nullptr;
+  // Scopes that were current before those opened since, innermost last.
+  std::vector<Scope*> enclosing_;
+};
+
+// Binds every name use to its declaration in one walk over the tree. Entering a
+// scope pushes its declarations onto a stack per name and leaving it pops them,
+// so the top of each stack is the innermost visible declaration. This gives the
+// same results as searching the parent chain of the complete scopes, but takes
+// time linear in the size of the tree rather than in size times depth. Type
+// names are resolved the same way, creating one Type per type declaration and
+// undeclared name.
+class Resolver {
+ public:
+  explicit Resolver(St& table, NodeId expr_count) : table_(table), bindings_(expr_count) {}
+
+  void Resolve(const Expr& root) {
+    const Scope& global = *table_.scopes()[0];
+    Enter(global);
+    // The root has no scope of its own, so its names are bound in the outermost.
+    Bind(root, global, bindings_[root.node_id]);
+    Traverse(
+        &root, [this](const auto& node) { return Enter(node); }, [this](const auto& node) { Leave(node); });
+    table_.set_bindings(std::move(bindings_));
+    table_.set_types(std::move(types_), TypeByNode(declared_.begin(), declared_.end()), std::move(variable_types_),
+                     std::move(signatures_));
+  }
+
+ private:
+  bool Enter(const Expr& e) {
+    if (const Scope* scope = table_.getScope(e)) {
+      if (e.node_id >= bindings_.size()) bindings_.resize(e.node_id + 1);
+      Bind(e, *scope, bindings_[e.node_id]);
+    }
+    if (const auto* let = std::get_if<Let>(&e)) {
+      // The types of a let exist before their names become visible, and get
+      // their structure once all of them are.
+      for (const auto& d : let->declaration) {
+        if (const auto* td = std::get_if<TypeDeclaration>(d.get())) Declare(*td);
+      }
+      if (const Scope* scope = table_.getScope(*let)) Enter(*scope);
+      for (const auto& d : let->declaration) {
+        if (const auto* td = std::get_if<TypeDeclaration>(d.get())) Complete(*declared_[td->node_id]);
+      }
+    }
+    return true;
+  }
+
+  bool Enter(const Declaration& d) {
+    if (const auto* v = std::get_if<FunctionDeclaration>(&d)) {
+      if (v->node_id >= signatures_.size()) signatures_.resize(v->node_id + 1);
+      types::Signature& signature = signatures_[v->node_id];
+      for (const TypeField& p : v->parameter) signature.parameters.push_back(ResolveType(p.type_id));
+      if (v->type_id) signature.result = ResolveType(*v->type_id);
+      if (const Scope* scope = table_.getScope(*v)) Enter(*scope);
+    } else if (const auto* v = std::get_if<VariableDeclaration>(&d)) {
+      Set(variable_types_, v->node_id, v->type_id ? ResolveType(*v->type_id) : nullptr);
+    }
+    return true;
+  }
+
+  bool Enter(const auto&) { return true; }
+
+  void Leave(const Expr& e) {
+    if (const auto* let = std::get_if<Let>(&e)) {
+      if (const Scope* scope = table_.getScope(*let)) Leave(*scope);
+    }
+  }
+
+  void Leave(const Declaration& d) {
+    if (const auto* v = std::get_if<FunctionDeclaration>(&d)) {
+      if (const Scope* scope = table_.getScope(*v)) Leave(*scope);
+    }
+  }
+
+  void Leave(const auto&) {}
+
+  template <class T>
+  using Stacks = std::unordered_map<Symbol, std::vector<T>>;
+
+  void Enter(const Scope& scope) {
+    for (const auto& [name, d] : scope.type) {
+      Binding b{d, &scope};
+      b.value_type = declared_[d->node_id];
+      types_by_name_[name].push_back(b);
+    }
+    for (size_t slot = 0; slot < scope.slots.size(); ++slot) {
+      Symbol name = scope.slots[slot];
+      StorageLocation location = scope.storage.at(name);
+      Binding b = std::visit([](auto d) { return Binding{d}; }, location);
+      b.scope = &scope;
+      b.slot = slot;
+      b.value_type = DeclaredType(location);
+      storage_[name].push_back(b);
+    }
+    for (const auto& [name, d] : scope.function) functions_[name].push_back(Binding{d, &scope});
+  }
+
+  void Leave(const Scope& scope) {
+    for (Symbol name : scope.slots) storage_[name].pop_back();
+    for (const auto& [name, d] : scope.function) functions_[name].pop_back();
+    for (const auto& [name, d] : scope.type) types_by_name_[name].pop_back();
+  }
+
+  // Creates the Type of the given declaration. Aliases have no canonical type
+  // until completed.
+  void Declare(const TypeDeclaration& d) {
+    auto kind = std::visit(Overloaded{[](const TypeId&) { return types::Type::kUnknown; },
+                                      [](const TypeFields&) { return types::Type::kRecord; },
+                                      [](const ArrayType&) { return types::Type::kArray; }},
+                           d.value);
+    types::Type& type = types_.emplace_back(kind, d.id, &d);
+    if (kind == types::Type::kUnknown) type.canonical = nullptr;
+    Set(declared_, d.node_id, &type);
+  }
+
+  void Complete(types::Type& type) {
+    std::visit(Overloaded{[&](const TypeId&) { Unalias(type); },
+                          [&](const TypeFields& fields) {
+                            for (const TypeField& f : fields) type.fields.push_back({f.id, ResolveType(f.type_id)});
+                          },
+                          [&](const ArrayType& at) { type.element = ResolveType(at.element_type_id); }},
+               type.declaration->value);
+  }
+
+  // Returns the canonical type of the given alias, resolving it first if needed.
+  // Aliases in a cycle that does not pass through a record or array stand for
+  // an unknown type.
+  const types::Type* Unalias(types::Type& alias) {
+    if (alias.canonical) return alias.canonical;
+    alias.canonical = UnknownType(alias.name);  // Ends cycles back to this alias.
+    const types::Type* target = ResolveType(std::get<TypeId>(alias.declaration->value));
+    if (!target->canonical) target = Unalias(*declared_[target->declaration->node_id]);
+    alias.canonical = target->canonical;
+    alias.kind = target->canonical->kind;
+    return alias.canonical;
+  }
+
+  // Returns the innermost visible type with the given name.
+  const types::Type* ResolveType(Symbol name) {
+    if (auto it = types_by_name_.find(name); it != types_by_name_.end() && !it->second.empty()) {
+      return it->second.back().value_type;
+    }
+    if (name == kInt) return types::Int();
+    if (name == kString) return types::String();
+    return UnknownType(name);
+  }
+
+  const types::Type* UnknownType(Symbol name) {
+    auto [it, inserted] = unknown_types_.try_emplace(name);
+    if (inserted) it->second = &types_.emplace_back(types::Type::kUnknown, name);
+    return it->second;
+  }
+
+  const types::Type* DeclaredType(StorageLocation location) {
+    return std::visit(
+        Overloaded{[&](const VariableDeclaration* d) { return d->type_id ? ResolveType(*d->type_id) : nullptr; },
+                   [&](const TypeField* d) { return ResolveType(d->type_id); },
+                   [](const For*) { return types::Int(); },
+                   [](std::nullptr_t) -> const types::Type* { return nullptr; }},
+        location);
+  }
+
+  static Binding Innermost(const Stacks<Binding>& stacks, Symbol name, const Scope& use_scope) {
+    auto it = stacks.find(name);
+    if (it == stacks.end() || it->second.empty()) return {};
+    Binding b = it->second.back();
+    b.depth = use_scope.depth - b.scope->depth;
+    return b;
+  }
+
+  static Symbol BaseName(const LValue& l) {
+    const LValue* base = &l;
+    while (!std::holds_alternative<Identifier>(*base)) {
+      base = std::visit(Overloaded{[](const RecordField& rf) -> const LValue* { return rf.l_value.get(); },
+                                   [](const ArrayElement& ae) -> const LValue* { return ae.l_value.get(); },
+                                   [](const Identifier&) -> const LValue* { return nullptr; }},
+                        *base);
+    }
+    return std::get<Identifier>(*base);
+  }
+
+  // Escape analysis: a variable used in a function nested in the one declaring
+  // it is captured.
+  void MarkCaptured(const Binding& b, const Scope& use_scope) {
+    if (b.scope && b.scope->function_scope != use_scope.function_scope) {
+      table_.scopes()[b.scope->id]->captured[b.slot] = true;
+    }
+  }
+
+  void Bind(const Expr& e, const Scope& scope, Binding& b) {
+    if (const auto* l = std::get_if<ArenaPtr<LValue>>(&e)) {
+      b = Innermost(storage_, BaseName(**l), scope);
+      MarkCaptured(b, scope);
+    } else if (const auto* a = std::get_if<Assignment>(&e)) {
+      b = Innermost(storage_, BaseName(*a->l_value), scope);
+      MarkCaptured(b, scope);
+    } else if (const auto* fc = std::get_if<FunctionCall>(&e)) {
+      b = Innermost(functions_, fc->id, scope);
+    } else if (const auto* rl = std::get_if<RecordLiteral>(&e)) {
+      b = Innermost(types_by_name_, rl->type_id, scope);
+      b.value_type = ResolveType(rl->type_id);
+    } else if (const auto* al = std::get_if<ArrayLiteral>(&e)) {
+      b = Innermost(types_by_name_, al->type_id, scope);
+      b.value_type = ResolveType(al->type_id);
+    }
+  }
+
+  St& table_;
+  std::vector<Binding> bindings_;
+  Stacks<Binding> storage_;
+  Stacks<Binding> functions_;
+  Stacks<Binding> types_by_name_;
+  std::deque<types::Type> types_;
+  std::unordered_map<Symbol, const types::Type*> unknown_types_;
+  std::vector<types::Type*> declared_;
+  TypeByNode variable_types_;
+  std::vector<types::Signature> signatures_;
 };
 }  // namespace
 
+bool Scope::IsCaptured(Symbol name) const {
+  for (size_t slot = 0; slot < slots.size(); ++slot) {
+    if (slots[slot] == name) return captured[slot];
+  }
+  return false;
+}
+
 std::unique_ptr<SymbolTable> SymbolTable::Build(const Expr& root) {
   StBuilder builder;
-  std::visit(builder, root);
-  return std::make_unique<St>(builder.Build());
+  // The parser numbers children before their parents, so the root has the
+  // largest expression id.
+  builder.scope_by_expr.reserve(root.node_id + 1);
+  builder.Visit(root);
+  auto table = std::make_unique<St>(builder.Build());
+  Resolver(*table, root.node_id + 1).Resolve(root);
+  return table;
 }
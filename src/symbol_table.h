@@ -1,12 +1,12 @@
 #pragma once
 
 #include <memory>
-#include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
 #include "syntax.h"
+#include "types.h"
 
 // Return value for lookupStorageLocation. Returns variable declaration,
 // function parameter, or nullptr to indicate not found.
@@ -19,59 +19,113 @@ using StorageLocation =
 // functions and let.
 struct Scope {
   Scope() : id(0) {}
-  explicit Scope(int id, const Scope* p) : id(id), parent(p) {}
+  explicit Scope(int id, const Scope* p) : id(id), depth(p->depth + 1), parent(p), function_scope(p->function_scope) {}
+
+  // Returns true if functions declared in this scope's function use the given
+  // name in storage, so that it must outlive calls of the function.
+  bool IsCaptured(syntax::Symbol name) const;
 
   int id;
+  // Number of static links to the outermost scope.
+  int depth = 0;
   const Scope* parent = nullptr;
-  std::unordered_map<std::string_view, const syntax::FunctionDeclaration*> function;
-  std::unordered_map<std::string_view, StorageLocation> storage;
-  std::unordered_map<std::string_view, const syntax::TypeDeclaration*> type;
+  // Scope of the parameters of the innermost function containing this scope,
+  // or the outermost scope.
+  const Scope* function_scope = this;
+  std::unordered_map<syntax::Symbol, const syntax::FunctionDeclaration*> function;
+  std::unordered_map<syntax::Symbol, StorageLocation> storage;
+  std::unordered_map<syntax::Symbol, const syntax::TypeDeclaration*> type;
+  // Names in storage in order of declaration. The index of a name is its slot.
+  std::vector<syntax::Symbol> slots;
+  // Whether the name in each slot is used in a function other than the one
+  // containing this scope, found by escape analysis when the table is built.
+  std::vector<bool> captured;
+};
+
+// Declaration that the name used by an expression resolves to: the variable of
+// an l-value or assignment, the function of a call, or the type of a record or
+// array literal. Found once for every expression when the table is built.
+// Undeclared types of literals still have a Type, which is unknown.
+struct Binding {
+  using Declaration = std::variant<std::nullptr_t, const syntax::VariableDeclaration*, const syntax::TypeField*,
+                                   const syntax::For*, const syntax::FunctionDeclaration*,
+                                   const syntax::TypeDeclaration*>;
+
+  Declaration declaration = nullptr;
+  // Scope declaring the name, or null if not found.
+  const Scope* scope = nullptr;
+  // Number of static links from the scope of the use to the declaring scope.
+  int depth = 0;
+  // Slot of variables in the declaring scope.
+  int slot = 0;
+  // Declared type of a variable, which is null if inferred from its value, or
+  // type of a literal.
+  const types::Type* value_type = nullptr;
+
+  StorageLocation storage() const {
+    return std::visit(syntax::Overloaded{[](const syntax::VariableDeclaration* d) -> StorageLocation { return d; },
+                                         [](const syntax::TypeField* d) -> StorageLocation { return d; },
+                                         [](const syntax::For* d) -> StorageLocation { return d; },
+                                         [](const auto&) -> StorageLocation { return nullptr; }},
+                      declaration);
+  }
+  const syntax::FunctionDeclaration* function() const {
+    auto d = std::get_if<const syntax::FunctionDeclaration*>(&declaration);
+    return d ? *d : nullptr;
+  }
+  const syntax::TypeDeclaration* type() const {
+    auto d = std::get_if<const syntax::TypeDeclaration*>(&declaration);
+    return d ? *d : nullptr;
+  }
 };
 
 // Table to look up symbols in the AST starting from a given expression. Returns
-// null if not found.
+// null if not found. Nodes are identified by their NodeId, so all of them must
+// belong to the tree the table was built for.
 class SymbolTable {
  public:
   static std::unique_ptr<SymbolTable> Build(const syntax::Expr& root);
   virtual ~SymbolTable() = default;
 
   // Returns function declarations with given name visible in given expression.
-  virtual const syntax::FunctionDeclaration* lookupFunction(const syntax::Expr& expr, std::string_view name) const = 0;
+  virtual const syntax::FunctionDeclaration* lookupFunction(const syntax::Expr& expr, syntax::Symbol name) const = 0;
 
   // Prevents implicit conversion for better error messages
   template <typename T>
-  const syntax::FunctionDeclaration* lookupFunction(const T&, std::string_view) const = delete;
+  const syntax::FunctionDeclaration* lookupFunction(const T&, syntax::Symbol) const = delete;
 
   // Returns variable declarations with given name visible in given expression.
-  virtual const syntax::VariableDeclaration* lookupVariable(const syntax::Expr& expr, std::string_view name) const = 0;
+  virtual const syntax::VariableDeclaration* lookupVariable(const syntax::Expr& expr, syntax::Symbol name) const = 0;
 
   // Prevents implicit conversion for better error messages
   template <typename T>
-  const syntax::VariableDeclaration* lookupVariable(const T&, std::string_view) const = delete;
+  const syntax::VariableDeclaration* lookupVariable(const T&, syntax::Symbol) const = delete;
 
   // Returns type declarations with given name visible in given expression.
   // NOTE: This returns the direct definition of the type. If the type is an
   // alias (e.g. type a = b), this returns the TypeDeclaration for 'a' which
-  // contains an Identifier 'b'. To get the underlying structural type, use
-  // lookupUnaliasedType or manually unwind aliases.
-  virtual const syntax::TypeDeclaration* lookupType(const syntax::Expr& expr, std::string_view name) const = 0;
+  // contains an Identifier 'b'. Its Type from getType has the structure.
+  virtual const syntax::TypeDeclaration* lookupType(const syntax::Expr& expr, syntax::Symbol name) const = 0;
 
   template <typename T>
-  const syntax::TypeDeclaration* lookupType(const T&, std::string_view) const = delete;
+  const syntax::TypeDeclaration* lookupType(const T&, syntax::Symbol) const = delete;
 
-  // Returns type declaration with given name visible in given expression,
-  // traversing any type aliases.
-  // NOTE: This unwinds aliases until a Record, Array, or Builtin type is found.
-  // Use this when checking structural constraints (e.g. "is this a record?").
-  virtual const syntax::TypeDeclaration* lookupUnaliasedType(const syntax::Expr& expr, std::string_view name) const = 0;
+  // Returns the type declared by the given type declaration.
+  virtual const types::Type* getType(const syntax::TypeDeclaration&) const = 0;
+  // Returns the declared type of the given variable, or null if its type is
+  // inferred from its value.
+  virtual const types::Type* getType(const syntax::VariableDeclaration&) const = 0;
 
   template <typename T>
-  const syntax::TypeDeclaration* lookupUnaliasedType(const T&, std::string_view) const = delete;
+  const types::Type* getType(const T&) const = delete;
+
+  // Returns the declared parameter and result types of the given function.
+  virtual const types::Signature& getSignature(const syntax::FunctionDeclaration&) const = 0;
 
-  virtual StorageLocation lookupStorageLocation(const syntax::Expr& expr, std::string_view name) const = 0;
+  virtual StorageLocation lookupStorageLocation(const syntax::Expr& expr, syntax::Symbol name) const = 0;
 
   template <typename T>
-  StorageLocation lookupStorageLocation(const T&, std::string_view) const = delete;
+  StorageLocation lookupStorageLocation(const T&, syntax::Symbol) const = delete;
 
   // Returns the immediate scope for a given expression, or scope defining AST
   virtual const Scope* getScope(const syntax::Expr& expr) const = 0;
@@ -83,14 +137,25 @@ class SymbolTable {
 
   // Returns the scope where the given variable name is stored, starting from
   // the given expression.
-  virtual const Scope* getDefiningScope(const syntax::Expr& expr, std::string_view name) const = 0;
+  virtual const Scope* getDefiningScope(const syntax::Expr& expr, syntax::Symbol name) const = 0;
 
   template <typename T>
-  const Scope* getDefiningScope(const T&, std::string_view) const = delete;
+  const Scope* getDefiningScope(const T&, syntax::Symbol) const = delete;
+
+  // Returns the declaration of the name used by the given expression, if any.
+  // Unlike the lookup functions above, this takes constant time.
+  virtual const Binding& getBinding(const syntax::Expr& use) const = 0;
+
+  template <typename T>
+  const Binding& getBinding(const T&) const = delete;
 
   // Returns all scopes encountered thus far.
   virtual const std::vector<std::unique_ptr<Scope>>& scopes() const = 0;
 
+  // Returns the number of expressions in the tree, which is one more than
+  // their largest NodeId.
+  virtual syntax::NodeId exprCount() const = 0;
+
   // Returns string for debugging.
   virtual std::string toString() const = 0;
 };
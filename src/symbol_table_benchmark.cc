@@ -0,0 +1,87 @@
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "checker.h"
+#include "symbol_table.h"
+#include "testing/heap_counter.h"
+#include "testing/testing.h"
+#include "type_finder.h"
+
+namespace {
+
+// A parsed program with every expression listed, for lookups outside the walk.
+struct Program {
+  std::shared_ptr<syntax::Expr> root;
+  std::vector<const syntax::Expr*> exprs;
+};
+
+Program Load(std::shared_ptr<syntax::Expr> root) {
+  Program p{root, {}};
+  syntax::Walk(*root, syntax::Overloaded{[&](const syntax::Expr& e) { p.exprs.push_back(&e); }, [](const auto&) {}});
+  return p;
+}
+
+std::vector<Program> LoadCorpus() {
+  std::vector<Program> corpus;
+  for (const auto& entry : std::filesystem::directory_iterator(TESTDATA_DIR)) {
+    if (entry.path().extension() != ".tig") continue;
+    if (auto root = testing::ParseFile(entry.path().string())) corpus.push_back(Load(root));
+  }
+  return corpus;
+}
+
+// Builds the symbol table and looks up the scope and type of every expression,
+// as the checker and code generators do. Returns the number of scopes found.
+size_t LookUpAll(const Program& p) {
+  auto symbols = SymbolTable::Build(*p.root);
+  std::vector<std::string> errors;
+  TypeFinder types(*symbols, errors);
+  size_t found = 0;
+  for (const syntax::Expr* e : p.exprs) {
+    found += symbols->getScope(*e) != nullptr;
+    types(*e);
+  }
+  for (const syntax::Expr* e : p.exprs) found += types(*e) != nullptr;
+  return found;
+}
+
+TEST_CASE("Look up scopes and types", "[symbol_table]") {
+  std::vector<Program> corpus = LoadCorpus();
+  REQUIRE(!corpus.empty());
+  Program large = Load(testing::Parse(testing::SyntheticProgram(10000)));
+
+  testing::HeapUsage before = testing::HeapAllocated();
+  LookUpAll(large);
+  testing::HeapUsage after = testing::HeapAllocated();
+  std::cout << "Heap for symbol table and types of " << large.exprs.size()
+            << " expressions: " << after.allocations - before.allocations << " allocations, "
+            << after.bytes - before.bytes << " bytes" << std::endl;
+
+  BENCHMARK("testdata corpus") {
+    size_t found = 0;
+    for (const Program& p : corpus) found += LookUpAll(p);
+    return found;
+  };
+  BENCHMARK("10000 functions") { return LookUpAll(large); };
+}
+
+// Every let refers to the outermost variable, so searching the parent chain for
+// each use takes time quadratic in the depth.
+TEST_CASE("Resolve and check nested lets", "[symbol_table]") {
+  for (int depth : {10, 100, 1000, 10000}) {
+    auto root = testing::Parse(testing::NestedLets(depth));
+    REQUIRE(root != nullptr);
+    BENCHMARK("depth " + std::to_string(depth)) {
+      auto symbols = SymbolTable::Build(*root);
+      std::vector<std::string> errors;
+      TypeFinder types(*symbols, errors);
+      return ListErrors(*root, *symbols, types).size() + errors.size();
+    };
+  }
+}
+}  // namespace
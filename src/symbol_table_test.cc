@@ -14,9 +14,9 @@ SCENARIO("SymbolTable", "[SymbolTable]") {
     Expr nil = Nil{};
     auto t = SymbolTable::Build(nil);
     WHEN("empty") {
-      REQUIRE(t->lookupFunction(nil, "foo") == nullptr);
-      REQUIRE(std::holds_alternative<std::nullptr_t>(t->lookupStorageLocation(nil, "foo")));
-      REQUIRE(t->lookupType(nil, "foo") == nullptr);
+      REQUIRE(t->lookupFunction(nil, Symbol("foo")) == nullptr);
+      REQUIRE(std::holds_alternative<std::nullptr_t>(t->lookupStorageLocation(nil, Symbol("foo"))));
+      REQUIRE(t->lookupType(nil, Symbol("foo")) == nullptr);
     }
   }
 
@@ -30,9 +30,9 @@ in
 end)");
     REQUIRE(expr != nullptr);
     auto t = SymbolTable::Build(*expr);
-    const std::vector<std::unique_ptr<Expr>>& body = std::get<Let>(*expr).body;
+    const ArenaSpan<ArenaPtr<Expr>>& body = std::get<Let>(*expr).body;
     REQUIRE(body.size() == 1);
-    StorageLocation var = t->lookupStorageLocation(*body[0], "arr1");
+    StorageLocation var = t->lookupStorageLocation(*body[0], Symbol("arr1"));
     REQUIRE(std::holds_alternative<const VariableDeclaration*>(var));
   }
 
@@ -50,15 +50,15 @@ end)");
     const Declaration& decl = *std::get<Let>(*expr).declaration[1];
     REQUIRE(std::holds_alternative<FunctionDeclaration>(decl));
     const FunctionDeclaration& fdecl = std::get<FunctionDeclaration>(decl);
-    StorageLocation a = t->lookupStorageLocation(*fdecl.body, "a");
+    StorageLocation a = t->lookupStorageLocation(*fdecl.body, Symbol("a"));
     REQUIRE(std::holds_alternative<const TypeField*>(a));
     const TypeField* a_ptr = std::get<const TypeField*>(a);
     REQUIRE(a_ptr != nullptr);
     REQUIRE(a_ptr->id == "a");
     REQUIRE(a_ptr->type_id == "arrtype");
-    const std::vector<std::unique_ptr<Expr>>& body = std::get<Let>(*expr).body;
+    const ArenaSpan<ArenaPtr<Expr>>& body = std::get<Let>(*expr).body;
     REQUIRE(body.size() == 1);
-    const FunctionDeclaration* f = t->lookupFunction(*body[0], "first");
+    const FunctionDeclaration* f = t->lookupFunction(*body[0], Symbol("first"));
     REQUIRE(f != nullptr);
     REQUIRE(f->id == "first");
     REQUIRE(f->parameter.size() == 1);
@@ -80,15 +80,84 @@ end)");
 
     // Check that `g` is visible from within `f`
     const auto& f_decl = std::get<FunctionDeclaration>(*std::get<Let>(*expr).declaration[0]);
-    const FunctionDeclaration* g_lookup_from_f = t->lookupFunction(*f_decl.body, "g");
+    const FunctionDeclaration* g_lookup_from_f = t->lookupFunction(*f_decl.body, Symbol("g"));
     REQUIRE(g_lookup_from_f != nullptr);
     REQUIRE(g_lookup_from_f->id == "g");
 
     // Check that `f` is visible from within `g`
     const auto& g_decl = std::get<FunctionDeclaration>(*std::get<Let>(*expr).declaration[1]);
-    const FunctionDeclaration* f_lookup_from_g = t->lookupFunction(*g_decl.body, "f");
+    const FunctionDeclaration* f_lookup_from_g = t->lookupFunction(*g_decl.body, Symbol("f"));
     REQUIRE(f_lookup_from_g != nullptr);
     REQUIRE(f_lookup_from_g->id == "f");
   }
+
+  GIVEN("uses of names in nested scopes") {
+    auto expr = testing::Parse(R"(
+let
+  type rec = {x: int}
+  var a := 1
+  var b := 2
+  function f(p: int): int = a + p
+in
+  let var c := rec{x = b} in c.x := f(b) end
+end)");
+    REQUIRE(expr != nullptr);
+    auto t = SymbolTable::Build(*expr);
+    std::vector<const Expr*> uses;
+    Walk(*expr, Overloaded{[&](const Expr& e) {
+                             if (t->getBinding(e).scope) uses.push_back(&e);
+                           },
+                           [](const auto&) {}});
+
+    THEN("bindings match the lookups in the parent chain") {
+      REQUIRE(uses.size() == 7);
+      for (const Expr* e : uses) {
+        const Binding& b = t->getBinding(*e);
+        if (const auto* fc = std::get_if<FunctionCall>(e)) {
+          REQUIRE(b.function() == t->lookupFunction(*e, fc->id));
+        } else if (const auto* rl = std::get_if<RecordLiteral>(e)) {
+          REQUIRE(b.type() == t->lookupType(*e, rl->type_id));
+        } else {
+          REQUIRE(!std::holds_alternative<std::nullptr_t>(b.storage()));
+        }
+        int depth = 0;
+        for (const Scope* s = t->getScope(*e); s != b.scope; s = s->parent) ++depth;
+        REQUIRE(b.depth == depth);
+      }
+    }
+    THEN("variables have slots in order of declaration") {
+      const auto& let = std::get<Let>(*expr);
+      const auto& f = std::get<FunctionDeclaration>(*let.declaration[3]);
+      // a + p in f
+      const auto& sum = std::get<Binary>(*f.body);
+      const Binding& a = t->getBinding(*sum.left);
+      REQUIRE(a.slot == 0);
+      REQUIRE(a.depth == 1);
+      REQUIRE(a.scope == t->getScope(let));
+      const Binding& p = t->getBinding(*sum.right);
+      REQUIRE(std::get<const TypeField*>(p.declaration) == &f.parameter[0]);
+      REQUIRE(p.slot == 0);
+      REQUIRE(p.depth == 0);
+      // b in the inner let
+      const auto& inner = std::get<Let>(*let.body[0]);
+      const auto& c = std::get<VariableDeclaration>(*inner.declaration[0]);
+      const auto& field = std::get<RecordLiteral>(*c.value).fields[0];
+      const Binding& b = t->getBinding(*field.expr);
+      REQUIRE(b.slot == 1);
+      REQUIRE(b.depth == 1);
+    }
+    THEN("only variables used by nested functions are captured") {
+      const Scope& outer = *t->getScope(std::get<Let>(*expr));
+      REQUIRE(outer.IsCaptured(Symbol("a")));
+      REQUIRE(!outer.IsCaptured(Symbol("b")));
+      const auto& f = std::get<FunctionDeclaration>(*std::get<Let>(*expr).declaration[3]);
+      const Scope& f_scope = *t->getScope(f);
+      REQUIRE(f_scope.function_scope == &f_scope);
+      REQUIRE(!f_scope.IsCaptured(Symbol("p")));
+      const Scope& inner = *t->getScope(std::get<Let>(*std::get<Let>(*expr).body[0]));
+      REQUIRE(inner.function_scope == outer.function_scope);
+      REQUIRE(!inner.IsCaptured(Symbol("c")));
+    }
+  }
 }
 }  // namespace
@@ -0,0 +1,70 @@
+#include "symbol.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+
+using syntax::Symbol;
+
+SCENARIO("Symbol", "[symbol]") {
+  GIVEN("Interned text") {
+    Symbol a("alpha");
+    std::string copy = "alpha";
+    THEN("equal text yields equal ids") {
+      REQUIRE(Symbol(copy) == a);
+      REQUIRE(Symbol(copy).id() == a.id());
+      REQUIRE(a.str() == "alpha");
+      REQUIRE(a == "alpha");
+    }
+    THEN("different text yields different ids") { REQUIRE(Symbol("beta") != a); }
+  }
+  GIVEN("Predefined symbols") {
+    THEN("they match their text") {
+      REQUIRE(Symbol() == Symbol(""));
+      REQUIRE(Symbol().empty());
+      REQUIRE(Symbol("int") == syntax::kInt);
+      REQUIRE(Symbol("string") == syntax::kString);
+      REQUIRE(Symbol("nil") == syntax::kNil);
+      REQUIRE(Symbol("NOTYPE") == syntax::kNoType);
+    }
+  }
+  GIVEN("Concurrent interning") {
+    constexpr int kThreads = 8;
+    constexpr int kNames = 1000;
+    std::vector<std::vector<Symbol>> interned(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([t, &interned] {
+        for (int i = 0; i < kNames; ++i) interned[t].emplace_back("concurrent" + std::to_string(i));
+      });
+    }
+    for (auto& t : threads) t.join();
+    THEN("all threads agree on the ids") {
+      for (int t = 1; t < kThreads; ++t) REQUIRE(interned[t] == interned[0]);
+      for (int i = 0; i < kNames; ++i) REQUIRE(interned[0][i].str() == "concurrent" + std::to_string(i));
+    }
+  }
+  GIVEN("Texts read while other threads intern many more") {
+    std::vector<Symbol> known;
+    for (int i = 0; i < 100; ++i) known.emplace_back("known" + std::to_string(i));
+    std::atomic<bool> done = false;
+    std::atomic<int> mismatches = 0;
+    std::thread reader([&] {
+      while (!done) {
+        for (int i = 0; i < 100; ++i) mismatches += known[i].str() != "known" + std::to_string(i);
+      }
+    });
+    // Enough texts to need several chunks of the interner.
+    std::vector<Symbol> added;
+    for (int i = 0; i < 100000; ++i) added.emplace_back("added" + std::to_string(i));
+    done = true;
+    reader.join();
+    THEN("the texts stay the same") {
+      REQUIRE(mismatches == 0);
+      for (int i = 0; i < 100000; i += 999) REQUIRE(added[i].str() == "added" + std::to_string(i));
+    }
+  }
+}
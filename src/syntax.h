@@ -1,18 +1,25 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+#include "arena.h"
 #include "binary_op.h"
+#include "symbol.h"
 
 // Types and helper functions for the abstract syntax tree from
 // http://www.cs.columbia.edu/~sedwards/classes/2002/w4115/tiger.pdf.
 namespace syntax {
 // Abstract syntax node types are a mix of structs, std::variants, and
-// type aliases.
+// type aliases. Nodes live in the Arena of the parse result and refer to their
+// children with ArenaPtr and ArenaSpan. All of them are trivially
+// destructible, so the arena frees a whole tree without visiting it.
 
 // forward declarations
 struct RecordField;
@@ -30,108 +37,137 @@ struct For;
 struct Break;
 struct Let;
 struct Parenthesized;
+struct Expr;
 
-using Identifier = std::string;
-using TypeId = std::string;
+// Dense, sequential number of a node among the nodes of its kind in one tree,
+// assigned by the parser in order of creation. Passes keep per-node data in
+// vectors indexed by it rather than in maps keyed by node address.
+using NodeId = uint32_t;
+
+// Number of numbered nodes of each kind in a tree, which while the tree is
+// built are the ids of the next ones.
+struct NodeCounts {
+  NodeId exprs = 0;
+  NodeId lets = 0;
+  NodeId functions = 0;
+  NodeId types = 0;
+  NodeId variables = 0;
+};
+
+// Identifiers and type-ids are interned by the scanner. String constants are
+// views into the source text, which the parse result keeps alive alongside the
+// tree.
+using Identifier = Symbol;
+using TypeId = Symbol;
 using LValue = std::variant<Identifier, RecordField, ArrayElement>;
 
 struct StringConstant {
-  std::string value;
+  std::string_view value;
 };
 using IntegerConstant = int;
 struct Nil {};
-using Expr =
-    std::variant<StringConstant, IntegerConstant, Nil, std::unique_ptr<LValue>, Negated, Binary, Assignment,
-                 FunctionCall, RecordLiteral, ArrayLiteral, IfThen, IfThenElse, While, For, Break, Let, Parenthesized>;
 struct RecordField {
-  std::unique_ptr<LValue> l_value;
-  std::string id;
+  ArenaPtr<LValue> l_value;
+  Identifier id;
 };
 struct ArrayElement {
-  std::unique_ptr<LValue> l_value;
-  std::unique_ptr<Expr> expr;
+  ArenaPtr<LValue> l_value;
+  ArenaPtr<Expr> expr;
 };
 struct Negated {
-  std::unique_ptr<Expr> expr;
+  ArenaPtr<Expr> expr;
 };
 struct Binary {
-  std::unique_ptr<Expr> left;
+  ArenaPtr<Expr> left;
   BinaryOp op;
-  std::unique_ptr<Expr> right;
+  ArenaPtr<Expr> right;
 };
 struct Assignment {
-  std::unique_ptr<LValue> l_value;
-  std::unique_ptr<Expr> expr;
+  ArenaPtr<LValue> l_value;
+  ArenaPtr<Expr> expr;
 };
 struct Parenthesized {
-  std::vector<std::unique_ptr<Expr>> exprs;
+  ArenaSpan<ArenaPtr<Expr>> exprs;
 };
 struct FunctionCall {
   Identifier id;
-  std::vector<std::unique_ptr<Expr>> arguments;
+  ArenaSpan<ArenaPtr<Expr>> arguments;
 };
 struct FieldAssignment {
-  std::string id;
-  std::unique_ptr<Expr> expr;
+  Identifier id;
+  ArenaPtr<Expr> expr;
 };
 struct RecordLiteral {
   TypeId type_id;
-  std::vector<FieldAssignment> fields;
+  ArenaSpan<FieldAssignment> fields;
 };
 struct ArrayLiteral {
   TypeId type_id;
-  std::unique_ptr<Expr> size;
-  std::unique_ptr<Expr> value;
+  ArenaPtr<Expr> size;
+  ArenaPtr<Expr> value;
 };
 struct IfThen {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> then_expr;
+  ArenaPtr<Expr> condition;
+  ArenaPtr<Expr> then_expr;
 };
 struct IfThenElse {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> then_expr;
-  std::unique_ptr<Expr> else_expr;
+  ArenaPtr<Expr> condition;
+  ArenaPtr<Expr> then_expr;
+  ArenaPtr<Expr> else_expr;
 };
 struct While {
-  std::unique_ptr<Expr> condition;
-  std::unique_ptr<Expr> body;
+  ArenaPtr<Expr> condition;
+  ArenaPtr<Expr> body;
 };
 struct For {
-  std::string id;
-  std::unique_ptr<Expr> start;
-  std::unique_ptr<Expr> end;
-  std::unique_ptr<Expr> body;
+  Identifier id;
+  ArenaPtr<Expr> start;
+  ArenaPtr<Expr> end;
+  ArenaPtr<Expr> body;
 };
 struct Break {};
 struct VariableDeclaration {
-  std::string id;
-  std::unique_ptr<Expr> value;
+  Identifier id;
+  ArenaPtr<Expr> value;
   std::optional<TypeId> type_id;
+  NodeId node_id = 0;
 };
 struct TypeField {
-  std::string id;
+  Identifier id;
   TypeId type_id;
 };
-using TypeFields = std::vector<TypeField>;
+using TypeFields = ArenaSpan<TypeField>;
 struct ArrayType {
   TypeId element_type_id;
 };
 struct FunctionDeclaration {
-  std::string id;
+  Identifier id;
   TypeFields parameter;
-  std::unique_ptr<Expr> body;
+  ArenaPtr<Expr> body;
   std::optional<TypeId> type_id;
+  NodeId node_id = 0;
 };
 using Type = std::variant<TypeId, TypeFields, ArrayType>;
 struct TypeDeclaration {
   TypeId id;
   Type value;
+  NodeId node_id = 0;
 };
 using Declaration = std::variant<TypeDeclaration, VariableDeclaration, FunctionDeclaration>;
 struct Let {
-  std::vector<std::unique_ptr<Declaration>> declaration;
-  std::vector<std::unique_ptr<Expr>> body;
+  ArenaSpan<ArenaPtr<Declaration>> declaration;
+  ArenaSpan<ArenaPtr<Expr>> body;
+  NodeId node_id = 0;
+};
+using ExprVariant =
+    std::variant<StringConstant, IntegerConstant, Nil, ArenaPtr<LValue>, Negated, Binary, Assignment,
+                 FunctionCall, RecordLiteral, ArrayLiteral, IfThen, IfThenElse, While, For, Break, Let, Parenthesized>;
+// An expression is its variant together with its id.
+struct Expr : ExprVariant {
+  using ExprVariant::ExprVariant;
+  NodeId node_id = 0;
 };
+static_assert(std::is_trivially_destructible_v<Expr> && std::is_trivially_destructible_v<Declaration>);
 
 // Generic struct of lambdas for ad-hoc visitors.
 template <class... F>
@@ -142,7 +178,7 @@ template <class... F>
 Overloaded(F...) -> Overloaded<F...>;
 
 // A base class for AST visitors that handles dispatching for variant types
-// (Expr, Declaration, Type, LValue) and unwraps unique_ptrs automatically.
+// (Expr, Declaration, Type, LValue) and unwraps ArenaPtrs automatically.
 // Uses the Curiously Recurring Template Pattern (CRTP).
 template <typename Derived>
 struct VisitorBase {
@@ -157,9 +193,9 @@ struct VisitorBase {
   bool operator()(const Type& v) { return std::visit(derived(), v); }
   bool operator()(const LValue& v) { return std::visit(derived(), v); }
 
-  bool operator()(const std::unique_ptr<Expr>& v) { return derived()(*v); }
-  bool operator()(const std::unique_ptr<LValue>& v) { return derived()(*v); }
-  bool operator()(const std::unique_ptr<Declaration>& v) { return derived()(*v); }
+  bool operator()(const ArenaPtr<Expr>& v) { return derived()(*v); }
+  bool operator()(const ArenaPtr<LValue>& v) { return derived()(*v); }
+  bool operator()(const ArenaPtr<Declaration>& v) { return derived()(*v); }
 
  protected:
   using super = VisitorBase<Derived>;
@@ -304,7 +340,7 @@ bool VisitChildren(const LValue& v, F&& f) {
   return std::visit([&f](const auto& e) { return VisitChildren(e, f); }, v);
 }
 template <class F>
-bool VisitChildren(const std::unique_ptr<LValue>& v, F&& f) {
+bool VisitChildren(const ArenaPtr<LValue>& v, F&& f) {
   return VisitChildren(*v, f);
 }
 template <class F>
@@ -342,16 +378,82 @@ bool VisitChildren(const Let& v, F&& f) {
   return true;
 }
 
+// A node of one of the kinds that VisitChildren passes to its function.
+using NodePtr = std::variant<const Expr*, const LValue*, const Declaration*, const FieldAssignment*>;
+
+// Depth below which Traverse recurses natively, which is faster than using its
+// explicit stack but needs native stack for every level.
+inline constexpr int kMaxTraverseRecursion = 256;
+
+// Performs a pre-order and post-order traversal of the tree below `root`.
+// Invokes `enter(node)` before and `leave(node)` after the children of each
+// node. If `enter` returns false, skips the children of the node and does not
+// invoke `leave` for it. Subtrees deeper than kMaxTraverseRecursion are
+// traversed with a stack of their own rather than the native stack, so that
+// arbitrarily deep trees can be traversed.
+template <class Enter, class Leave>
+void Traverse(NodePtr root, Enter&& enter, Leave&& leave) {
+  auto iterate = [&](NodePtr subtree) {
+    struct Frame {
+      NodePtr node;
+      bool entered = false;
+    };
+    std::vector<Frame> stack = {{subtree}};
+    while (!stack.empty()) {
+      Frame& top = stack.back();
+      NodePtr node = top.node;
+      if (top.entered) {
+        stack.pop_back();
+        std::visit([&](const auto* n) { std::invoke(leave, *n); }, node);
+        continue;
+      }
+      top.entered = true;
+      size_t first_child = stack.size();
+      std::visit(
+          [&](const auto* n) {
+            if (!std::invoke(enter, *n)) {
+              stack.pop_back();
+              return;
+            }
+            VisitChildren(*n, [&](const auto& child) {
+              stack.push_back({&child});
+              return true;
+            });
+          },
+          node);
+      // Children were pushed in order, but are visited from the top.
+      if (stack.size() > first_child + 1) std::reverse(stack.begin() + first_child, stack.end());
+    }
+  };
+  auto recurse = [&](auto& self, const auto& node, int depth) -> void {
+    if (depth == kMaxTraverseRecursion) return iterate(&node);
+    if (!std::invoke(enter, node)) return;
+    VisitChildren(node, [&](const auto& child) {
+      self(self, child, depth + 1);
+      return true;
+    });
+    std::invoke(leave, node);
+  };
+  std::visit([&](const auto* n) { recurse(recurse, *n, 0); }, root);
+}
+
 // Performs a generic pre-order traversal (Implicit Traversal / Handler Style).
-// Invokes `h(node)` then recursively walks all children.
+// Invokes `h(node)` then walks all children, using Traverse.
 // If `h` returns `bool`, traversal stops when it returns `false`.
 template <class Node, class H>
 bool Walk(const Node& node, H&& h) {
-  if constexpr (std::is_invocable_r_v<bool, H, const Node&>) {
-    if (!std::invoke(h, node)) return false;
-  } else {
-    std::invoke(h, node);
-  }
-  return VisitChildren(node, [&](const auto& child) { return Walk(child, h); });
+  bool keep_going = true;
+  Traverse(
+      &node,
+      [&](const auto& n) {
+        if constexpr (std::is_invocable_r_v<bool, H, decltype(n)>) {
+          keep_going = keep_going && std::invoke(h, n);
+        } else if (keep_going) {
+          std::invoke(h, n);
+        }
+        return keep_going;
+      },
+      [](const auto&) {});
+  return keep_going;
 }
 }  // namespace syntax
@@ -1,18 +1,40 @@
 #pragma once
-#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "syntax.h"
 
+// Helpers for the parser actions. Lists grow in std::vectors while their
+// elements are parsed and move to the arena once the enclosing node is built.
 namespace syntax {
-template <class T, class V = std::vector<std::unique_ptr<T>>>
-V Add(V v, std::unique_ptr<T> e) {
-  v.emplace_back(std::move(e));
+template <class T, class V = std::vector<ArenaPtr<T>>>
+V Add(V v, ArenaPtr<T> e) {
+  v.emplace_back(e);
   return v;
 }
 
-std::vector<FieldAssignment> Add(std::vector<FieldAssignment> v, std::string id, std::unique_ptr<Expr> expr) {
-  v.emplace_back(FieldAssignment{std::move(id), std::move(expr)});
+inline std::vector<FieldAssignment> Add(std::vector<FieldAssignment> v, Identifier id, ArenaPtr<Expr> expr) {
+  v.emplace_back(FieldAssignment{id, expr});
   return v;
 }
+
+// Allocates an expression node in the given arena and numbers it, as well as
+// the Let it may hold.
+template <class T>
+ArenaPtr<Expr> NewExpr(Arena& arena, NodeCounts& counts, T node) {
+  if constexpr (std::is_same_v<T, Let>) node.node_id = counts.lets++;
+  ArenaPtr<Expr> e = arena.New<Expr>(std::move(node));
+  e->node_id = counts.exprs++;
+  return e;
+}
+
+// Allocates a declaration node in the given arena and numbers it among the
+// declarations of its kind.
+template <class T>
+ArenaPtr<Declaration> NewDeclaration(Arena& arena, NodeCounts& counts, T node) {
+  if constexpr (std::is_same_v<T, FunctionDeclaration>) node.node_id = counts.functions++;
+  if constexpr (std::is_same_v<T, TypeDeclaration>) node.node_id = counts.types++;
+  if constexpr (std::is_same_v<T, VariableDeclaration>) node.node_id = counts.variables++;
+  return arena.New<Declaration>(std::move(node));
+}
 }  // namespace syntax
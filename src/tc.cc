@@ -1,18 +1,47 @@
 #include <cctype>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "bytecode.h"
+#include "checker.h"
 #include "debug_string.h"
 #include "driver.h"
 #include "java_source.h"
 #include "symbol_table.h"
 #include "type_finder.h"
 
+namespace {
+
+// Returns the name of the class generated for the given source file, which is
+// its base name capitalized.
+std::string ClassName(const std::string& filename) {
+  std::string class_name = filename;
+  size_t last_slash = class_name.find_last_of("/\\");
+  if (last_slash != std::string::npos) {
+    class_name = class_name.substr(last_slash + 1);
+  }
+  size_t last_dot = class_name.find_last_of('.');
+  if (last_dot != std::string::npos) {
+    class_name = class_name.substr(0, last_dot);
+  }
+  if (class_name.empty()) return "Main";
+  class_name[0] = std::toupper(class_name[0]);
+  return class_name;
+}
+
+}  // namespace
+
 int main(int argc, char** argv) {
   std::vector<std::string> args(argv + 1, argv + argc);
   bool print_ast = false;
   bool print_java = false;
+  bool emit_class = false;
+  // Threads checking function declarations.
+  int threads = 1;
   std::string filename;
 
   for (const auto& arg : args) {
@@ -20,6 +49,14 @@ int main(int argc, char** argv) {
       print_ast = true;
     } else if (arg == "--print-java") {
       print_java = true;
+    } else if (arg == "--emit-class") {
+      emit_class = true;
+    } else if (arg.starts_with("--threads=")) {
+      threads = std::atoi(arg.c_str() + std::string_view("--threads=").size());
+      if (threads < 1) {
+        std::cerr << "Error: --threads needs a positive number." << std::endl;
+        return 1;
+      }
     } else if (arg.starts_with("--")) {
       std::cerr << "Error: Unknown flag '" << arg << "'." << std::endl;
       return 1;
@@ -51,23 +88,37 @@ int main(int argc, char** argv) {
     std::vector<std::string> errors;
     TypeFinder types(*symbols, errors);
 
-    // Extract class name from filename
-    std::string class_name = filename;
-    size_t last_slash = class_name.find_last_of("/\\");
-    if (last_slash != std::string::npos) {
-      class_name = class_name.substr(last_slash + 1);
+    try {
+      std::cout << java::Compile(*driver.result, *symbols, types, ClassName(filename)) << std::endl;
+    } catch (const std::exception& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
     }
-    size_t last_dot = class_name.find_last_of('.');
-    if (last_dot != std::string::npos) {
-      class_name = class_name.substr(0, last_dot);
+  }
+  if (emit_class) {
+    // Writes <ClassName>.class and the classes it uses to the current
+    // directory, with the experimental backend of bytecode::Compile. They run
+    // with Std.class in the class path, which the build compiles from
+    // src/Std.java into the directory of tc if it finds javac.
+    std::unique_ptr<SymbolTable> symbols = SymbolTable::Build(*driver.result);
+    std::vector<std::string> errors;
+    TypeFinder types(*symbols, errors);
+    // The checkers type the tree, so the TypeFinder's errors come with theirs.
+    std::vector<std::string> checker_errors = ListErrors(*driver.result, *symbols, types, threads);
+    errors.insert(errors.end(), checker_errors.begin(), checker_errors.end());
+    for (const std::string& error : errors) std::cerr << error << std::endl;
+    if (!errors.empty()) return 1;
+
+    std::vector<bytecode::ClassFile> class_files;
+    try {
+      class_files = bytecode::Compile(*driver.result, *symbols, types, ClassName(filename));
+    } catch (const std::exception& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
     }
-    if (!class_name.empty()) {
-      class_name[0] = std::toupper(class_name[0]);
-    } else {
-      class_name = "Main";
+    for (const bytecode::ClassFile& class_file : class_files) {
+      std::ofstream(class_file.class_name + ".class", std::ios::binary) << class_file.bytes;
     }
-
-    std::cout << java::Compile(*driver.result, *symbols, types, class_name) << std::endl;
   }
 
   return 0;
@@ -0,0 +1,25 @@
+#include "heap_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<size_t> heap_allocations = 0;
+std::atomic<size_t> heap_bytes = 0;
+}  // namespace
+
+void* operator new(size_t size) {
+  ++heap_allocations;
+  heap_bytes += size;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace testing {
+
+HeapUsage HeapAllocated() { return {heap_allocations, heap_bytes}; }
+
+}  // namespace testing
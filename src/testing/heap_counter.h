@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+
+namespace testing {
+
+// Totals of the replaced global operator new, linked into benchmarks only.
+struct HeapUsage {
+  size_t allocations = 0;
+  size_t bytes = 0;
+};
+
+// Returns the number and size of heap allocations made so far by the whole
+// binary, including those that were freed again.
+HeapUsage HeapAllocated();
+
+}  // namespace testing
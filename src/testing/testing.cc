@@ -1,52 +1,100 @@
 #define _POSIX_C_SOURCE 2
 #include "testing.h"
 
+#include <array>
 #include <cstdio>
-#include <fstream>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
+#include <string_view>
 
 #include "../driver.h"
 
-extern FILE* yyin;
-
 namespace testing {
-std::unique_ptr<syntax::Expr> Parse(std::string_view text,
+std::shared_ptr<syntax::Expr> Parse(std::string_view text,
                                     DriverOptions options) {
-  std::ofstream myfile;
-  std::string file_name = "/tmp/testing.tig";
-  myfile.open(file_name);
-  myfile << text;
-  myfile.close();
-  return ParseFile(file_name, options);
+  Driver driver(options);
+  driver.parseBuffer(text);
+  return std::move(driver.result);
 }
 
-std::unique_ptr<syntax::Expr> ParseFile(const std::string& file_name,
+std::shared_ptr<syntax::Expr> ParseFile(const std::string& file_name,
                                         DriverOptions options) {
-  yyin = fopen(file_name.c_str(), "r");
-  if (!yyin) {
-    std::perror("File opening failed");
-    return nullptr;
-  }
   Driver driver(options);
   driver.parse(file_name);
-  // std::fclose(yyin);
   return std::move(driver.result);
 }
 
+std::string SyntheticProgram(int function_count) {
+  std::ostringstream out;
+  out << "let\n"
+      << "  type intArray = array of int\n"
+      << "  var total := 0\n"
+      << "  var cells := intArray [64] of 0\n";
+  for (int i = 0; i < function_count; ++i) {
+    out << "  function f" << i << "(a: int, b: int): int =\n"
+        << "    let var x := a * 2 + b\n"
+        << "        var s := \"f" << i << "\"\n"
+        << "    in if x > 10 & b <> 0 then (cells[x - x / 64 * 64] := x; x - 1)\n"
+        << "       else " << (i > 0 ? "f" + std::to_string(i - 1) + "(x + 1, b - 1)" : "x") << " end\n";
+  }
+  out << "in\n"
+      << "  total := f" << function_count - 1 << "(1, 2);\n"
+      << "  total\n"
+      << "end\n";
+  return out.str();
+}
+
+std::string NestedLets(int depth) {
+  std::ostringstream out;
+  out << "let var v0 := 0 in\n";
+  for (int i = 1; i < depth; ++i) out << "let var v" << i << " := v0 + " << i << " in\n";
+  out << "v0 + v" << depth - 1 << "\n";
+  for (int i = 0; i < depth; ++i) out << "end\n";
+  return out.str();
+}
+
+std::string DeepProgram(int depth) {
+  std::ostringstream out;
+  out << "let var sum := 1";
+  for (int i = 1; i < depth; ++i) out << "+1";
+  out << " in\n";
+  for (int i = 0; i < depth; ++i) out << "if sum = " << i % 10 << " then " << i % 10 << " else\n";
+  out << "sum\nend\n";
+  return out.str();
+}
+
+std::vector<std::string> DeepNestings(int depth) {
+  auto nest = [&](std::string_view prefix, std::string_view open, std::string_view inner, std::string_view close,
+                  std::string_view suffix) {
+    std::string text(prefix);
+    for (int i = 0; i < depth; ++i) text += open;
+    text += inner;
+    for (int i = 0; i < depth; ++i) text += close;
+    return text += suffix;
+  };
+  return {NestedLets(depth), nest("", "(print(\"a\"); ", "0", ")", ""),
+          nest("let function f(a: int): int = a in ", "f(", "0", ")", " end"),
+          nest("let var i := 0 in ", "while i < 1 do (", "i := i + 1", ")", " end"),
+          nest("", "for i := 0 to 1 do ", "print(\"a\")", "", "")};
+}
+
+std::string Code(std::initializer_list<int> bytes) {
+  std::string code;
+  for (int b : bytes) code.push_back(static_cast<char>(b));
+  return code;
+}
+
 struct PipeDeleter {
   void operator()(FILE* f) const {
     if (f) pclose(f);
   }
 };
 
-std::string RunJava() {
+std::string Run(std::string_view command) {
   std::string result;
-  // Command that works on Cygwin and Linux by avoiding path separator in the
-  // Java classpath.
-  const char* cmd = "test -f /tmp/Std.class || cp -f ../../src/Std.class /tmp;"
-                    "cd /tmp; cp Main.class $(date +%N).class; java Main";
   std::array<char, 128> buffer;
-  std::unique_ptr<FILE, PipeDeleter> pipe(popen(cmd, "r"));
+  std::unique_ptr<FILE, PipeDeleter> pipe(popen(std::string(command).c_str(), "r"));
   if (pipe) {
     while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
       result += buffer.data();
@@ -54,4 +102,24 @@ std::string RunJava() {
   }
   return result;
 }
+
+std::string RunJava() {
+  // Std.class is compiled afresh, so that it is never older than Std.java.
+  std::string std_dir = CompileStd();
+  if (std_dir.empty()) return "";
+  // Command that works on Cygwin and Linux by avoiding path separator in the
+  // Java classpath.
+  return Run("cp " + std_dir + "/Std.class /tmp;"
+             "cd /tmp; cp Main.class $(date +%N).class; java Main");
+}
+
+std::string CompileStd() {
+  // Std.java is next to the directory of the test data.
+  std::string dir = (std::filesystem::temp_directory_path() / "tiger_std").string();
+  std::string source = (std::filesystem::path(TESTDATA_DIR).parent_path() / "Std.java").string();
+  if (!Run("mkdir -p " + dir + " && javac -d " + dir + " " + source + " 2>&1 && echo ok").ends_with("ok\n")) {
+    return "";
+  }
+  return dir;
+}
 } // namespace testing
@@ -1,15 +1,47 @@
 #pragma once
+#include <initializer_list>
+#include <string>
+#include <vector>
+
 #include "../driver.h"
 #include "../syntax.h"
 
 namespace testing {
 
-std::unique_ptr<syntax::Expr> Parse(std::string_view text,
+// Both return the root of the parsed tree, which keeps the source text alive,
+// or null on errors.
+std::shared_ptr<syntax::Expr> Parse(std::string_view text,
                                     DriverOptions options = {});
-std::unique_ptr<syntax::Expr> ParseFile(const std::string& file_name,
+std::shared_ptr<syntax::Expr> ParseFile(const std::string& file_name,
                                         DriverOptions options = {});
 
+// Returns a type-correct Tiger program with a let declaring the given number of
+// functions, about five lines each, for benchmarks on large inputs.
+std::string SyntheticProgram(int function_count);
+
+// Returns a Tiger program of lets nested to the given depth, each declaring one
+// variable initialized from the variable of the outermost let.
+std::string NestedLets(int depth);
+
+// Returns a Tiger program with a sum of the given number of terms and an
+// else-if chain of the given length, whose trees are that deep.
+std::string DeepProgram(int depth);
+
+// Returns Tiger programs of lets, sequences, calls, while bodies and for bodies
+// nested to the given depth.
+std::vector<std::string> DeepNestings(int depth);
+
+// Returns the given bytes, like those of method code, as a string.
+std::string Code(std::initializer_list<int> bytes);
+
+// Returns the standard output of the given shell command.
+std::string Run(std::string_view command);
+
 // Returns output of executing code in /tmp/Main.class with Std.class in
 // classpath.
 std::string RunJava();
+
+// Compiles the library class Std and returns the directory of Std.class, or an
+// empty string if javac fails.
+std::string CompileStd();
 }  // namespace testing
@@ -1,116 +1,159 @@
-
 #include "type_finder.h"
 
-#include <algorithm>
-
 namespace {
 using namespace syntax;
 
-// Helper function to concatenate std::string and std::string_view.
-std::string operator+(std::string&& s, std::string_view v) {
-  s.append(v.data(), v.size());
+// Helper function to concatenate std::string and a symbol's text.
+std::string operator+(std::string&& s, Symbol v) {
+  s.append(v.str());
   return std::move(s);
 }
 
+// Returns true for types that the program does not declare, including the
+// type of errors.
+bool Unresolved(const types::Type* t) {
+  return t->kind == types::Type::kUnknown || t->kind == types::Type::kUnit || t->kind == types::Type::kNil;
+}
+
 }  // namespace
 
-std::string_view TypeFinder::operator()(const Expr& id) {
-  if (auto i = cache_.find(&id); i != cache_.end()) {
-    return i->second;
+const types::Type* TypeFinder::operator()(const Expr& expr) {
+  Cache& cache = *cache_;
+  // Many expressions have the type of another one, like a binary expression
+  // that of its left operand. Such chains are followed in a loop, however long,
+  // and all expressions on them get the type of the last.
+  const size_t chain_start = chain_.size();
+  const types::Type* result = nullptr;
+  for (const Expr* id = &expr; id;) {
+    // Expressions of other trees have no type here.
+    if (id->node_id >= cache.size()) {
+      result = types::Unit();
+      break;
+    }
+    if (const types::Type* cached = cache[id->node_id].load(std::memory_order_relaxed)) {
+      result = cached;
+      break;
+    }
+    // Calls of functions without a declared type infer it from their body. Seed
+    // the cache so that recursion through such calls ends with NOTYPE.
+    cache[id->node_id].store(types::Unit(), std::memory_order_relaxed);
+    chain_.push_back(id->node_id);
+    const Expr* next = nullptr;
+    auto same_as = [&next](const Expr& e) -> const types::Type* {
+      next = &e;
+      return nullptr;
+    };
+    // Record and array literals name their type, which is unknown if undeclared.
+    auto literal_type = [&] {
+      const types::Type* t = symbols_.getBinding(*id).value_type;
+      return t ? t : types::Unit();
+    };
+    // Not all expressions have a value.
+    // > Procedure calls, assignments, if-then, while, break, and sometimes
+    // > if-then-else produce no value and may not appear where a value is
+    // > expected (e.g., (a:=b)+c is illegal). A let expression with nothing
+    // > between the `in` and `end` returns no value.
+    result = std::visit(
+        Overloaded{[](const StringConstant&) { return types::String(); },
+                   [](const IntegerConstant&) { return types::Int(); },
+                   [](const Negated&) { return types::Int(); },
+                   [&](const RecordLiteral&) { return literal_type(); },
+                   [&](const ArrayLiteral&) { return literal_type(); },
+                   [](const Nil&) {
+                     // technically its type is determined from context
+                     return types::Unit();
+                   },
+                   [](const Assignment&) { return types::Unit(); },
+                   [](const IfThen&) { return types::Unit(); },
+                   [](const While&) { return types::Unit(); },
+                   [](const For&) { return types::Unit(); },
+                   [](const Break&) { return types::Unit(); },
+                   [&](const ArenaPtr<LValue>& l) {
+                     // A variable without a declared type has that of its value.
+                     const Binding& b = symbols_.getBinding(*id);
+                     const auto* vd = std::get_if<const VariableDeclaration*>(&b.declaration);
+                     if (vd && *vd && !b.value_type && std::holds_alternative<Identifier>(*l)) {
+                       return same_as(*(*vd)->value);
+                     }
+                     return GetLValueType(*id, *l);
+                   },
+                   // Arithmetic, comparisons, & and | all give ints.
+                   [](const Binary&) { return types::Int(); },
+                   [&](const IfThenElse& ite) { return same_as(*ite.then_expr); },
+                   [&](const Let& l) { return l.body.empty() ? types::Unit() : same_as(*l.body.back()); },
+                   [&](const Parenthesized& p) { return p.exprs.empty() ? types::Unit() : same_as(*p.exprs.back()); },
+                   [&](const FunctionCall& fc) {
+                     const auto* fd = symbols_.getBinding(*id).function();
+                     if (!fd) {
+                       if (const types::Signature* library = types::LibrarySignature(fc.id.str())) {
+                         return library->result;
+                       }
+                       errors_.emplace_back("Function not found: " + fc.id);
+                       return types::Unit();
+                     }
+                     // Ambiguous spec. Does a missing return type declaration
+                     // mean no type or inferred type? Generously assume the
+                     // latter.
+                     const types::Type* declared = symbols_.getSignature(*fd).result;
+                     return declared ? declared : same_as(*fd->body);
+                   }},
+        *id);
+    id = next;
   }
-  // Not all expressions have a value.
-  // > Procedure calls, assignments, if-then, while, break, and sometimes
-  // > if-then-else produce no value and may not appear where a value is
-  // > expected (e.g., (a:=b)+c is illegal). A let expression with nothing
-  // > between the `in` and `end` returns no value.
-  std::string_view result = std::visit(
-      Overloaded{[](const StringConstant&) -> std::string_view { return "string"; },
-                 [](const IntegerConstant&) -> std::string_view { return "int"; },
-                 [](const Negated&) -> std::string_view { return "int"; },
-                 [](const RecordLiteral& rl) -> std::string_view { return rl.type_id; },
-                 [](const ArrayLiteral& al) -> std::string_view { return al.type_id; },
-                 [](const Nil&) -> std::string_view {
-                   // technically its type is determined from context
-                   return "NOTYPE";
-                 },
-                 [](const Assignment&) -> std::string_view { return "NOTYPE"; },
-                 [](const IfThen&) -> std::string_view { return "NOTYPE"; },
-                 [](const While&) -> std::string_view { return "NOTYPE"; },
-                 [](const For&) -> std::string_view { return "NOTYPE"; },
-                 [](const Break&) -> std::string_view { return "NOTYPE"; },
-                 [&](const std::unique_ptr<LValue>& l) { return GetLValueType(id, *l); },
-                 [&](const Binary& b) { return (*this)(*b.left); },
-                 [&](const IfThenElse& ite) { return (*this)(*ite.then_expr); },
-                 [&](const Let& l) -> std::string_view { return l.body.empty() ? "NOTYPE" : (*this)(*l.body.back()); },
-                 [&](const Parenthesized& p) -> std::string_view {
-                   return p.exprs.empty() ? "NOTYPE" : (*this)(*p.exprs.back());
-                 },
-                 [&](const FunctionCall& fc) -> std::string_view {
-                   const auto* fd = symbols_.lookupFunction(id, fc.id);
-                   if (!fd) {
-                     errors_.emplace_back("Function not found: " + fc.id);
-                     return "NOTYPE";
-                   }
-                   // Ambiguous spec. Does a missing return type declaration
-                   // mean no type or inferred type? Generously assume the
-                   // latter.
-                   return fd->type_id ? *fd->type_id : (*this)(*fd->body);
-                 }},
-      id);
-  cache_.emplace(&id, result);
+  for (size_t i = chain_start; i < chain_.size(); ++i) cache[chain_[i]].store(result, std::memory_order_relaxed);
+  chain_.resize(chain_start);
   return result;
 }
 
-// Returns the type-id of the given l-value, or "NOTYPE" in case of errors.
-std::string_view TypeFinder::GetLValueType(const Expr& parent, const LValue& lvalue) {
-  return std::visit(
-      Overloaded{[&](const Identifier& name) -> std::string_view {
-                   return std::visit(Overloaded{[&](const VariableDeclaration* vd) -> std::string_view {
-                                                  return vd->type_id ? *vd->type_id : (*this)(*vd->value);
-                                                },
-                                                [&](const TypeField* tf) -> std::string_view { return tf->type_id; },
-                                                [&](const For*) -> std::string_view { return "int"; },
-                                                [&](std::nullptr_t) -> std::string_view {
-                                                  errors_.emplace_back("Variable not found: " + name);
-                                                  return "NOTYPE";
-                                                }},
-                                     symbols_.lookupStorageLocation(parent, name));
-                 },
-                 [&](const RecordField& rf) -> std::string_view {
-                   // Example: `foo.bar`
-                   std::string_view record_type = this->GetLValueType(parent, *rf.l_value);
-                   const TypeDeclaration* td = symbols_.lookupUnaliasedType(parent, record_type);
-                   if (!td) {
-                     errors_.emplace_back("Type not found: " + record_type);
-                     return "NOTYPE";
-                   }
-                   const auto* tf = std::get_if<TypeFields>(&td->value);
-                   if (!tf) {
-                     errors_.emplace_back("Record type expected: " + record_type);
-                     return "NOTYPE";
-                   }
-                   // Find field named rf.id in the record type.
-                   auto it = std::find_if(tf->begin(), tf->end(), [&](const TypeField& f) { return f.id == rf.id; });
-                   if (it == tf->end()) {
-                     errors_.emplace_back("Record field not found: " + rf.id);
-                     return "NOTYPE";
-                   }
-                   return it->type_id;
-                 },
-                 [&](const ArrayElement& ae) -> std::string_view {
-                   // Example: `foo[7]`
-                   std::string_view array_type = this->GetLValueType(parent, *ae.l_value);
-                   const TypeDeclaration* td = symbols_.lookupUnaliasedType(parent, array_type);
-                   if (!td) {
-                     errors_.emplace_back("Type not found: " + array_type);
-                     return "NOTYPE";
-                   }
-                   const auto* at = std::get_if<ArrayType>(&td->value);
-                   if (!at) {
-                     errors_.emplace_back("Array type expected: " + array_type);
-                     return "NOTYPE";
-                   }
-                   return at->element_type_id;
+// Returns the type of the given l-value, or "NOTYPE" in case of errors.
+const types::Type* TypeFinder::GetLValueType(const Expr& parent, const LValue& lvalue) {
+  // Record fields and array elements around the variable, outermost first.
+  std::vector<const LValue*> path;
+  const LValue* base = &lvalue;
+  while (!std::holds_alternative<Identifier>(*base)) {
+    path.push_back(base);
+    base = std::visit(Overloaded{[](const RecordField& rf) -> const LValue* { return rf.l_value.get(); },
+                                 [](const ArrayElement& ae) -> const LValue* { return ae.l_value.get(); },
+                                 [](const Identifier&) -> const LValue* { return nullptr; }},
+                      *base);
+  }
+  const Binding& b = symbols_.getBinding(parent);
+  const types::Type* type = std::visit(
+      Overloaded{[&](const VariableDeclaration* vd) { return b.value_type ? b.value_type : (*this)(*vd->value); },
+                 [&](const TypeField*) { return b.value_type; },
+                 [&](const For*) { return types::Int(); },
+                 [&](std::nullptr_t) {
+                   errors_.emplace_back("Variable not found: " + std::get<Identifier>(*base));
+                   return types::Unit();
                  }},
-      lvalue);
+      b.storage());
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    type = std::visit(
+        Overloaded{[&](const RecordField& rf) {
+                     // Example: `foo.bar`
+                     if (type->kind != types::Type::kRecord) {
+                       errors_.emplace_back(Unresolved(type) ? "Type not found: " + type->name
+                                                             : "Record type expected: " + type->name);
+                       return types::Unit();
+                     }
+                     const types::Type* field_type = type->field(rf.id);
+                     if (!field_type) {
+                       errors_.emplace_back("Record field not found: " + rf.id);
+                       return types::Unit();
+                     }
+                     return field_type;
+                   },
+                   [&](const ArrayElement&) {
+                     // Example: `foo[7]`
+                     if (type->kind != types::Type::kArray) {
+                       errors_.emplace_back(Unresolved(type) ? "Type not found: " + type->name
+                                                             : "Array type expected: " + type->name);
+                       return types::Unit();
+                     }
+                     return type->canonical->element;
+                   },
+                   [&](const Identifier&) { return type; }},
+        **it);
+  }
+  return type;
 }
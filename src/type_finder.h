@@ -1,38 +1,65 @@
 #pragma once
-#include <string_view>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "symbol_table.h"
 #include "syntax.h"
+#include "types.h"
 
 // Type inference function for Tiger expressions. Caches results. Therefore, it
 // should be created once and passed by reference. Errors detected during type
 // inference, like undeclared variables, are appended to the given vector.
 class TypeFinder {
  public:
-  TypeFinder(const SymbolTable& symbols, std::vector<std::string>& errors) : symbols_(symbols), errors_(errors) {}
+  TypeFinder(const SymbolTable& symbols, std::vector<std::string>& errors)
+      : symbols_(symbols), errors_(errors), cache_(std::make_shared<Cache>(symbols.exprCount())) {}
+  // Creates a finder for typing part of the tree on another thread. It shares
+  // the cache of the given finder, but reports errors to the given vector.
+  // Finders sharing a cache may run concurrently. Their types are the same as
+  // on one thread if each expression not cached yet is typed by only one of
+  // them, as a finder may see the NOTYPE another one puts in the cache while
+  // it infers a result type.
+  TypeFinder(const TypeFinder& shared, std::vector<std::string>& errors)
+      : symbols_(shared.symbols_), errors_(errors), cache_(shared.cache_) {}
   TypeFinder() = delete;
   ~TypeFinder() = default;
-  TypeFinder(const TypeFinder&) = delete;
   TypeFinder& operator=(const TypeFinder&) = delete;
   TypeFinder(TypeFinder&&) = delete;
   TypeFinder& operator=(TypeFinder&&) = delete;
 
-  // Returns the type-id of the given expression, or "NOTYPE" in case of errors.
+  // Returns the type of the given expression, or the unit type named "NOTYPE"
+  // in case of errors.
   // NOTE:
-  // - For simple types and aliases, returns the declared name (e.g. "myint").
-  // - For the special `nil` value, returns "NOTYPE" or "nil"
-  //   depending on context, requiring specific handling in checkers
-  //   (e.g. `is_nil` checks).
-  // - Loop variables are resolved to "int".
-  std::string_view operator()(const syntax::Expr& id);
-  std::string_view operator()(const syntax::VariableDeclaration& vd) {
-    return vd.type_id ? *vd.type_id : (*this)(*vd.value);
+  // - Aliases keep their declared name (e.g. "myint"). Use types::SameType to
+  //   compare types.
+  // - The special `nil` value has the unit type, requiring specific handling
+  //   in checkers (e.g. `is_nil` checks).
+  // - Loop variables are resolved to int.
+  const types::Type* operator()(const syntax::Expr& id);
+  const types::Type* operator()(const syntax::VariableDeclaration& vd) {
+    const types::Type* declared = symbols_.getType(vd);
+    return declared ? declared : (*this)(*vd.value);
   }
 
-  std::string_view GetLValueType(const syntax::Expr& parent, const syntax::LValue& lvalue);
+  // Returns the vector errors are appended to.
+  std::vector<std::string>& errors() const { return errors_; }
+
+  // Returns the type of an l-value of the given expression, which must be the
+  // l-value expression or assignment using it.
+  const types::Type* GetLValueType(const syntax::Expr& parent, const syntax::LValue& lvalue);
 
  private:
   const SymbolTable& symbols_;
   std::vector<std::string>& errors_;
-  std::unordered_map<const syntax::Expr*, std::string_view> cache_;
+  // Type of each expression by NodeId, or null if not found yet. Sized for
+  // the whole tree up front, so that finders sharing it never reallocate it.
+  // Finders on other threads may read and write the same entries. Each entry
+  // is a type on its own, so relaxed order suffices.
+  using Cache = std::vector<std::atomic<const types::Type*>>;
+  std::shared_ptr<Cache> cache_;
+  // Expressions being typed, each having the type of the next, reused across
+  // calls.
+  std::vector<syntax::NodeId> chain_;
 };
@@ -10,7 +10,7 @@ SCENARIO("TypeFinder") {
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(nil);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(nil) == "NOTYPE");
+    REQUIRE(tf(nil)->name == "NOTYPE");
     REQUIRE(errors.empty());
   }
   GIVEN("array type and an array variable") {
@@ -25,7 +25,7 @@ end)");
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(*expr);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(*expr) == "int");
+    REQUIRE(tf(*expr)->name == "int");
     REQUIRE(errors.empty());
   }
   GIVEN("Alias chain") {
@@ -39,7 +39,29 @@ in a[7] end)");
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(*expr);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(*expr) == "int");
+    REQUIRE(tf(*expr)->name == "int");
+    REQUIRE(errors.empty());
+  }
+  GIVEN("Record alias") {
+    auto expr = testing::Parse(R"(
+let
+  type Point = {x: int, y: int}
+  type Alias = Point
+  var a: Alias := nil
+  var p: Point := nil
+in a = p end)");
+    REQUIRE(expr != nullptr);
+    std::vector<std::string> errors;
+    auto symbols = SymbolTable::Build(*expr);
+    TypeFinder tf(*symbols, errors);
+    const auto& comparison = std::get<syntax::Binary>(*std::get<syntax::Let>(*expr).body.back());
+    const types::Type* alias = tf(*comparison.left);
+    const types::Type* point = tf(*comparison.right);
+    REQUIRE(alias->name == "Alias");
+    REQUIRE(point->name == "Point");
+    REQUIRE(alias->canonical == point);
+    REQUIRE(types::SameType(alias, point));
+    REQUIRE(alias->field(syntax::Symbol("y")) == types::Int());
     REQUIRE(errors.empty());
   }
   GIVEN("undeclared variable") {
@@ -48,7 +70,7 @@ in a[7] end)");
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(*expr);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(*expr) == "NOTYPE");
+    REQUIRE(tf(*expr)->name == "NOTYPE");
     REQUIRE(errors.size() == 1);
     REQUIRE(errors[0] == "Variable not found: y");
   }
@@ -63,7 +85,7 @@ end)");
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(*expr);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(*expr) == "NOTYPE");
+    REQUIRE(tf(*expr)->name == "NOTYPE");
     REQUIRE(errors.size() == 1);
     REQUIRE(errors[0] == "Type not found: Foo");
   }
@@ -78,9 +100,24 @@ end)");
     std::vector<std::string> errors;
     auto symbols = SymbolTable::Build(*expr);
     TypeFinder tf(*symbols, errors);
-    REQUIRE(tf(*expr) == "NOTYPE");
+    REQUIRE(tf(*expr)->name == "NOTYPE");
     REQUIRE(errors.size() == 1);
     REQUIRE(errors[0] == "Type not found: Foo");
   }
+  GIVEN("mutually recursive procedures without declared types") {
+    auto expr = testing::Parse(R"(
+let
+  function f(a: int) = g(a + 1)
+  function g(b: int) = f(b - 1)
+in
+  f(0)
+end)");
+    REQUIRE(expr != nullptr);
+    std::vector<std::string> errors;
+    auto symbols = SymbolTable::Build(*expr);
+    TypeFinder tf(*symbols, errors);
+    REQUIRE(tf(*expr)->name == "NOTYPE");
+    REQUIRE(errors.empty());
+  }
 }
 }  // namespace
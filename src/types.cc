@@ -0,0 +1,51 @@
+#include "types.h"
+
+#include <unordered_map>
+
+namespace types {
+
+const Type* Type::field(syntax::Identifier id) const {
+  for (const Field& f : canonical->fields) {
+    if (f.id == id) return f.type;
+  }
+  return nullptr;
+}
+
+const Type* Int() {
+  static const Type type(Type::kInt, syntax::kInt);
+  return &type;
+}
+
+const Type* String() {
+  static const Type type(Type::kString, syntax::kString);
+  return &type;
+}
+
+const Type* Nil() {
+  static const Type type(Type::kNil, syntax::kNil);
+  return &type;
+}
+
+const Type* Unit() {
+  static const Type type(Type::kUnit, syntax::kNoType);
+  return &type;
+}
+
+const Signature* LibrarySignature(std::string_view name) {
+  static const std::unordered_map<std::string_view, Signature> kSignatures = {
+      {"print", {{String()}, Unit()}},
+      {"printi", {{Int()}, Unit()}},
+      {"flush", {{}, Unit()}},
+      {"getchar", {{}, String()}},
+      {"ord", {{String()}, Int()}},
+      {"chr", {{Int()}, String()}},
+      {"size", {{String()}, Int()}},
+      {"substring", {{String(), Int(), Int()}, String()}},
+      {"concat", {{String(), String()}, String()}},
+      {"not", {{Int()}, Int()}},
+      {"exit", {{Int()}, Unit()}}};
+  auto found = kSignatures.find(name);
+  return found == kSignatures.end() ? nullptr : &found->second;
+}
+
+}  // namespace types
@@ -0,0 +1,65 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+#include "symbol.h"
+#include "syntax.h"
+
+namespace types {
+
+// Type of Tiger values. There is one object for each builtin type, each type
+// declaration, and each undeclared type name, so types compare by pointer. An
+// alias is an object of its own, which keeps the name it was declared with,
+// and shares the canonical type of the declaration it names.
+struct Type {
+  enum Kind { kInt, kString, kNil, kUnit, kRecord, kArray, kUnknown };
+  struct Field {
+    syntax::Identifier id;
+    const Type* type;
+  };
+
+  Type(Kind kind, syntax::Symbol name, const syntax::TypeDeclaration* declaration = nullptr)
+      : kind(kind), name(name), declaration(declaration) {}
+  Type(const Type&) = delete;
+  Type& operator=(const Type&) = delete;
+
+  // Returns the type of the field with the given name, or null if not found.
+  const Type* field(syntax::Identifier id) const;
+
+  // Kind of the type, which for an alias is that of the type it stands for.
+  Kind kind;
+  // Name as written in the program. Values of the unit type are the
+  // expressions without a value, and the type of errors, named "NOTYPE".
+  syntax::Symbol name;
+  const syntax::TypeDeclaration* declaration;
+  // The type an alias stands for, or this type for all others.
+  const Type* canonical = this;
+  // Fields of a record in order of declaration. Like the element type of an
+  // array, they are set on the canonical type only.
+  std::vector<Field> fields;
+  // Element type of an array.
+  const Type* element = nullptr;
+};
+
+// Returns true if both are the same type, possibly under different aliases.
+inline bool SameType(const Type* a, const Type* b) { return a->canonical == b->canonical; }
+
+// Builtin types.
+const Type* Int();
+const Type* String();
+const Type* Nil();
+const Type* Unit();
+
+// Parameter types and result type of a function. The result type is null if
+// the function does not declare it.
+struct Signature {
+  std::vector<const Type*> parameters;
+  const Type* result = nullptr;
+};
+
+// Returns the signature of the library function with the given name, like
+// print or ord, or null if there is none. Its result is the unit type for
+// functions without a value.
+const Signature* LibrarySignature(std::string_view name);
+
+}  // namespace types